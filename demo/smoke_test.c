@@ -0,0 +1,750 @@
+//  Smoke test of the library on a tiny generated corpus, run by ctest
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  Runs vocabCount, cooccur, shuffle and glove on a few thousand lines of generated text, then checks that:
+//   - the layout and scheduling options (interleave, batchSize, numaPolicy, pinThreads, hugePages, exportThreads)
+//     leave the text output of a single-threaded run byte-identical to the default;
+//   - training with hot row replicas, or stratified SGD, reaches about the cost per record that plain Hogwild training
+//     does, and stratified SGD with several threads is reproducible; sampling half the records comes within 10% of it;
+//   - checkpoints written in the background are byte-identical to those written between iterations;
+//   - training with a held-out sample stops once the held-out loss stops improving, unless stopPatience is 0;
+//   - a warm start with no iterations gives the words of a smaller, reordered vocabulary the rows they were trained to,
+//     from a binary parameter file exactly and from a double model file to float precision;
+//   - text vectors load with the right size even where words start like numbers, and gloveVectorsNearest returns
+//     the exact nearest neighbors;
+//   - an HNSW index over generated vectors finds at least 95% of the exact nearest neighbors, and a copy of it with a
+//     link past the last row is rejected;
+//   - gloveTrain and gloveModelSave write the same text as glove, and a model file saved from the handle reads back
+//     with the same words and rows, while damaged copies of it are rejected or stay within bounds;
+//   - the word hash written with the model file, and one of 50000 words, find the row of every word and reject others;
+//   - glovePipeline writes the same vocabulary as vocabCount, and a shuffled file holding the same records as cooccur;
+//   - its profile has a span for each stage and training iteration, counting what they processed, and writes out.
+//  Training reseeds rand() before each run, so runs with one thread are reproducible. Prints FAIL lines and exits 1 on
+//  a mismatch.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "glove.h"
+
+#define MAX_STRING_LENGTH 1000
+#define CORPUS_LINES 3000
+#define LINE_TOKENS 20
+#define CORPUS_VOCAB 300
+#define VECTOR_ROWS 4000
+#define VECTOR_SIZE 24
+#define QUERIES 50
+#define K 10
+
+typedef struct cooccur_rec {
+    int word1;
+    int word2;
+    double val;
+} CREC;
+
+/* Header of an index file, as src/index.c writes it */
+typedef struct index_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t count, size, stride;
+    uint32_t m, m0;
+    uint32_t max_level, reserved;
+    uint64_t entry_point;
+    uint64_t rows_offset, levels_offset, upper_index_offset, links0_offset, upper_offset;
+    uint64_t upper_length;
+    uint64_t file_size;
+} INDEX_FILE_HEADER;
+
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/* Lines of words w0 .. w<CORPUS_VOCAB - 1>, skewed towards the low numbers as word counts are */
+static int generate_corpus(const char *file_name) {
+    unsigned long long state = 88172645463325252ULL;
+    long long a, b;
+    FILE *fout = fopen(file_name, "w");
+    if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n", file_name); return 1;}
+    for (a = 0; a < CORPUS_LINES; a++) {
+        for (b = 0; b < LINE_TOKENS; b++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            fprintf(fout, "%sw%llu", (b > 0) ? " " : "", (state % CORPUS_VOCAB) * ((state >> 32) % CORPUS_VOCAB) / CORPUS_VOCAB);
+        }
+        fprintf(fout, "\n");
+    }
+    return fclose(fout);
+}
+
+/* Text vectors of VECTOR_ROWS words with normally distributed values. Some words start like numbers, as "infrequent"
+ * (inf) and "nan" do, which a parser that runs on past the end of a line would take for one more value */
+static int generate_vectors(const char *file_name) {
+    unsigned long long state = 2463534242ULL;
+    double u1, u2;
+    long long a, b;
+    FILE *fout = fopen(file_name, "w");
+    if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n", file_name); return 1;}
+    for (a = 0; a < VECTOR_ROWS; a++) {
+        fprintf(fout, "%s%lld", (a % 100 == 1) ? "infrequent" : (a % 100 == 51) ? "nan" : "v", a);
+        for (b = 0; b < VECTOR_SIZE; b++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            u1 = ((state >> 11) + 1) * (1.0 / 9007199254740993.0);
+            u2 = (state & 0xffff) * (1.0 / 65536.0);
+            fprintf(fout, " %.6f", sqrt(-2 * log(u1)) * cos(6.283185307179586 * u2));
+        }
+        fprintf(fout, "\n");
+    }
+    return fclose(fout);
+}
+
+/* Queries near every 80th row: the row with each value shifted by a small step */
+static void make_queries(const GloveVectors *vectors, float *queries) {
+    int q, b;
+    for (q = 0; q < QUERIES; q++)
+        for (b = 0; b < VECTOR_SIZE; b++)
+            queries[q * VECTOR_SIZE + b] = gloveVectorsRow(vectors, q * 80LL)[b] + ((b + q) % 3 - 1) * 0.05f;
+}
+
+/* Cosine of a query with a row, in double precision */
+static double exact_score(const GloveVectors *vectors, const float *query, long long row) {
+    double dot = 0, norm = 0;
+    int b;
+    for (b = 0; b < VECTOR_SIZE; b++) {
+        dot += (double)query[b] * gloveVectorsRow(vectors, row)[b];
+        norm += (double)query[b] * query[b];
+    }
+    return dot / sqrt(norm);
+}
+
+/* Score of the k-th most similar row to a query, scanning every row */
+static double kth_score(const GloveVectors *vectors, const float *query, int k) {
+    double best[K], score;
+    long long a;
+    int n = 0, b;
+    for (a = 0; a < gloveVectorsCount(vectors); a++) {
+        score = exact_score(vectors, query, a);
+        if (n == k && score <= best[k - 1]) continue;
+        for (b = (n < k) ? n++ : k - 1; b > 0 && best[b - 1] < score; b--) best[b] = best[b - 1];
+        best[b] = score;
+    }
+    return best[k - 1];
+}
+
+/* Whole contents of a file, or NULL if it cannot be read */
+static char *read_file(const char *file_name, long long *length) {
+    char *data;
+    FILE *fin = fopen(file_name, "rb");
+    if (fin == NULL) return NULL;
+    fseek(fin, 0, SEEK_END);
+    *length = ftell(fin);
+    rewind(fin);
+    data = (char*)malloc(*length + 1);
+    if (data != NULL && fread(data, 1, *length, fin) != (size_t)*length) {free(data); data = NULL;}
+    if (data != NULL) data[*length] = 0; // So text files can be searched as strings
+    fclose(fin);
+    return data;
+}
+
+static int same_files(const char *file1, const char *file2) {
+    long long length1 = 0, length2 = 0;
+    char *data1 = read_file(file1, &length1), *data2 = read_file(file2, &length2);
+    int same = data1 != NULL && data2 != NULL && length1 == length2 && memcmp(data1, data2, length1) == 0;
+    free(data1);
+    free(data2);
+    return same;
+}
+
+static int compare_crec(const void *a, const void *b) {
+    const CREC *x = (const CREC*)a, *y = (const CREC*)b;
+    if (x->word1 != y->word1) return (x->word1 < y->word1) ? -1 : 1;
+    if (x->word2 != y->word2) return (x->word2 < y->word2) ? -1 : 1;
+    return (x->val < y->val) ? -1 : (x->val > y->val);
+}
+
+/* Whether two record files hold the same records in any order */
+static int same_records(const char *file1, const char *file2) {
+    long long length1 = 0, length2 = 0;
+    char *data1 = read_file(file1, &length1), *data2 = read_file(file2, &length2);
+    int same = data1 != NULL && data2 != NULL && length1 == length2 && length1 > 0 && length1 % sizeof(CREC) == 0;
+    if (same) {
+        qsort(data1, length1 / sizeof(CREC), sizeof(CREC), compare_crec);
+        qsort(data2, length2 / sizeof(CREC), sizeof(CREC), compare_crec);
+        same = memcmp(data1, data2, length1) == 0;
+    }
+    free(data1);
+    free(data2);
+    return same;
+}
+
+static void default_glove_args(GloveArgs *args) {
+    createGloveArgs(args);
+    args->threads = 1;
+    args->iter = 3;
+    args->vectorSize = 20;
+    args->xMax = 10;
+}
+
+/* Train with one option changed from the defaults and compare the text output with that of the default run */
+static void check_option(const char *name, const GloveArgs *args) {
+    char out[MAX_STRING_LENGTH], what[MAX_STRING_LENGTH];
+    snprintf(out, MAX_STRING_LENGTH, "smoke_%s", name);
+    srand(1);
+    check(glove(args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt", out, NULL) == 0, name);
+    strcat(out, ".txt");
+    snprintf(what, MAX_STRING_LENGTH, "%s changes the text output", name);
+    check(same_files(out, "smoke_default.txt"), what);
+    remove(out);
+}
+
+/* Cost per record of the last iteration, through the telemetry callback */
+static void record_cost(const GloveTelemetry *telemetry, void *user_data) {
+    if (telemetry->iterationDone && telemetry->total.records > 0)
+        *(double*)user_data = telemetry->total.cost / telemetry->total.records;
+}
+
+/* Train with several threads, hot rows, schedule and sample fraction and return the cost per record of the last
+ * iteration, or -1 on failure */
+static double threaded_cost(int hot_rows, int schedule, float sample_fraction) {
+    GloveArgs args;
+    double cost = -1;
+    default_glove_args(&args);
+    args.threads = 4;
+    args.iter = 10;
+    args.hotRows = hot_rows;
+    args.syncEvery = 2000;
+    args.schedule = schedule;
+    args.sampleFraction = sample_fraction;
+    args.telemetry = record_cost;
+    args.telemetryData = &cost;
+    srand(1);
+    if (glove(&args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt", "smoke_threaded", NULL) != 0) return -1;
+    remove("smoke_threaded.txt");
+    return cost;
+}
+
+/* Checkpoints written in the background hold the same parameters as those written between iterations, in every output
+ * format */
+static void check_async_checkpoint(void) {
+    static const char *extensions[] = {"txt", "bin", "ckpt", "glvm", "mph"};
+    GloveArgs args;
+    int a, iter, async, trained = 1, same = 1;
+    char sync_file[MAX_STRING_LENGTH], async_file[MAX_STRING_LENGTH];
+    default_glove_args(&args);
+    args.binary = 2;
+    args.modelFile = 1;
+    args.checkpointEvery = 1;
+    for (async = 0; async < 2; async++) {
+        args.asyncCheckpoint = async;
+        srand(1);
+        trained = trained && glove(&args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt",
+                                   async ? "smoke_async" : "smoke_sync", NULL) == 0;
+    }
+    check(trained, "training with checkpoints");
+    for (iter = 1; iter <= args.iter; iter++) {
+        for (a = 0; a < (int)(sizeof(extensions) / sizeof(extensions[0])); a++) {
+            snprintf(sync_file, MAX_STRING_LENGTH, "smoke_sync.%03d.%s", iter, extensions[a]);
+            snprintf(async_file, MAX_STRING_LENGTH, "smoke_async.%03d.%s", iter, extensions[a]);
+            same = same && same_files(sync_file, async_file);
+            remove(sync_file);
+            remove(async_file);
+        }
+    }
+    for (a = 0; a < (int)(sizeof(extensions) / sizeof(extensions[0])); a++) {
+        snprintf(sync_file, MAX_STRING_LENGTH, "smoke_sync.%s", extensions[a]);
+        snprintf(async_file, MAX_STRING_LENGTH, "smoke_async.%s", extensions[a]);
+        if (a != 2) same = same && same_files(sync_file, async_file); // The final outputs have no checkpoint file
+        remove(sync_file);
+        remove(async_file);
+    }
+    check(same, "asynchronous checkpoints differ from synchronous ones");
+}
+
+/* Count the iterations trained, through the telemetry callback */
+static void count_iteration(const GloveTelemetry *telemetry, void *user_data) {
+    if (telemetry->iterationDone) (*(int*)user_data)++;
+}
+
+/* Iterations a run of at most iter iterations trains with a held-out sample and the given stopping rule, or -1 */
+static int iterations_trained(int iter, float tolerance, int patience) {
+    GloveArgs args;
+    int iterations = 0;
+    FILE *fid;
+    default_glove_args(&args);
+    args.iter = iter;
+    args.heldOut = 2000;
+    args.stopTolerance = tolerance;
+    args.stopPatience = patience;
+    args.telemetry = count_iteration;
+    args.telemetryData = &iterations;
+    srand(1);
+    if (glove(&args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt", "smoke_stop", NULL) != 0) return -1;
+    fid = fopen("smoke_stop.txt", "rb");
+    check(fid != NULL, "training that stops early writes no output");
+    if (fid != NULL) fclose(fid);
+    remove("smoke_stop.txt");
+    return iterations;
+}
+
+/* A held-out loss that must halve every iteration stops training after patience + 1 iterations; patience 0 runs them
+ * all */
+static void check_early_stopping(void) {
+    int stopped = iterations_trained(10, 0.5f, 2), all = iterations_trained(10, 0.5f, 0);
+    check(stopped >= 3 && stopped < 10, "training with a held-out sample does not stop early");
+    check(all == 10, "training with stopPatience 0 stops early");
+}
+
+/* Whether every word of model b has the word and context rows, biases included, that it has in model a, rounded to
+ * float first if <rounded>, as model files are decoded to floats */
+static int same_rows(const GloveModel *a, const GloveModel *b, int rounded) {
+    long long row, other, c;
+    const double *rows[4];
+    for (row = 0; row < gloveModelVocabSize(b); row++) {
+        other = gloveModelFind(a, gloveModelWord(b, row));
+        if (other < 0) return 0;
+        rows[0] = gloveModelWordRow(a, other);
+        rows[1] = gloveModelWordRow(b, row);
+        rows[2] = gloveModelContextRow(a, other);
+        rows[3] = gloveModelContextRow(b, row);
+        for (c = 0; c <= gloveModelVectorSize(b); c++) {
+            if ((rounded ? (double)(float)rows[0][c] : rows[0][c]) != rows[1][c]) return 0;
+            if ((rounded ? (double)(float)rows[2][c] : rows[2][c]) != rows[3][c]) return 0;
+        }
+    }
+    return 1;
+}
+
+/* A run with no iterations warm started from a binary parameter file, or from a double model file of model 0, starts
+ * every word of a reordered, smaller vocabulary from its trained rows */
+static void check_warm_start(void) {
+    GloveArgs args;
+    GloveModel *trained = NULL, *warm = NULL;
+    char line[MAX_STRING_LENGTH];
+    long long words = 0, a;
+    char **lines = (char**)calloc(CORPUS_VOCAB, sizeof(char*));
+    FILE *fin = fopen("smoke_vocab.txt", "r"), *fout;
+
+    /* Every other word of the vocabulary, in reverse order */
+    while (fin != NULL && words < CORPUS_VOCAB && fgets(line, MAX_STRING_LENGTH, fin) != NULL) {
+        lines[words] = (char*)malloc(strlen(line) + 1);
+        strcpy(lines[words++], line);
+    }
+    if (fin != NULL) fclose(fin);
+    fout = fopen("smoke_warm_vocab.txt", "w");
+    for (a = words - 1; a >= 0 && fout != NULL; a -= 2) fputs(lines[a], fout);
+    if (fout != NULL) fclose(fout);
+    for (a = 0; a < words; a++) free(lines[a]);
+    free(lines);
+
+    default_glove_args(&args);
+    args.binary = 2;
+    srand(1);
+    if (gloveTrain(&args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt", "smoke_warm", NULL, &trained) != 0) {
+        check(0, "training the model to warm start from");
+        return;
+    }
+    args.binary = 0;
+    args.model = 0;
+    args.modelFile = 2;
+    check(gloveModelSave(trained, &args, "smoke_warm", NULL) == 0, "saving the model to warm start from");
+
+    default_glove_args(&args);
+    args.iter = 0;
+    args.warmStartFrom = "smoke_warm.bin";
+    args.warmStartVocab = "smoke_vocab.txt";
+    check(gloveTrain(&args, "smoke_cooccurrence.shuf.bin", "smoke_warm_vocab.txt", NULL, NULL, &warm) == 0
+          && gloveModelVocabSize(warm) == (words + 1) / 2 && same_rows(trained, warm, 0),
+          "a warm start from a binary parameter file changes the rows");
+    gloveModelFree(warm);
+    warm = NULL;
+    args.warmStartFrom = "smoke_warm.glvm";
+    args.warmStartVocab = NULL;
+    check(gloveTrain(&args, "smoke_cooccurrence.shuf.bin", "smoke_warm_vocab.txt", NULL, NULL, &warm) == 0
+          && gloveModelVocabSize(warm) == (words + 1) / 2 && same_rows(trained, warm, 1),
+          "a warm start from a model file changes the rows");
+    gloveModelFree(warm);
+    gloveModelFree(trained);
+    remove("smoke_warm.bin");
+    remove("smoke_warm.txt");
+    remove("smoke_warm.glvm");
+    remove("smoke_warm.mph");
+    remove("smoke_warm_vocab.txt");
+}
+
+/* Hot row replicas delay the updates of the most frequent rows and stratified SGD trains on the records block by block,
+ * but both should train as far as Hogwild does; training on half the records per iteration should come close. Threads
+ * of a stratified run never share a row, so the run is reproducible */
+static void check_threaded_training(void) {
+    GloveArgs args;
+    int a, trained = 1;
+    char out[MAX_STRING_LENGTH];
+    double plain = threaded_cost(0, 0, 0), hot = threaded_cost(CORPUS_VOCAB / 10, 0, 0);
+    double stratified = threaded_cost(0, 1, 0), sampled = threaded_cost(0, 0, 0.5f);
+    fprintf(stderr, "Cost per record after 10 iterations: %g with Hogwild, %g with hot rows, %g stratified, "
+            "%g sampled\n", plain, hot, stratified, sampled);
+    check(plain > 0 && hot > 0 && hot < 1.05 * plain, "hot rows train to a higher cost");
+    check(stratified > 0 && stratified < 1.05 * plain, "stratified SGD trains to a higher cost");
+    check(sampled > plain && sampled < 1.1 * plain, "sampling trains to the same cost, or a much higher one");
+
+    default_glove_args(&args);
+    args.threads = 4;
+    args.schedule = 1;
+    for (a = 0; a < 2; a++) {
+        snprintf(out, MAX_STRING_LENGTH, "smoke_stratified%d", a);
+        srand(1);
+        trained = trained && glove(&args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt", out, NULL) == 0;
+    }
+    check(trained && same_files("smoke_stratified0.txt", "smoke_stratified1.txt"),
+          "stratified SGD with several threads is not reproducible");
+    remove("smoke_stratified0.txt");
+    remove("smoke_stratified1.txt");
+}
+
+/* Open copies of a float model file with one byte at a time changed in its header, word offsets and words, or with its
+ * end cut off. They must be rejected, or else give words that end within the mapping */
+static void check_damaged_model(const char *file_name) {
+    long long length = 0, rows_start, a, b, letters = 0;
+    char *data = read_file(file_name, &length);
+    GloveModelFile *file;
+    GloveModelInfo info;
+    FILE *fout;
+    if (data == NULL || gloveModelFileOpen(file_name, &file) != 0) {check(0, "reading the model file"); free(data); return;}
+    gloveModelFileInfo(file, &info);
+    gloveModelFileClose(file);
+    rows_start = length - info.rows * info.rowBytes;
+    for (a = 0; a <= rows_start; a++) {
+        fout = fopen("smoke_damaged.glvm", "wb");
+        if (fout == NULL) {check(0, "writing a damaged model file"); break;}
+        if (a < rows_start) {
+            data[a] ^= 0x5a;
+            fwrite(data, 1, length, fout);
+            data[a] ^= 0x5a;
+        }
+        else fwrite(data, 1, length - 8, fout);
+        fclose(fout);
+        if (gloveModelFileOpen("smoke_damaged.glvm", &file) != 0) continue;
+        gloveModelFileInfo(file, &info);
+        for (b = 0; b < info.rows; b++) letters += strlen(gloveModelFileWord(file, b));
+        gloveModelFileClose(file);
+    }
+    check(letters > 0, "no damaged copy with a changed word opens");
+    free(data);
+    remove("smoke_damaged.glvm");
+}
+
+/* An HNSW index finds most of the exact nearest neighbors, and an index whose links point past its rows is rejected */
+static void check_index(const GloveVectors *vectors) {
+    GloveIndexArgs args;
+    GloveIndex *index = NULL;
+    INDEX_FILE_HEADER header;
+    float queries[QUERIES * VECTOR_SIZE], scores[QUERIES * K];
+    long long rows[QUERIES * K], length = 0, a;
+    uint32_t link;
+    int q, found = 0;
+    char *data;
+    FILE *fout;
+
+    createGloveIndexArgs(&args);
+    args.threads = 2;
+    make_queries(vectors, queries);
+    if (gloveIndexBuild(&args, vectors, "smoke_index.hnsw") != 0 || gloveIndexOpen("smoke_index.hnsw", &index) != 0) {
+        check(0, "building and opening an index");
+        return;
+    }
+    check(gloveIndexSearch(index, queries, QUERIES, K, 64, 2, rows, scores) == 0, "gloveIndexSearch");
+    gloveIndexClose(index);
+    for (q = 0; q < QUERIES; q++) {
+        double threshold = kth_score(vectors, queries + q * VECTOR_SIZE, K) - 1e-5;
+        for (a = 0; a < K; a++) found += rows[q * K + a] >= 0 && exact_score(vectors, queries + q * VECTOR_SIZE, rows[q * K + a]) >= threshold;
+    }
+    fprintf(stderr, "HNSW recall at %d with ef 64: %.3f\n", K, found / (double)(QUERIES * K));
+    check(found >= 0.95 * QUERIES * K, "the index misses more than 5% of the nearest neighbors");
+
+    data = read_file("smoke_index.hnsw", &length);
+    if (data != NULL && length >= (long long)sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
+        link = (uint32_t)header.count; // First link of the first node, one past the last row
+        if (header.links0_offset + 2 * sizeof(uint32_t) <= (uint64_t)length) memcpy(data + header.links0_offset + sizeof(uint32_t), &link, sizeof(link));
+        fout = fopen("smoke_damaged.hnsw", "wb");
+        if (fout != NULL) {
+            fwrite(data, 1, length, fout);
+            fclose(fout);
+        }
+        check(gloveIndexOpen("smoke_damaged.hnsw", &index) != 0, "an index with a link past its rows opens");
+        if (index != NULL) gloveIndexClose(index);
+        index = NULL;
+    }
+    else check(0, "reading the index file");
+    free(data);
+    remove("smoke_index.hnsw");
+    remove("smoke_damaged.hnsw");
+}
+
+/* gloveVectorsNearest returns the exact nearest neighbors, best first */
+static void check_nearest(const GloveVectors *vectors) {
+    float queries[QUERIES * VECTOR_SIZE], scores[QUERIES * K];
+    long long rows[QUERIES * K];
+    double threshold;
+    int q, a, exact = 1;
+
+    make_queries(vectors, queries);
+    if (gloveVectorsNearest(vectors, queries, QUERIES, K, 2, rows, scores) != 0) {check(0, "gloveVectorsNearest"); return;}
+    for (q = 0; q < QUERIES; q++) {
+        threshold = kth_score(vectors, queries + q * VECTOR_SIZE, K) - 1e-5;
+        for (a = 0; a < K; a++) {
+            if (rows[q * K + a] < 0 || exact_score(vectors, queries + q * VECTOR_SIZE, rows[q * K + a]) < threshold
+                || fabs(exact_score(vectors, queries + q * VECTOR_SIZE, rows[q * K + a]) - scores[q * K + a]) > 1e-4
+                || (a > 0 && scores[q * K + a] > scores[q * K + a - 1])) exact = 0;
+        }
+    }
+    check(exact, "gloveVectorsNearest differs from a scan of every row");
+}
+
+static void check_vectors(void) {
+    GloveVectors *vectors = NULL;
+    if (generate_vectors("smoke_vectors.txt") != 0 || gloveVectorsLoad("smoke_vectors.txt", NULL, &vectors) != 0) {
+        check(0, "loading text vectors");
+        return;
+    }
+    check(gloveVectorsCount(vectors) == VECTOR_ROWS && gloveVectorsSize(vectors) == VECTOR_SIZE, "text vector dimensions");
+    check(gloveVectorsFind(vectors, "infrequent101") == 101 && gloveVectorsFind(vectors, "nan151") == 151,
+          "words that start like numbers");
+    check_nearest(vectors);
+    check_index(vectors);
+    gloveVectorsFree(vectors);
+    remove("smoke_vectors.txt");
+}
+
+/* The word hash written next to a model file finds the row of every word and rejects others, and one built from many
+ * more words does too */
+static void check_word_hash(const GloveModelFile *file) {
+    GloveWordHash *hash = NULL;
+    GloveModelInfo info;
+    char **words, word[32];
+    long long a, count = 50000, wrong = 0;
+
+    gloveModelFileInfo(file, &info);
+    if (gloveWordHashOpen("smoke_saved.mph", &hash) != 0) {check(0, "gloveWordHashOpen"); return;}
+    for (a = 0; a < info.rows; a++)
+        wrong += gloveWordHashFind(hash, gloveModelFileWord(file, a)) != a
+                 || gloveWordHashRow(hash, file, gloveModelFileWord(file, a)) != gloveModelFileRow(file, a);
+    wrong += gloveWordHashFind(hash, "not-a-word") != -1 || gloveWordHashRow(hash, file, "not-a-word") != NULL;
+    gloveWordHashClose(hash);
+    check(wrong == 0, "the model's word hash finds wrong rows");
+
+    words = (char**)malloc(count * sizeof(char*));
+    for (a = 0; a < count && words != NULL; a++) {
+        snprintf(word, sizeof(word), "word%lld", a * 7919);
+        words[a] = (char*)malloc(strlen(word) + 1);
+        if (words[a] != NULL) strcpy(words[a], word);
+    }
+    if (words != NULL && gloveWordHashWrite((const char* const*)words, count, "smoke_words.mph") == 0
+        && gloveWordHashOpen("smoke_words.mph", &hash) == 0) {
+        for (wrong = 0, a = 0; a < count; a++) wrong += gloveWordHashFind(hash, words[a]) != a;
+        for (a = 0; a < 1000; a++) {
+            snprintf(word, sizeof(word), "word%lld", a * 7919 + 1);
+            wrong += gloveWordHashFind(hash, word) != -1;
+        }
+        gloveWordHashClose(hash);
+        check(wrong == 0, "a hash of 50000 words finds wrong rows");
+    }
+    else check(0, "writing a hash of 50000 words");
+    for (a = 0; a < count && words != NULL; a++) free(words[a]);
+    free(words);
+    remove("smoke_words.mph");
+}
+
+static void check_model_round_trip(void) {
+    GloveArgs args;
+    GloveModel *model = NULL;
+    GloveModelFile *file = NULL;
+    GloveModelInfo info;
+    const double *combined;
+    long long a, rows;
+
+    default_glove_args(&args);
+    srand(1);
+    check(gloveTrain(&args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt", NULL, NULL, &model) == 0 && model != NULL, "gloveTrain");
+    if (model == NULL) return;
+    args.modelFile = 2;
+    check(gloveModelSave(model, &args, "smoke_saved", NULL) == 0, "gloveModelSave");
+    check(same_files("smoke_saved.txt", "smoke_default.txt"), "gloveModelSave writes other text than glove");
+    check(gloveModelSave(model, &args, NULL, NULL) != 0, "gloveModelSave accepts a NULL output");
+
+    combined = gloveModelCombined(model);
+    if (gloveModelFileOpen("smoke_saved.glvm", &file) == 0) {
+        gloveModelFileInfo(file, &info);
+        rows = gloveModelVocabSize(model);
+        check(info.rows == rows + 1 && info.dim == gloveModelVectorSize(model) && info.dtype == GLOVE_DTYPE_FLOAT64,
+              "model file dimensions");
+        for (a = 0; a < rows && info.rows == rows + 1; a++) {
+            if (strcmp(gloveModelFileWord(file, a), gloveModelWord(model, a)) != 0 ||
+                memcmp(gloveModelFileRow(file, a), combined + a * info.dim, info.dim * sizeof(double)) != 0) {
+                check(0, "model file rows differ from the model");
+                break;
+            }
+        }
+        check_word_hash(file);
+        gloveModelFileClose(file);
+        check_damaged_model("smoke_saved.glvm");
+    }
+    else check(0, "gloveModelFileOpen");
+    gloveModelFree(model);
+    remove("smoke_saved.txt");
+    remove("smoke_saved.glvm");
+    remove("smoke_saved.mph");
+}
+
+/* Index of the first span of the profile with the given name and parent, or -1 */
+static int find_span(const GloveProfile *profile, const char *name, int parent) {
+    int a;
+    GloveProfileSpan span;
+    for (a = 0; a < gloveProfileCount(profile); a++)
+        if (gloveProfileGet(profile, a, &span) == 0 && span.parent == parent && strcmp(span.name, name) == 0) return a;
+    return -1;
+}
+
+/* The profile of a pipeline run has a span for each stage, counting the tokens, cooccurrence records or records
+ * trained on that the stage processed, and one span per training iteration; it writes out as JSON and as a Chrome
+ * trace */
+static void check_profile(const GloveProfile *profile, int iter) {
+    static const char *stages[] = {"vocab_count", "cooccur", "shuffle", "glove"};
+    long long length = 0, tokens = (long long)CORPUS_LINES * LINE_TOKENS, records, expected;
+    int a, iterations = 0, found = 1, counted = 1;
+    char *data = read_file("smoke_cooccurrence.bin", &length);
+    GloveProfileSpan span;
+    free(data);
+    records = length / sizeof(CREC);
+
+    for (a = 0; a < (int)(sizeof(stages) / sizeof(stages[0])); a++) {
+        expected = (a < 2) ? tokens : (a == 2) ? records : iter * records;
+        if (gloveProfileGet(profile, find_span(profile, stages[a], -1), &span) != 0) found = 0;
+        else counted = counted && span.records == expected && span.wallSeconds >= 0;
+    }
+    check(found, "the profile is missing a stage");
+    check(counted, "a stage's span counts other records than the stage processed");
+    for (a = 0; a < gloveProfileCount(profile); a++) {
+        if (gloveProfileGet(profile, a, &span) == 0 && strcmp(span.name, "iter") == 0) {
+            iterations++;
+            check(span.parent == find_span(profile, "glove", -1) && span.records == records,
+                  "a training iteration's span is misplaced or counts other records");
+        }
+    }
+    check(iterations == iter, "the profile has another number of iterations than were trained");
+
+    check(gloveProfileWrite(profile, "smoke_profile.json", GLOVE_PROFILE_JSON) == 0
+          && gloveProfileWrite(profile, "smoke_profile.trace.json", GLOVE_PROFILE_CHROME_TRACE) == 0,
+          "writing the profile");
+    data = read_file("smoke_profile.json", &length);
+    check(data != NULL && length > 12 && strncmp(data, "{\"spans\": [", 11) == 0 && strstr(data, "\"glove\"") != NULL
+          && strcmp(data + length - 4, "\n]}\n") == 0, "the JSON profile");
+    free(data);
+    data = read_file("smoke_profile.trace.json", &length);
+    check(data != NULL && strncmp(data, "{\"displayTimeUnit\"", 18) == 0 && strstr(data, "\"ph\": \"X\"") != NULL,
+          "the Chrome trace profile");
+    free(data);
+    remove("smoke_profile.json");
+    remove("smoke_profile.trace.json");
+}
+
+static void check_pipeline(void) {
+    GlovePipelineArgs args;
+    GloveModel *model = NULL;
+
+    createGlovePipelineArgs(&args);
+    default_glove_args(&args.glove);
+    args.shuffle.arraySize = 10000; // Several chunks, so the writer thread and the merge run
+    check(gloveProfileCreate(&args.profile) == 0, "creating a profile");
+    srand(1);
+    check(glovePipeline(&args, "smoke_corpus.txt", "smoke_pipeline_vocab.txt", "smoke_pipeline.shuf.bin", NULL, NULL,
+                        &model) == 0 && model != NULL, "glovePipeline");
+    check(same_files("smoke_pipeline_vocab.txt", "smoke_vocab.txt"), "glovePipeline writes another vocabulary");
+    check(same_records("smoke_pipeline.shuf.bin", "smoke_cooccurrence.bin"), "glovePipeline shuffles other records");
+    check_profile(args.profile, args.glove.iter);
+    gloveProfileFree(args.profile);
+    args.profile = NULL;
+    gloveModelFree(model);
+    args.glove.processes = 2;
+    check(glovePipeline(&args, "smoke_corpus.txt", NULL, NULL, NULL, NULL, NULL) != 0, "glovePipeline forks workers");
+    remove("smoke_pipeline_vocab.txt");
+    remove("smoke_pipeline.shuf.bin");
+}
+
+int main(void) {
+    VocabCountArgs vocab_args;
+    CooccurArgs cooccur_args;
+    ShuffleArgs shuffle_args;
+    GloveArgs args;
+
+    if (generate_corpus("smoke_corpus.txt") != 0) return 1;
+    createVocabCountArgs(&vocab_args);
+    createCooccurArgs(&cooccur_args);
+    createShuffleArgs(&shuffle_args);
+    shuffle_args.arraySize = 10000;
+    if (vocabCount(&vocab_args, "smoke_corpus.txt", "smoke_vocab.txt") != 0 ||
+        cooccur(&cooccur_args, "smoke_corpus.txt", "smoke_vocab.txt", "smoke_cooccurrence.bin") != 0 ||
+        shuffle(&shuffle_args, "smoke_cooccurrence.bin", "smoke_cooccurrence.shuf.bin") != 0) {
+        fprintf(stderr, "FAIL: preparing the cooccurrences\n");
+        return 1;
+    }
+    check(same_records("smoke_cooccurrence.shuf.bin", "smoke_cooccurrence.bin"), "shuffle loses or changes records");
+
+    default_glove_args(&args);
+    srand(1);
+    if (glove(&args, "smoke_cooccurrence.shuf.bin", "smoke_vocab.txt", "smoke_default", NULL) != 0) {
+        fprintf(stderr, "FAIL: glove\n");
+        return 1;
+    }
+    default_glove_args(&args); args.interleave = 1; check_option("interleave", &args);
+    default_glove_args(&args); args.batchSize = 64; check_option("batch", &args);
+    default_glove_args(&args); args.interleave = 1; args.batchSize = 64; check_option("interleave_batch", &args);
+    default_glove_args(&args); args.numaPolicy = 1; check_option("numa_first_touch", &args);
+    default_glove_args(&args); args.numaPolicy = 2; check_option("numa_interleave", &args);
+    default_glove_args(&args); args.pinThreads = 1; check_option("pin", &args);
+    default_glove_args(&args); args.hugePages = 1; check_option("huge_pages", &args);
+    default_glove_args(&args); args.exportThreads = 2; check_option("export_threads", &args);
+
+    check_threaded_training();
+    check_async_checkpoint();
+    check_early_stopping();
+    check_warm_start();
+    check_vectors();
+    check_model_round_trip();
+    check_pipeline();
+
+    remove("smoke_corpus.txt");
+    remove("smoke_vocab.txt");
+    remove("smoke_cooccurrence.bin");
+    remove("smoke_cooccurrence.shuf.bin");
+    remove("smoke_default.txt");
+    if (failures > 0) {
+        fprintf(stderr, "%d check(s) failed.\n", failures);
+        return 1;
+    }
+    fprintf(stderr, "All checks passed.\n");
+    return 0;
+}
@@ -28,6 +28,99 @@
 extern "C" {
 #endif
 
+/*
+ * vocabCount, cooccur, shuffle, glove and gloveTrain keep all of their state in a context local to the call, so several
+ * calls may run at the same time from different threads of one process, e.g. a hyperparameter sweep. Each call adds its
+ * process id and a call number to the name given for its temporary files, so concurrent calls with the default names
+ * do not share them; output file names are the caller's to keep apart. Two exceptions: the C library's rand() is
+ * shared, so concurrent runs are not reproducible against sequential ones, and glove with processes > 1 forks the
+ * caller, which should not have other calls in flight at that moment.
+ */
+
+/**
+ * Profiling
+ * Resource profiles of vocabCount, cooccur, shuffle and glove. Set the profile field of their args to a profile from
+ * gloveProfileCreate and each call adds a span for itself, with spans for its phases inside it. The records of the
+ * call's span are tokens for vocab_count and cooccur, cooccurrences shuffled for shuffle and trained on for glove;
+ * those of the phases are:
+ *
+ *  vocab_count: count (reading and hashing the corpus; records are tokens), sort (records are distinct words),
+ *    write (records are words written)
+ *  cooccur: vocab (reading the vocabulary; records are words), window (the window loop and its sorted overflow files;
+ *    records are tokens), table (writing the dense table to a temporary file; records are cooccurrences), merge
+ *    (merging the temporary files; records are cooccurrences written)
+ *  shuffle: chunks (shuffling chunks into temporary files), merge (merging them); records are cooccurrences
+ *  glove: setup (sizing the data, initializing parameters, warm starts), iter (one span per iteration; records are
+ *    cooccurrences trained on), save (writing the outputs)
+ *
+ * With a NULL profile, the default, profiling is off and costs a pointer test per phase. Callers may add spans for
+ * their own phases with the same functions, which are safe to call from several threads.
+ *
+ *  GloveProfileSpan
+ *    name, parent (index of the enclosing span, or -1), depth (0 for a span without a parent)
+ *    start: seconds from gloveProfileCreate to the start of the span
+ *    wallSeconds, cpuSeconds: elapsed and CPU time (user + system, of all threads of the process)
+ *    bytesRead, bytesWritten: bytes the process read and wrote, per /proc/self/io on Linux or the process I/O
+ *      counters on Windows; 0 elsewhere
+ *    peakRss: peak resident set size of the process, in bytes, when the span ended
+ *    tempFiles, tempBytes: temporary files written within the span, and their sizes
+ *    records: items processed by the span, as listed above
+ *  CPU time and bytes are process-wide, so spans overlapping in time count each other's work.
+ *
+ *  gloveProfileBegin: start a span inside span <parent> (-1 for none); returns its index, or -1 for a NULL profile
+ *  gloveProfileEnd: end span <span> and any span inside it still open
+ *  gloveProfileAddRecords: add <records> to the records of span <span>
+ *  gloveProfileAddTempFile: count file <fileName>, at its current size, in span <span> and the spans enclosing it
+ *  gloveProfileCount, gloveProfileGet: the number of spans and span <span>, whose name lives as long as the profile
+ *  gloveProfileWrite: write all spans to <fileName> as JSON (GLOVE_PROFILE_JSON) or in the Chrome trace event
+ *    format (GLOVE_PROFILE_CHROME_TRACE), for chrome://tracing or Perfetto
+ */
+#define GLOVE_PROFILE_JSON 0
+#define GLOVE_PROFILE_CHROME_TRACE 1
+typedef struct _GloveProfile GloveProfile;
+typedef struct _GloveProfileSpan {
+    const char *name;
+    int parent, depth;
+    double start, wallSeconds, cpuSeconds;
+    long long bytesRead, bytesWritten, peakRss, tempFiles, tempBytes, records;
+} GloveProfileSpan;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveProfileCreate(GloveProfile** profile);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveProfileBegin(GloveProfile* profile, int parent, const char* name);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveProfileEnd(GloveProfile* profile, int span);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveProfileAddRecords(GloveProfile* profile, int span, long long records);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveProfileAddTempFile(GloveProfile* profile, int span, const char* fileName);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveProfileCount(const GloveProfile* profile);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveProfileGet(const GloveProfile* profile, int span, GloveProfileSpan* result);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveProfileWrite(const GloveProfile* profile, const char* fileName, int format);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveProfileFree(GloveProfile* profile);
+
 /**
  * cooccur
  * Constructs word-word cooccurrence statistics from a corpus. The user should supply a vocabulary file, as produced by
@@ -53,7 +146,10 @@ extern "C" {
  *		array, before writing to disk. This value overrides that which is automatically produced by '-memory'. Typically
  *		only needs adjustment for use with very large corpora; Ignored if <= 0; default -1
  *	overflowFile <char*>
- *		Filename, excluding extension, for temporary files; default overflow
+ *		Filename, excluding extension, for temporary files, followed by _<process id>_<call number> to keep calls
+ *		apart; default overflow
+ *	profile <GloveProfile*>
+ *		Profile to add this call's spans to (see Profiling); default NULL, for none
  *	mode <int>
  *    If <int> = 0 (default), interpret the below arguments as file names and expect to hit disk;
  *    If <int> = 1, interpret the below arguments as strings containing the respective data themselves and expect to use
@@ -75,6 +171,7 @@ typedef struct _CooccurArgs {
     int maxProduct, overflowLength;
     char *overflowFile;
     int mode;
+    GloveProfile *profile;
 } CooccurArgs;
 #ifdef _WIN32
 __declspec(dllexport)
@@ -85,6 +182,44 @@ __declspec(dllexport)
 #endif
 int cooccur(const CooccurArgs* args, const char* corpusIn, const char* vocabIn, char* cooccurOut);
 
+/**
+ * Training telemetry
+ * A GloveTelemetryCallback set in GloveArgs receives the progress of the current iteration. Reports within an
+ * iteration come from a monitor thread and read the training threads' counters without synchronization, so they are
+ * approximate; the report with iterationDone = 1 comes from the calling thread after all training threads finished.
+ * With several processes, only the calling process reports, for its own threads. The report and its thread array are
+ * only valid during the call.
+ *
+ *  GloveThreadStats
+ *    records: cooccurrence records read this iteration
+ *    recordsPerSecond: records / elapsed
+ *    cost: accumulated weighted squared error
+ *    skipped: records whose update was skipped, in whole or in part (the vector or bias step), because of a NaN or
+ *      infinite value
+ *    bytesRead: bytes of cooccurrence data read
+ *    ioWait: seconds spent blocked reading cooccurrence data
+ *  GloveTelemetry
+ *    iter: iteration being trained, starting at 1
+ *    iterationDone: 1 for the final report of the iteration, else 0
+ *    elapsed: seconds since the iteration started
+ *    threads, thread: per-thread statistics
+ *    total: sums over the threads (recordsPerSecond is total records / elapsed)
+ */
+typedef struct _GloveThreadStats {
+    long long records;
+    double recordsPerSecond, cost;
+    long long skipped, bytesRead;
+    double ioWait;
+} GloveThreadStats;
+typedef struct _GloveTelemetry {
+    int iter, iterationDone;
+    double elapsed;
+    int threads;
+    const GloveThreadStats *thread;
+    GloveThreadStats total;
+} GloveTelemetry;
+typedef void (*GloveTelemetryCallback)(const GloveTelemetry* telemetry, void* userData);
+
 /**
  * glove
  * Train the GloVe model on the specified cooccurrence data, which typically will be the output of the `shuffle` tool.
@@ -117,7 +252,128 @@ int cooccur(const CooccurArgs* args, const char* corpusIn, const char* vocabIn,
  *	saveGradsq <int>
  *		Save accumulated squared gradients; default 0 (off);
  *	checkpointEvery <int>
- *		Checkpoint a  model every <int> iterations; default 0 (off)
+ *		Checkpoint a  model every <int> iterations; default 0 (off). Besides the usual outputs, named with the iteration
+ *		number, each checkpoint writes <gloveOut>.<iter>.ckpt, which holds everything needed to resume training
+ *	asyncCheckpoint <int>
+ *		If <int> = 1, checkpoints copy the parameters to a snapshot in memory and a background thread writes it out
+ *		while the next iteration trains, at the cost of one extra copy of the parameters; default 0 (off)
+ *	exportThreads <int>
+ *		If <int> > 0, text output (and gradsq text output) is formatted by <int> threads with a fast fixed-point
+ *		formatter, in chunks that are written out in vocabulary order. The text is identical to the fprintf output;
+ *		values too close to a rounding tie for the fast path are formatted by snprintf. Ignored if <= 0; default 0
+ *	precision <int>
+ *		Digits after the decimal point in text output, 0 to 15; default 6
+ *	modelFile <int>
+ *		Also save the vectors selected by <model>, with the vocabulary and <unk>, to <gloveOut>.glvm (and each checkpoint
+ *		to <gloveOut>.<iter>.glvm) in the binary model file format read by gloveModelFileOpen, next to a word hash
+ *		file of the same name ending in .mph (see gloveWordHashOpen):
+ *		   0: no model file (default)
+ *		   1: 32-bit floats
+ *		   2: 64-bit doubles
+ *		   3: per-row scaled int8
+ *		   4: product quantization with <pqSubspaces> subspaces
+ *	pqSubspaces <int>
+ *		With modelFile = 4, one-byte codes per row; the row's values are split evenly among them. <= 0 for one per 4
+ *		values; default 0
+ *	heldOut <int>
+ *		Keep the last <int> records of the (shuffled) cooccurrence file out of training and report the mean weighted
+ *		squared error on them after every iteration, for early stopping; at most half the file; ignored if <= 0;
+ *		default 0
+ *	stopTolerance <float>
+ *		With heldOut, an iteration improves on the best held-out loss only if it lowers it by more than this fraction;
+ *		default 0.001
+ *	stopPatience <int>
+ *		With heldOut, stop training after <int> iterations in a row without improvement; 0 to always run <iter>
+ *		iterations; default 2
+ *	keepBest <int>
+ *		With heldOut, if <int> = 1, keep a copy of the parameters with the lowest held-out loss and save those as the
+ *		final output instead of the last ones; default 0 (off)
+ *	analogyDir <char*>
+ *		Directory of the word analogy question files (eval/question-data). If set, the word + context vectors in memory
+ *		are scored on them every <analogyEvery> iterations, as gloveAnalogyEvaluate does, and the accuracies are printed
+ *		after the iteration's cost, to track quality without writing and reloading the vectors; default NULL
+ *	analogyEvery <int>
+ *		Iterations between analogy evaluations; default 1
+ *	sampleFraction <float>
+ *		If 0 < <float> < 1, each iteration trains on a sample of about this fraction of the records instead of all of
+ *		them. A record of weight f(X_ij) is kept with probability p = min(1, c * f(X_ij)), with c set by a pass over the
+ *		cooccurrence file before training, and a kept record's weight is divided by p, so the expected update of an
+ *		iteration is unchanged. Heavy records, which carry most of the loss, are trained on every iteration; the long
+ *		tail of rare pairs, whose gradients are tiny, is thinned out. Records are still read, but skipped ones cost no
+ *		parameter updates. Reported costs estimate those of the full data; default 0 (off)
+ *	telemetry <GloveTelemetryCallback>
+ *		Called with progress statistics every <telemetryInterval> seconds while an iteration trains, and once more when
+ *		it completes; ignored if NULL; default NULL
+ *	telemetryData <void*>
+ *		Passed to every call of <telemetry>; default NULL
+ *	telemetryInterval <float>
+ *		Seconds between reports within an iteration; if <= 0, only the end of each iteration is reported; default 1.0
+ *	interleave <int>
+ *		If <int> = 1, store each word's vector, bias and squared gradients together in one cache-line aligned block
+ *		instead of in separate arrays, which roughly halves the cache and TLB misses per update on large vocabularies.
+ *		Output files are identical either way; default 0 (off)
+ *	numaPolicy <int>
+ *		Placement of the parameter arrays on multi-socket machines (Linux only):
+ *		   0: pages land on the node of the thread that initializes them (default)
+ *		   1: first-touch, each training thread faults in an equal slice of the arrays before initialization
+ *		   2: interleave pages round-robin across all NUMA nodes
+ *	pinThreads <int>
+ *		If <int> = 1, pin training thread i to the i-th processor available to the process; default 0 (off)
+ *	hugePages <int>
+ *		Back the parameter arrays with 2 MB pages to reduce TLB misses (Linux only):
+ *		   0: normal pages (default)
+ *		   1: transparent huge pages
+ *		   2: explicit huge pages from the hugetlbfs pool, falling back to 1 if the pool is too small
+ *	batchSize <int>
+ *		If <int> > 0, each thread reads <int> records at a time, computes their weights and logs in one vectorized pass,
+ *		and prefetches the parameter rows of upcoming records while updating the current one. Values of 64-1024 work
+ *		well; results may differ from the unbatched path in the last bits. Ignored if <= 0; default 0
+ *	schedule <int>
+ *		Parallel training schedule:
+ *		   0: lock-free asynchronous SGD (Hogwild), every thread may update any row (default)
+ *		   1: stratified SGD, words and context words are each split into <threads> classes and the records bucketed
+ *		      into <threads> x <threads> blocks; each epoch runs <threads> rounds of blocks that share no rows, so
+ *		      threads never write the same row concurrently. Costs one extra pass over the cooccurrence file and a
+ *		      temporary copy of it on disk
+ *	hotRows <int>
+ *		With the Hogwild schedule, each thread keeps a private replica of the vectors, biases and squared gradients of
+ *		the <int> most frequent words and context words, which receive most of the updates on Zipfian data, and merges
+ *		its changes into the shared parameters every <syncEvery> records. The changes are added as they are, as Hogwild
+ *		would have applied them directly. Ignored if <= 0 or if schedule = 1; default 0
+ *	syncEvery <int>
+ *		Records each thread processes between merges of its hot row replica; default 100000
+ *	processes <int>
+ *		Number of local processes to train with (POSIX only). The calling process forks <int> - 1 workers; each trains
+ *		with <threads> threads on its own shard of the cooccurrence file, in its own copy of the parameters kept in a
+ *		shared memory segment, and the copies are averaged <processSyncs> times per iteration. Implies schedule = 0.
+ *		The workers are forked inside the call, so only use <int> > 1 when no other thread of the calling process is
+ *		running: a forked worker has only the calling thread, and locks the others held stay locked in it. glovePipeline
+ *		refuses <int> > 1 for that reason; default 1
+ *	processSyncs <int>
+ *		Number of times per iteration the processes average their parameters; default 1
+ *	tempFile <char*>
+ *		Filename, excluding extension, for temporary files, followed by _<process id>_<call number> to keep calls
+ *		apart; default temp_glove
+ *	resumeFrom <char*>
+ *		Name of a .ckpt file written by an earlier run with the same vocabulary and vector size. Its parameters and
+ *		iteration count replace random initialization, and training continues with the following iteration. With one
+ *		thread and one process the result is identical to an uninterrupted run; ignored if NULL; default NULL
+ *	warmStartFrom <char*>
+ *		Name of a .ckpt file, or of a binary parameter file (<gloveOut>.bin written with binary = 1 or 2), from an earlier
+ *		run with the same vector size but possibly a different vocabulary. Words of <vocabIn> that are also in
+ *		<warmStartVocab> start from their vectors and biases there (and, from a checkpoint, their squared gradients);
+ *		only new words get random initialization. Training then starts at iteration 1, so <iter> can be set to the few
+ *		iterations of a fine-tune. A binary model file (.glvm) holds its own words: one of model 0 gives word and
+ *		context vectors with biases, one of another model, such as pretrained vectors converted with
+ *		gloveVectorsConvert, only the word vectors. Ignored if NULL or if <resumeFrom> is set; default NULL
+ *	warmStartVocab <char*>
+ *		Vocabulary file the <warmStartFrom> model was trained with; required with it unless it is a model file;
+ *		default NULL
+ *	warmStartEta <float>
+ *		Learning rate of carried-over words relative to new ones, applied by scaling their squared gradients; values
+ *		below 1 keep old words closer to the earlier model; default 1.0
+ *	profile <GloveProfile*>
+ *		Profile to add this call's spans to (see Profiling); default NULL, for none
  *	mode <int>
  *    If <int> = 0 (default), interpret the below arguments as file names and expect to hit disk;
  *    If <int> = 1, interpret the below arguments as strings containing the respective data themselves and expect to use
@@ -141,6 +397,24 @@ typedef struct _GloveArgs {
     int verbose, vectorSize, threads, iter;
     float eta, alpha, xMax;
     int binary, model, saveGradsq, checkpointEvery, mode;
+    // Fields added after the original ones go at the end, so code built against the old layout still lines up
+    int interleave, numaPolicy, pinThreads, hugePages, batchSize, schedule, hotRows, syncEvery;
+    int processes, processSyncs;
+    char *tempFile, *resumeFrom;
+    int asyncCheckpoint, exportThreads, precision, modelFile;
+    int heldOut;
+    float stopTolerance;
+    int stopPatience, keepBest;
+    GloveTelemetryCallback telemetry;
+    void *telemetryData;
+    float telemetryInterval;
+    char *warmStartFrom, *warmStartVocab;
+    float warmStartEta;
+    float sampleFraction;
+    int pqSubspaces;
+    char *analogyDir;
+    int analogyEvery;
+    GloveProfile *profile;
 } GloveArgs;
 #ifdef _WIN32
 __declspec(dllexport)
@@ -151,6 +425,205 @@ __declspec(dllexport)
 #endif
 int glove(const GloveArgs* args, const char* shufCooccurIn, const char* vocabIn, char* gloveOut, char* gradsqOut);
 
+/**
+ * gloveTrain
+ * Same as glove, but also returns the trained parameters in a model handle instead of freeing them, so they can be used
+ * without reading the output files back. gloveOut may be NULL to skip all output files (checkpointEvery is then
+ * ignored) and gradsqOut may be NULL to skip the squared gradients. On success *model is set and must be released with
+ * gloveModelFree; on failure it is NULL.
+ *
+ *  gloveModelVocabSize, gloveModelVectorSize
+ *    Number of words (rows) and vector size, excluding bias
+ *  gloveModelWord
+ *    Word of row <row>, or NULL if out of range
+ *  gloveModelFind
+ *    Row of <word>, or -1 if it is not in the vocabulary
+ *  gloveModelWordRow, gloveModelContextRow
+ *    The word or context vector of row <row>, followed by its bias (vectorSize + 1 values), pointing into the trained
+ *    parameters; NULL if out of range
+ *  gloveModelCombined
+ *    Word + context vectors of all rows, vocabSize x vectorSize values without biases, as written for model 2. Built
+ *    on the first call and kept with the handle; NULL if out of memory
+ *  gloveModelSave
+ *    Write the outputs selected by args (binary, model, saveGradsq, precision, exportThreads, modelFile) to gloveOut and
+ *    gradsqOut, as glove does at the end of training; returns 0 on success, 1 if model, args or gloveOut is NULL or
+ *    writing fails. gradsqOut may be NULL to not write gradsq
+ *  gloveModelFree
+ *    Release the handle and everything it points to
+ */
+typedef struct _GloveModel GloveModel;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveTrain(const GloveArgs* args, const char* shufCooccurIn, const char* vocabIn, char* gloveOut, char* gradsqOut,
+               GloveModel** model);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+long long gloveModelVocabSize(const GloveModel* model);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelVectorSize(const GloveModel* model);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const char* gloveModelWord(const GloveModel* model, long long row);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+long long gloveModelFind(const GloveModel* model, const char* word);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const double* gloveModelWordRow(const GloveModel* model, long long row);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const double* gloveModelContextRow(const GloveModel* model, long long row);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const double* gloveModelCombined(GloveModel* model);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelSave(const GloveModel* model, const GloveArgs* args, char* gloveOut, char* gradsqOut);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveModelFree(GloveModel* model);
+
+/**
+ * gloveBenchmarkUpdates
+ * Time the AdaGrad update glove applies to each cooccurrence record, on its own: <updates> updates of uniformly random
+ * (word, context) pairs of <vocabSize> words, with the vectorSize, eta, alpha, xMax, interleave and hugePages of <args>
+ * and the row prefetching of batchSize > 0, on the calling thread. A vocabulary whose rows fit in cache measures the
+ * arithmetic, a large one the random row loads of training on a real vocabulary. Sets *seconds and returns 0, or
+ * returns 1 if a size is out of range
+ */
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveBenchmarkUpdates(const GloveArgs* args, long long vocabSize, long long updates, double* seconds);
+
+/**
+ * Binary model files
+ * A self-describing file of trained word vectors that can be memory mapped and used in place. A fixed header records
+ * the format version, byte order, value type, the <model> variant of GloveArgs the rows were written for, the vector
+ * size and the number of rows; it is followed by the words, each NUL terminated, and by one row of values per word.
+ * Rows start on 64-byte boundaries and are padded to a multiple of 64 bytes, so they can be handed to vectorized code
+ * as they are. Row i belongs to word i, in vocabulary order; files written by glove end with the <unk> row.
+ *
+ * Values per row (dim) depend on model: 2 * (vectorSize + 1) for model 0 (word vector and bias, then context vector
+ * and bias), vectorSize for models 1 and 2.
+ *
+ * Rows can also be stored quantized, to cut the memory of serving copies:
+ *   GLOVE_DTYPE_INT8: each row is a float scale followed by dim signed bytes, value = scale * code, with the scale set
+ *   by the row's largest magnitude; 4x smaller than float32
+ *   GLOVE_DTYPE_PQ: product quantization. The dim values are split into <subspaces> groups and each group is replaced
+ *   by the one-byte index of its nearest centroid in a k-means codebook of 256 centroids per group, trained on (up to
+ *   65536 of) the rows themselves and stored in the file. Rows are <subspaces> bytes and are not padded; the default
+ *   of one subspace per 4 values is 16x smaller than float32. The writer keeps all rows in memory as floats until
+ *   it is closed, when the codebook is trained
+ * Closing a writer of quantized rows prints the relative RMS reconstruction error, sqrt(sum of squared errors / sum
+ * of squared values), which is also stored in the file.
+ *
+ *  gloveModelFileOpen
+ *    Map the file and check its header; returns 0 and sets *model on success, else prints an error and returns 1
+ *  gloveModelFileInfo
+ *    Fill in the dimensions, value type, PQ subspaces (0 for other types) and reconstruction error (0 for float rows)
+ *    of an open file
+ *  gloveModelFileWord, gloveModelFileRow
+ *    Word and stored data of row <row>, pointing into the mapping (valid until gloveModelFileClose); NULL if out of
+ *    range
+ *  gloveModelFileDecode
+ *    Write the dim values of row <row>, dequantized if need be, to <values>; returns 1 if <row> is out of range
+ *  gloveModelFileDot
+ *    Dot product of row <row> with dim floats of <query>, computed on the stored codes
+ *  gloveModelFileScore
+ *    Dot products of <count> rows starting at <firstRow> with <query>, into <scores>; returns 1 if out of range. For
+ *    PQ rows the query is first multiplied with every centroid, after which each row costs one table lookup per
+ *    subspace instead of dim multiplications, so score many rows per call
+ *
+ *  gloveModelWriterOpen
+ *    Create a file for <rows> rows of the given <model> and <dtype>, with words[0 .. rows - 1]; returns 0 and sets
+ *    *writer on success
+ *  gloveModelWriterOpenPQ
+ *    The same, with the number of PQ subspaces (<= 0 for the default) for dtype GLOVE_DTYPE_PQ
+ *  gloveModelWriterAddRow, gloveModelWriterAddRowF
+ *    Append the next row from dim doubles or floats, converting to the file's type; returns 1 once all rows are written
+ *  gloveModelWriterClose
+ *    Close the file; returns 1 if fewer than <rows> rows were written or the file could not be flushed
+ */
+#define GLOVE_DTYPE_FLOAT32 0
+#define GLOVE_DTYPE_FLOAT64 1
+#define GLOVE_DTYPE_INT8 2
+#define GLOVE_DTYPE_PQ 3
+typedef struct _GloveModelFile GloveModelFile;
+typedef struct _GloveModelWriter GloveModelWriter;
+typedef struct _GloveModelInfo {
+    long long rows;
+    int dim, vectorSize, model, dtype;
+    long long rowBytes;
+    int subspaces;
+    double error;
+} GloveModelInfo;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelFileOpen(const char* fileName, GloveModelFile** model);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveModelFileClose(GloveModelFile* model);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveModelFileInfo(const GloveModelFile* model, GloveModelInfo* info);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const char* gloveModelFileWord(const GloveModelFile* model, long long row);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const void* gloveModelFileRow(const GloveModelFile* model, long long row);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelFileDecode(const GloveModelFile* model, long long row, float* values);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+double gloveModelFileDot(const GloveModelFile* model, long long row, const float* query);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelFileScore(const GloveModelFile* model, const float* query, long long firstRow, long long count, float* scores);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelWriterOpen(const char* fileName, long long rows, int vectorSize, int model, int dtype,
+                         const char* const* words, GloveModelWriter** writer);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelWriterOpenPQ(const char* fileName, long long rows, int vectorSize, int model, int dtype, int subspaces,
+                           const char* const* words, GloveModelWriter** writer);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelWriterAddRow(GloveModelWriter* writer, const double* values);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelWriterAddRowF(GloveModelWriter* writer, const float* values);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveModelWriterClose(GloveModelWriter* writer);
+
 /**
  * shuffle
  * Shuffles the binary file of cooccurrence statistics produced by `cooccur`. For large files, the file is automatically
@@ -167,7 +640,10 @@ int glove(const GloveArgs* args, const char* shufCooccurIn, const char* vocabIn,
  *		Limit to length <int> the buffer which stores chunks of data to shuffle before writing to disk.
  *		This value overrides that which is automatically produced by '-memory'; Ignored if <= 0; default -1
  *	tempFile <char*>
- *		Filename, excluding extension, for temporary files; default temp_shuffle
+ *		Filename, excluding extension, for temporary files, followed by _<process id>_<call number> to keep calls
+ *		apart; default temp_shuffle
+ *	profile <GloveProfile*>
+ *		Profile to add this call's spans to (see Profiling); default NULL, for none
  *	mode <int>
  *    If <int> = 0 (default), interpret the below arguments as file names and expect to hit disk;
  *    If <int> = 1, interpret the below arguments as strings containing the respective data themselves and expect to use
@@ -186,6 +662,7 @@ typedef struct _ShuffleArgs {
     int arraySize;
     char* tempFile;
     int mode;
+    GloveProfile *profile;
 } ShuffleArgs;
 #ifdef _WIN32
 __declspec(dllexport)
@@ -196,6 +673,224 @@ __declspec(dllexport)
 #endif
 int shuffle(const ShuffleArgs* args, const char* cooccurIn, char* shufCooccurOut);
 
+/**
+ * Word vectors
+ * Trained vectors loaded into memory for similarity queries, replacing eval/python/distance.py. Rows are stored as
+ * floats normalized to unit length, so scores are cosine similarities.
+ *
+ *  gloveVectorsLoad
+ *    Load <vectorsFile>, which is a binary model file (see gloveModelFileOpen; files of model 0 give word + context
+ *    vectors), the headerless binary parameters written by glove with binary 1 or 2 if <vocabFile> names their
+ *    vocabulary (word + context vectors), or else a text file of "word value value ..." lines. Returns 0 and sets
+ *    *vectors on success, else prints an error and returns 1. Text files are split between one thread per processor
+ *    at line boundaries and parsed with a float parser much faster than strtof; a word2vec style "<rows> <size>"
+ *    first line is skipped, and words holding spaces (as in the Common Crawl vectors) are taken to be everything
+ *    before the last size values of their line
+ *  gloveVectorsFromModel
+ *    The same for the word + context vectors of a handle returned by gloveTrain
+ *  gloveVectorsConvert
+ *    Parse a text vectors file as gloveVectorsLoad does, on <threads> threads (<= 0 for one per processor), and
+ *    write its vectors as they are, not normalized, to the model file <modelOut> of model 1 and <dtype> (see
+ *    gloveModelWriterOpen). Converting a large pretrained file once makes later loads a mapping of the file, and it
+ *    can be given to warmStartFrom. Returns 0 on success
+ *  gloveVectorsCount, gloveVectorsSize
+ *    Number of rows and values per row
+ *  gloveVectorsWord
+ *    Word of row <row>, or NULL if out of range
+ *  gloveVectorsFind
+ *    Row of <word>, or -1 if it is not there
+ *  gloveVectorsRow
+ *    The normalized vector of row <row> (size floats), or NULL if out of range
+ *  gloveVectorsNearest
+ *    The <k> rows most similar to each of <count> query vectors (size floats each, normalized by the call), best
+ *    first, into rows[q * k .. q * k + k - 1] and their cosines into the same places of <scores>. The rows are split
+ *    between <threads> threads; batching queries into one call reads the rows once for all of them. Rows past the
+ *    number of rows are -1. Returns 1 if k < 1 or out of memory
+ *  gloveVectorsFree
+ *    Release the vectors
+ */
+typedef struct _GloveVectors GloveVectors;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveVectorsLoad(const char* vectorsFile, const char* vocabFile, GloveVectors** vectors);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveVectorsFromModel(GloveModel* model, GloveVectors** vectors);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveVectorsConvert(const char* textFile, const char* modelOut, int dtype, int threads);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+long long gloveVectorsCount(const GloveVectors* vectors);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveVectorsSize(const GloveVectors* vectors);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const char* gloveVectorsWord(const GloveVectors* vectors, long long row);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+long long gloveVectorsFind(const GloveVectors* vectors, const char* word);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const float* gloveVectorsRow(const GloveVectors* vectors, long long row);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveVectorsNearest(const GloveVectors* vectors, const float* queries, int count, int k, int threads,
+                        long long* rows, float* scores);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveVectorsFree(GloveVectors* vectors);
+
+/**
+ * Approximate nearest neighbor index
+ * A hierarchical navigable small world graph over word vectors, for similarity queries that visit a small part of
+ * the rows instead of all of them. The index file holds the normalized rows as well as the graph and is memory mapped
+ * when opened, so processes serving the same index share its pages. Rows are numbered as in the vectors it was built
+ * from.
+ *
+ * Use createGloveIndexArgs to get a default-valued set of parameters for the first argument of gloveIndexBuild.
+ * The following parameters are packaged in the GloveIndexArgs struct:
+ *
+ * 	verbose <int>
+ *		Set verbosity: 0 (default), 1, or 2
+ *	m <int>
+ *		Links per node on the upper layers of the graph, twice as many on the bottom layer; more links raise recall and
+ *		index size; default 16
+ *	efConstruction <int>
+ *		Candidates considered when linking each new node; higher builds a better graph, more slowly; default 200
+ *	threads <int>
+ *		Number of threads inserting nodes; <= 0 for one per processor (default)
+ *	seed <int>
+ *		Seed of the random levels of the nodes; default 0
+ *
+ *  gloveIndexBuild
+ *    Build an index of <vectors> and write it to <indexOut>; returns 0 on success
+ *  gloveIndexOpen
+ *    Map an index file and check its header; returns 0 and sets *index on success, else prints an error and returns 1
+ *  gloveIndexSearch
+ *    The <k> rows most similar to each of <count> query vectors, best first, as gloveVectorsNearest returns them.
+ *    <ef> (at least k) is the number of candidates each query keeps while searching, the recall/latency knob: larger
+ *    values find more of the true neighbors and take longer. Queries are spread over <threads> threads
+ *  gloveIndexClose
+ *    Unmap the index
+ */
+typedef struct _GloveIndexArgs {
+    int verbose, m, efConstruction, threads, seed;
+} GloveIndexArgs;
+typedef struct _GloveIndex GloveIndex;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int createGloveIndexArgs(GloveIndexArgs* emptyArgs);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveIndexBuild(const GloveIndexArgs* args, const GloveVectors* vectors, const char* indexOut);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveIndexOpen(const char* fileName, GloveIndex** index);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveIndexSearch(const GloveIndex* index, const float* queries, int count, int k, int ef, int threads,
+                     long long* rows, float* scores);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveIndexClose(GloveIndex* index);
+
+/**
+ * Word hash files
+ * A minimal perfect hash of a vocabulary, mapped from a file, that finds the row of a word without parsing the
+ * vocabulary or allocating: a lookup reads one 4-byte bucket seed and one 16-byte entry holding the word's 64-bit hash
+ * and row (and, for about 1% of words, one remap slot in between). The file is about 17 bytes per word and is
+ * written next to each model file (see modelFile), so a server can map both and go from word to row data directly.
+ * Words are not stored: an unknown word is rejected by its hash, which wrongly accepts it with probability 2^-64.
+ *
+ *  gloveWordHashWrite
+ *    Hash words[0 .. count - 1], which must be distinct, to rows 0 .. count - 1 and write the file <hashOut>; returns
+ *    0 on success
+ *  gloveWordHashBuild
+ *    The same for the words of <wordsFile>, a binary model file or a vocabulary file (the first field of each line)
+ *  gloveWordHashOpen
+ *    Map the file and check its header; returns 0 and sets *hash on success, else prints an error and returns 1
+ *  gloveWordHashFind
+ *    Row of <word>, or -1 if it is not in the vocabulary
+ *  gloveWordHashRow
+ *    Stored data of the row of <word> in <model> (see gloveModelFileRow), or NULL if it is not in the vocabulary
+ *  gloveWordHashClose
+ *    Unmap the file
+ */
+typedef struct _GloveWordHash GloveWordHash;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveWordHashWrite(const char* const* words, long long count, const char* hashOut);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveWordHashBuild(const char* wordsFile, const char* hashOut);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveWordHashOpen(const char* fileName, GloveWordHash** hash);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+long long gloveWordHashFind(const GloveWordHash* hash, const char* word);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const void* gloveWordHashRow(const GloveWordHash* hash, const GloveModelFile* model, const char* word);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+void gloveWordHashClose(GloveWordHash* hash);
+
+/**
+ * Word analogy evaluation
+ * Scores word vectors on the analogy questions of eval/question-data, as eval/python/evaluate.py does: a question
+ * "a b c d" is answered by the row most similar to b - a + c other than a, b, c and <unk>, and counts only if all four
+ * words are known. The first five question files are semantic, the rest syntactic.
+ *
+ *  gloveAnalogyEvaluate
+ *    Answer every question of the GLOVE_ANALOGY_FILES files in <questionDir> with one batched gloveVectorsNearest
+ *    call on <threads> threads and fill in *result; returns 1 if a file cannot be read
+ *  gloveAnalogyFile
+ *    Name of question file <file>, in the order of the counts of GloveAnalogyResult
+ *
+ *  GloveAnalogyResult
+ *    correct, count: correct and known-word questions of each file
+ *    semanticCorrect, semanticCount, syntacticCorrect, syntacticCount, totalCorrect, totalCount: their sums
+ *    fullCount: all questions, including those with unknown words
+ */
+#define GLOVE_ANALOGY_FILES 14
+typedef struct _GloveAnalogyResult {
+    long long correct[GLOVE_ANALOGY_FILES], count[GLOVE_ANALOGY_FILES];
+    long long semanticCorrect, semanticCount, syntacticCorrect, syntacticCount, totalCorrect, totalCount;
+    long long fullCount;
+} GloveAnalogyResult;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int gloveAnalogyEvaluate(const GloveVectors* vectors, const char* questionDir, int threads, GloveAnalogyResult* result);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+const char* gloveAnalogyFile(int file);
+
 /**
  * vocabCount
  * Constructs unigram counts from a corpus, and optionally thresholds the resulting vocabulary based on total vocabulary
@@ -211,6 +906,8 @@ int shuffle(const ShuffleArgs* args, const char* cooccurIn, char* shufCooccurOut
  *		sampled so as to obtain an even distribution over the alphabet; Ignored if <= 0; default -1
  *	minCount <int>
  *		Lower limit such that words which occur fewer than <int> times are discarded; if < 1 defaults to 1; default 1
+ *	profile <GloveProfile*>
+ *		Profile to add this call's spans to (see Profiling); default NULL, for none
  *	mode <int>
  *    If <int> = 0 (default), interpret the below arguments as file names and expect to hit disk;
  *    If <int> = 1, interpret the below arguments as strings containing the respective data themselves and expect to use
@@ -225,6 +922,7 @@ int shuffle(const ShuffleArgs* args, const char* cooccurIn, char* shufCooccurOut
  */
 typedef struct _VocabCountArgs {
     int verbose, maxVocab, minCount, mode;
+    GloveProfile *profile;
 } VocabCountArgs;
 #ifdef _WIN32
 __declspec(dllexport)
@@ -235,6 +933,66 @@ __declspec(dllexport)
 #endif
 int vocabCount(const VocabCountArgs* args, const char* corpusIn, char* vocabOut);
 
+/**
+ * glovePipeline
+ * Runs vocabCount, cooccur, shuffle and glove on a corpus in one call, handing data from one stage to the next in
+ * memory where the separate calls go through files:
+ *  - the vocabulary stays in memory for cooccur and glove, which would each read vocabOut back;
+ *  - the merged records of cooccur go straight into the chunks of shuffle, so the unshuffled cooccurrence file is
+ *    never written, and each full chunk is shuffled and written by another thread while the merge fills the next;
+ *  - when all records fit in one chunk of shuffle (half its memory), they are shuffled in memory and written out
+ *    without temporary files.
+ * glove then trains from the shuffled records on disk, which it reads again every iteration. The shuffle of the pipeline
+ * shuffles every chunk in full and its chunks hold half as many records as those of shuffle, so shufCooccurOut is a
+ * different permutation of the records than shuffle would write from the same cooccurrences; shuffle is unchanged.
+ * What the pipeline saves is the write and read back of the unshuffled cooccurrence file and of the vocabulary; the
+ * time of the stages themselves, training above all, is the same as for the separate calls.
+ *
+ * Use createGlovePipelineArgs to get a default-valued set of parameters for the first argument of the glovePipeline
+ * call. The following parameters are packaged in the GlovePipelineArgs struct:
+ *
+ *	vocab, cooccur, shuffle, glove
+ *		Args of the stages, as createVocabCountArgs, createCooccurArgs, createShuffleArgs and createGloveArgs set them.
+ *		glove.processes must be 1, as the pipeline runs threads of its own and cannot fork workers safely
+ *	profile <GloveProfile*>
+ *		Profile to add the spans of all stages to, in place of the profile fields of the stage args; default NULL
+ *	mode <int>
+ *    If <int> = 0 (default), interpret the below arguments as file names and expect to hit disk;
+ *    If <int> = 1, interpret the below arguments as strings containing the respective data themselves and expect to use
+ *    lots of memory [NOT IMPLEMENTED YET]
+ *
+ * The following arguments are in addition to the GlovePipelineArgs struct:
+ *
+ *  corpusIn <const char*>
+ *    [EITHER the name of a file OR a string] that contains the corpus
+ *  vocabOut <char*>
+ *    [EITHER the name of a file OR a null char*] to which vocabulary counts will be written; NULL to not write them
+ *  shufCooccurOut <char*>
+ *    [EITHER the name of a file OR a null char*] to which shuffled cooccurrence data will be written; NULL for a
+ *    temporary file named after shuffle.tempFile, removed after training
+ *  gloveOut, gradsqOut <char*>
+ *    As for glove
+ *  model <GloveModel**>
+ *    Receives the trained model as for gloveTrain, or NULL for none
+ */
+typedef struct _GlovePipelineArgs {
+    VocabCountArgs vocab;
+    CooccurArgs cooccur;
+    ShuffleArgs shuffle;
+    GloveArgs glove;
+    GloveProfile *profile;
+    int mode;
+} GlovePipelineArgs;
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int createGlovePipelineArgs(GlovePipelineArgs* emptyArgs);
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int glovePipeline(const GlovePipelineArgs* args, const char* corpusIn, char* vocabOut, char* shufCooccurOut,
+                  char* gloveOut, char* gradsqOut, GloveModel** model);
+
 #ifdef __cplusplus
 }
 #endif
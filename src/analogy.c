@@ -0,0 +1,142 @@
+//  Word analogy evaluation of trained word vectors, the native counterpart of eval/python/evaluate.py
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  Each question "a b c d" asks for the row most similar to b - a + c other than a, b and c, and is answered correctly
+//  if that row is d. All questions of all files are scored in one gloveVectorsNearest call, whose neighbors come out
+//  best first with ties in row order, so the answer is the first of them that is not excluded, as np.argmax picks it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/glove.h"
+
+#define MAX_STRING_LENGTH 1000
+#define CANDIDATES 5 // Neighbors fetched per question: the three question words and <unk> can come before the answer
+#define SEMANTIC_FILES 5 // The first files hold the semantic questions, the rest the syntactic ones
+
+static const char *ANALOGY_FILES[GLOVE_ANALOGY_FILES] = {
+        "capital-common-countries.txt", "capital-world.txt", "currency.txt",
+        "city-in-state.txt", "family.txt", "gram1-adjective-to-adverb.txt",
+        "gram2-opposite.txt", "gram3-comparative.txt", "gram4-superlative.txt",
+        "gram5-present-participle.txt", "gram6-nationality-adjective.txt",
+        "gram7-past-tense.txt", "gram8-plural.txt", "gram9-plural-verbs.txt"
+};
+
+typedef struct question {
+    long long rows[4];
+    int file;
+} QUESTION;
+
+const char* gloveAnalogyFile(int file) {
+    if (file < 0 || file >= GLOVE_ANALOGY_FILES) return NULL;
+    return ANALOGY_FILES[file];
+}
+
+/* Append the questions of one file whose words are all known to *questions, counting every line in *full_count */
+static int read_questions(const GloveVectors *vectors, const char *dir, int file, QUESTION **questions,
+                          long long *count, long long *capacity, long long *full_count) {
+    char file_name[MAX_STRING_LENGTH], line[4 * MAX_STRING_LENGTH], words[4][MAX_STRING_LENGTH];
+    int a, n;
+    FILE *fin;
+
+    snprintf(file_name, sizeof(file_name), "%s/%s", dir, ANALOGY_FILES[file]);
+    fin = fopen(file_name, "r");
+    if (fin == NULL) {fprintf(stderr, "Unable to open file %s.\n", file_name); return 1;}
+    while (fgets(line, sizeof(line), fin) != NULL) {
+        n = sscanf(line, "%999s %999s %999s %999s", words[0], words[1], words[2], words[3]);
+        if (n <= 0) continue;
+        (*full_count)++;
+        if (n < 4) continue;
+        if (*count == *capacity) {
+            *capacity = 2 * *capacity + 1024;
+            *questions = (QUESTION*)realloc(*questions, *capacity * sizeof(QUESTION));
+        }
+        for (a = 0; a < 4 && ((*questions)[*count].rows[a] = gloveVectorsFind(vectors, words[a])) >= 0; a++);
+        if (a < 4) continue;
+        (*questions)[(*count)++].file = file;
+    }
+    fclose(fin);
+    return 0;
+}
+
+int gloveAnalogyEvaluate(const GloveVectors* vectors, const char* questionDir, int threads, GloveAnalogyResult* result) {
+    QUESTION *questions = NULL, *q;
+    long long count = 0, capacity = 0, a, b, *rows, unk = gloveVectorsFind(vectors, "<unk>"), answer;
+    int file, c, size = gloveVectorsSize(vectors);
+    float *queries, *scores;
+    const float *x, *y, *z;
+
+    memset(result, 0, sizeof(GloveAnalogyResult));
+    for (file = 0; file < GLOVE_ANALOGY_FILES; file++)
+        if (read_questions(vectors, questionDir, file, &questions, &count, &capacity, &result->fullCount) != 0) {
+            free(questions);
+            return 1;
+        }
+    if (count == 0) {free(questions); return 0;}
+
+    queries = (float*)malloc(count * size * sizeof(float));
+    rows = (long long*)malloc(count * CANDIDATES * sizeof(long long));
+    scores = (float*)malloc(count * CANDIDATES * sizeof(float));
+    if (queries == NULL || rows == NULL || scores == NULL) {
+        fprintf(stderr, "Out of memory for %lld analogy questions.\n", count);
+        free(questions);
+        free(queries);
+        free(rows);
+        free(scores);
+        return 1;
+    }
+    for (a = 0; a < count; a++) {
+        x = gloveVectorsRow(vectors, questions[a].rows[0]);
+        y = gloveVectorsRow(vectors, questions[a].rows[1]);
+        z = gloveVectorsRow(vectors, questions[a].rows[2]);
+        for (c = 0; c < size; c++) queries[a * size + c] = y[c] - x[c] + z[c];
+    }
+    if (gloveVectorsNearest(vectors, queries, (int)count, CANDIDATES, threads, rows, scores) != 0) {
+        free(questions);
+        free(queries);
+        free(rows);
+        free(scores);
+        return 1;
+    }
+
+    for (a = 0; a < count; a++) {
+        q = &questions[a];
+        for (b = 0, answer = -1; b < CANDIDATES && answer < 0; b++) {
+            answer = rows[a * CANDIDATES + b];
+            if (answer == q->rows[0] || answer == q->rows[1] || answer == q->rows[2] || answer == unk) answer = -1;
+        }
+        result->count[q->file]++;
+        if (answer == q->rows[3]) result->correct[q->file]++;
+    }
+    for (file = 0; file < GLOVE_ANALOGY_FILES; file++) {
+        if (file < SEMANTIC_FILES) {
+            result->semanticCorrect += result->correct[file];
+            result->semanticCount += result->count[file];
+        }
+        else {
+            result->syntacticCorrect += result->correct[file];
+            result->syntacticCount += result->count[file];
+        }
+    }
+    result->totalCorrect = result->semanticCorrect + result->syntacticCorrect;
+    result->totalCount = result->semanticCount + result->syntacticCount;
+    free(questions);
+    free(queries);
+    free(rows);
+    free(scores);
+    return 0;
+}
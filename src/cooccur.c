@@ -28,6 +28,7 @@
 #include <string.h>
 #include <math.h>
 #include "../include/glove.h"
+#include "pipeline.h"
 
 #define TSIZE 1048576
 #define SEED 1159241
@@ -55,14 +56,22 @@ typedef struct hashrec {
     struct hashrec *next;
 } HASHREC;
 
-static int verbose; // 0, 1, or 2
-static long long max_product; // Cutoff for product of word frequency ranks below which cooccurrence counts will be stored in a compressed full array
-static long long overflow_length; // Number of cooccurrence records whose product exceeds max_product to store in memory before writing to disk
-static int window_size; // default context window size
-static int symmetric; // 0: asymmetric, 1: symmetric
-static real memory_limit; // soft limit, in gigabytes, used to estimate optimal array sizes
-static char *vocab_file, *file_head;
-static FILE *in, *out;
+/* State of one cooccur() call */
+typedef struct cooccur_context {
+    int verbose; // 0, 1, or 2
+    long long max_product; // Cutoff for product of word frequency ranks below which cooccurrence counts will be stored in a compressed full array
+    long long overflow_length; // Number of cooccurrence records whose product exceeds max_product to store in memory before writing to disk
+    int window_size; // default context window size
+    int symmetric; // 0: asymmetric, 1: symmetric
+    real memory_limit; // soft limit, in gigabytes, used to estimate optimal array sizes
+    char vocab_file[MAX_STRING_LENGTH], file_head[MAX_STRING_LENGTH];
+    FILE *in, *out;
+    const GLOVE_VOCAB *vocab; // Vocabulary in memory, read instead of vocab_file; NULL for none
+    GLOVE_RECORD_SINK sink; // Receives the merged records instead of out; NULL for none
+    void *sink_data;
+    GloveProfile *profile;
+    int profile_span; // Span of this call, -1 when not profiling
+} COOCCUR_CONTEXT;
 
 /* Efficient string comparison */
 static int scmp( char *s1, char *s2 ) {
@@ -215,32 +224,37 @@ static void delete(CRECID *pq, int size) {
     }
 }
 
+/* Send a merged record to the output file, or to the sink in its place */
+static void emit(COOCCUR_CONTEXT *ctx, CRECID *r) {
+    if (ctx->sink != NULL) ctx->sink(ctx->sink_data, r->word1, r->word2, r->val);
+    else fwrite(r, sizeof(CREC), 1, ctx->out);
+}
+
 /* Write top node of priority queue to file, accumulating duplicate entries */
-static int merge_write(CRECID new, CRECID *old, FILE *fout) {
+static int merge_write(COOCCUR_CONTEXT *ctx, CRECID new, CRECID *old) {
     if (new.word1 == old->word1 && new.word2 == old->word2) {
         old->val += new.val;
         return 0; // Indicates duplicate entry
     }
-    fwrite(old, sizeof(CREC), 1, fout);
+    emit(ctx, old);
     *old = new;
     return 1; // Actually wrote to file
 }
 
 /* Merge [num] sorted files of cooccurrence records */
-static int merge_files(int num) {
-    int i, size;
+static int merge_files(COOCCUR_CONTEXT *ctx, int num) {
+    int i, size, span = gloveProfileBegin(ctx->profile, ctx->profile_span, "merge");
     long long counter = 0;
     CRECID *pq, new, old;
-    char filename[200];
-    FILE **fid, *fout;
+    char filename[MAX_STRING_LENGTH + 32];
+    FILE **fid;
     fid = malloc(sizeof(FILE) * num);
     pq = malloc(sizeof(CRECID) * num);
-    fout = out;
-    if (verbose > 1) fprintf(stderr, "Merging cooccurrence files: processed 0 lines.");
+    if (ctx->verbose > 1) fprintf(stderr, "Merging cooccurrence files: processed 0 lines.");
     
     /* Open all files and add first entry of each to priority queue */
     for (i = 0; i < num; i++) {
-        sprintf(filename,"%s_%04d.bin",file_head,i);
+        if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, i) != 0) return 1;
         fid[i] = fopen(filename,"rb");
         if (fid[i] == NULL) {fprintf(stderr, "Unable to open file %s.\n",filename); return 1;}
         fread(&new, sizeof(CREC), 1, fid[i]);
@@ -262,8 +276,8 @@ static int merge_files(int num) {
     
     /* Repeatedly pop top node and fill priority queue until files have reached EOF */
     while (size > 0) {
-        counter += merge_write(pq[0], &old, fout); // Only count the lines written to file, not duplicates
-        if ((counter%100000) == 0) if (verbose > 1) fprintf(stderr,"\033[39G%lld lines.",counter);
+        counter += merge_write(ctx, pq[0], &old); // Only count the lines written to file, not duplicates
+        if ((counter%100000) == 0) if (ctx->verbose > 1) fprintf(stderr,"\033[39G%lld lines.",counter);
         i = pq[0].id;
         delete(pq, size);
         fread(&new, sizeof(CREC), 1, fid[i]);
@@ -273,44 +287,53 @@ static int merge_files(int num) {
             insert(pq, new, size);
         }
     }
-    fwrite(&old, sizeof(CREC), 1, fout);
+    emit(ctx, &old);
+    if (ctx->out != NULL) fflush(ctx->out);
     fprintf(stderr,"\033[0GMerging cooccurrence files: processed %lld lines.\n",++counter);
+    gloveProfileAddRecords(ctx->profile, span, counter);
     for (i=0;i<num;i++) {
-        sprintf(filename,"%s_%04d.bin",file_head,i);
-        remove(filename);
+        if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, i) == 0) remove(filename);
     }
+    gloveProfileEnd(ctx->profile, span);
     fprintf(stderr,"\n");
     return 0;
 }
 
 /* Collect word-word cooccurrence counts from input stream */
-static int get_cooccurrence() {
-    int flag, x, y, fidcounter = 1;
-    long long a, j = 0, k, id, counter = 0, ind = 0, vocab_size, w1, w2, *lookup, *history;
-    char format[20], filename[200], str[MAX_STRING_LENGTH + 1];
+static int get_cooccurrence(COOCCUR_CONTEXT *ctx) {
+    int flag, x, y, fidcounter = 1, span;
+    long long a, j = 0, k, id, counter = 0, ind = 0, vocab_size, w1, w2, *lookup, *history, written = 0;
+    char format[20], filename[MAX_STRING_LENGTH + 32], str[MAX_STRING_LENGTH + 1];
     FILE *fid, *foverflow;
     real *bigram_table, r;
     HASHREC *htmp, **vocab_hash = inithashtable();
-    CREC *cr = malloc(sizeof(CREC) * (overflow_length + 1));
-    history = malloc(sizeof(long long) * window_size);
+    CREC *cr = malloc(sizeof(CREC) * (ctx->overflow_length + 1));
+    history = malloc(sizeof(long long) * ctx->window_size);
     
     fprintf(stderr, "COUNTING COOCCURRENCES\n");
-    if (verbose > 0) {
-        fprintf(stderr, "window size: %d\n", window_size);
-        if (symmetric == 0) fprintf(stderr, "context: asymmetric\n");
+    if (ctx->verbose > 0) {
+        fprintf(stderr, "window size: %d\n", ctx->window_size);
+        if (ctx->symmetric == 0) fprintf(stderr, "context: asymmetric\n");
         else fprintf(stderr, "context: symmetric\n");
     }
-    if (verbose > 1) fprintf(stderr, "max product: %lld\n", max_product);
-    if (verbose > 1) fprintf(stderr, "overflow length: %lld\n", overflow_length);
+    if (ctx->verbose > 1) fprintf(stderr, "max product: %lld\n", ctx->max_product);
+    if (ctx->verbose > 1) fprintf(stderr, "overflow length: %lld\n", ctx->overflow_length);
     sprintf(format,"%%%ds %%lld", MAX_STRING_LENGTH); // Format to read from vocab file, which has (irrelevant) frequency data
-    if (verbose > 1) fprintf(stderr, "Reading vocab from file \"%s\"...", vocab_file);
-    fid = fopen(vocab_file,"r");
-    if (fid == NULL) {fprintf(stderr,"Unable to open vocab file %s.\n",vocab_file); return 1;}
-    while (fscanf(fid, format, str, &id) != EOF) hashinsert(vocab_hash, str, ++j); // Here id is not used: inserting vocab words into hash table with their frequency rank, j
-    fclose(fid);
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "vocab");
+    if (ctx->vocab != NULL) {
+        if (ctx->verbose > 1) fprintf(stderr, "Hashing vocab...");
+        for (a = 0; a < ctx->vocab->size; a++) hashinsert(vocab_hash, ctx->vocab->words + ctx->vocab->offsets[a], ++j);
+    }
+    else {
+        if (ctx->verbose > 1) fprintf(stderr, "Reading vocab from file \"%s\"...", ctx->vocab_file);
+        fid = fopen(ctx->vocab_file,"r");
+        if (fid == NULL) {fprintf(stderr,"Unable to open vocab file %s.\n",ctx->vocab_file); return 1;}
+        while (fscanf(fid, format, str, &id) != EOF) hashinsert(vocab_hash, str, ++j); // Here id is not used: inserting vocab words into hash table with their frequency rank, j
+        fclose(fid);
+    }
     vocab_size = j;
     j = 0;
-    if (verbose > 1) fprintf(stderr, "loaded %lld words.\nBuilding lookup table...", vocab_size);
+    if (ctx->verbose > 1) fprintf(stderr, "loaded %lld words.\nBuilding lookup table...", vocab_size);
     
     /* Build auxiliary lookup table used to index into bigram_table */
     lookup = (long long *)calloc( vocab_size + 1, sizeof(long long) );
@@ -320,10 +343,10 @@ static int get_cooccurrence() {
     }
     lookup[0] = 1;
     for (a = 1; a <= vocab_size; a++) {
-        if ((lookup[a] = max_product / a) < vocab_size) lookup[a] += lookup[a-1];
+        if ((lookup[a] = ctx->max_product / a) < vocab_size) lookup[a] += lookup[a-1];
         else lookup[a] = lookup[a-1] + vocab_size;
     }
-    if (verbose > 1) fprintf(stderr, "table contains %lld elements.\n",lookup[a-1]);
+    if (ctx->verbose > 1) fprintf(stderr, "table contains %lld elements.\n",lookup[a-1]);
     
     /* Allocate memory for full array which will store all cooccurrence counts for words whose product of frequency ranks is less than max_product */
     bigram_table = (real *)calloc( lookup[a-1] , sizeof(real) );
@@ -331,44 +354,50 @@ static int get_cooccurrence() {
         fprintf(stderr, "Couldn't allocate memory!");
         return 1;
     }
+    gloveProfileAddRecords(ctx->profile, span, vocab_size);
+    gloveProfileEnd(ctx->profile, span);
     
-    fid = in;
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "window");
+    fid = ctx->in;
     sprintf(format,"%%%ds",MAX_STRING_LENGTH);
-    sprintf(filename,"%s_%04d.bin",file_head, fidcounter);
+    if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, fidcounter) != 0) return 1;
     foverflow = fopen(filename,"wb");
-    if (verbose > 1) fprintf(stderr,"Processing token: 0");
+    if (foverflow == NULL) {fprintf(stderr, "Unable to open file %s.\n",filename); return 1;}
+    if (ctx->verbose > 1) fprintf(stderr,"Processing token: 0");
     
     /* For each token in input stream, calculate a weighted cooccurrence sum within window_size */
     while (1) {
-        if (ind >= overflow_length - window_size) { // If overflow buffer is (almost) full, sort it and write it to temporary file
+        if (ind >= ctx->overflow_length - 2 * ctx->window_size) { // If overflow buffer is (almost) full, sort it and write it to temporary file; a symmetric token adds up to 2 * window_size records
             qsort(cr, ind, sizeof(CREC), compare_crec);
             write_chunk(cr,ind,foverflow);
             fclose(foverflow);
+            gloveProfileAddTempFile(ctx->profile, span, filename);
             fidcounter++;
-            sprintf(filename,"%s_%04d.bin",file_head,fidcounter);
+            if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, fidcounter) != 0) return 1;
             foverflow = fopen(filename,"wb");
+            if (foverflow == NULL) {fprintf(stderr, "Unable to open file %s.\n",filename); return 1;}
             ind = 0;
         }
         flag = get_word(str, fid);
         if (feof(fid)) break;
         if (flag == 1) {j = 0; continue;} // Newline, reset line index (j)
         counter++;
-        if ((counter%100000) == 0) if (verbose > 1) fprintf(stderr,"\033[19G%lld",counter);
+        if ((counter%100000) == 0) if (ctx->verbose > 1) fprintf(stderr,"\033[19G%lld",counter);
         htmp = hashsearch(vocab_hash, str);
         if (htmp == NULL) continue; // Skip out-of-vocabulary words
         w2 = htmp->id; // Target word (frequency rank)
-        for (k = j - 1; k >= ( (j > window_size) ? j - window_size : 0 ); k--) { // Iterate over all words to the left of target word, but not past beginning of line
-            w1 = history[k % window_size]; // Context word (frequency rank)
-            if ( w1 < max_product/w2 ) { // Product is small enough to store in a full array
+        for (k = j - 1; k >= ( (j > ctx->window_size) ? j - ctx->window_size : 0 ); k--) { // Iterate over all words to the left of target word, but not past beginning of line
+            w1 = history[k % ctx->window_size]; // Context word (frequency rank)
+            if ( w1 < ctx->max_product/w2 ) { // Product is small enough to store in a full array
                 bigram_table[lookup[w1-1] + w2 - 2] += 1.0/((real)(j-k)); // Weight by inverse of distance between words
-                if (symmetric > 0) bigram_table[lookup[w2-1] + w1 - 2] += 1.0/((real)(j-k)); // If symmetric context is used, exchange roles of w2 and w1 (ie look at right context too)
+                if (ctx->symmetric > 0) bigram_table[lookup[w2-1] + w1 - 2] += 1.0/((real)(j-k)); // If symmetric context is used, exchange roles of w2 and w1 (ie look at right context too)
             }
             else { // Product is too big, data is likely to be sparse. Store these entries in a temporary buffer to be sorted, merged (accumulated), and written to file when it gets full.
                 cr[ind].word1 = w1;
                 cr[ind].word2 = w2;
                 cr[ind].val = 1.0/((real)(j-k));
                 ind++; // Keep track of how full temporary buffer is
-                if (symmetric > 0) { // Symmetric context
+                if (ctx->symmetric > 0) { // Symmetric context
                     cr[ind].word1 = w2;
                     cr[ind].word2 = w1;
                     cr[ind].val = 1.0/((real)(j-k));
@@ -376,44 +405,54 @@ static int get_cooccurrence() {
                 }
             }
         }
-        history[j % window_size] = w2; // Target word is stored in circular buffer to become context word in the future
+        history[j % ctx->window_size] = w2; // Target word is stored in circular buffer to become context word in the future
         j++;
     }
     
     /* Write out temp buffer for the final time (it may not be full) */
-    if (verbose > 1) fprintf(stderr,"\033[0GProcessed %lld tokens.\n",counter);
+    if (ctx->verbose > 1) fprintf(stderr,"\033[0GProcessed %lld tokens.\n",counter);
     qsort(cr, ind, sizeof(CREC), compare_crec);
     write_chunk(cr,ind,foverflow);
-    sprintf(filename,"%s_0000.bin",file_head);
+    fclose(foverflow);
+    gloveProfileAddTempFile(ctx->profile, span, filename);
+    gloveProfileAddRecords(ctx->profile, span, counter);
+    gloveProfileAddRecords(ctx->profile, ctx->profile_span, counter);
+    gloveProfileEnd(ctx->profile, span);
+    if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, 0) != 0) return 1;
     
     /* Write out full bigram_table, skipping zeros */
-    if (verbose > 1) fprintf(stderr, "Writing cooccurrences to disk");
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "table");
+    if (ctx->verbose > 1) fprintf(stderr, "Writing cooccurrences to disk");
     fid = fopen(filename,"wb");
+    if (fid == NULL) {fprintf(stderr, "Unable to open file %s.\n",filename); return 1;}
     j = 1e6;
     for (x = 1; x <= vocab_size; x++) {
-        if ( (long long) (0.75*log(vocab_size / x)) < j) {j = (long long) (0.75*log(vocab_size / x)); if (verbose > 1) fprintf(stderr,".");} // log's to make it look (sort of) pretty
+        if ( (long long) (0.75*log(vocab_size / x)) < j) {j = (long long) (0.75*log(vocab_size / x)); if (ctx->verbose > 1) fprintf(stderr,".");} // log's to make it look (sort of) pretty
         for (y = 1; y <= (lookup[x] - lookup[x-1]); y++) {
             if ((r = bigram_table[lookup[x-1] - 2 + y]) != 0) {
                 fwrite(&x, sizeof(int), 1, fid);
                 fwrite(&y, sizeof(int), 1, fid);
                 fwrite(&r, sizeof(real), 1, fid);
+                written++;
             }
         }
     }
     
-    if (verbose > 1) fprintf(stderr,"%d files in total.\n",fidcounter + 1);
+    if (ctx->verbose > 1) fprintf(stderr,"%d files in total.\n",fidcounter + 1);
     fclose(fid);
-    fclose(foverflow);
+    gloveProfileAddTempFile(ctx->profile, span, filename);
+    gloveProfileAddRecords(ctx->profile, span, written);
+    gloveProfileEnd(ctx->profile, span);
     free(cr);
     free(lookup);
     free(bigram_table);
     free(vocab_hash);
-    return merge_files(fidcounter + 1); // Merge the sorted temporary files
+    return merge_files(ctx, fidcounter + 1); // Merge the sorted temporary files
 }
 
 static const CooccurArgs DEFAULT_COOCCUR_ARGS = {
         .verbose = 0, .symmetric = 1, .windowSize = 15, .memory = 4, .maxProduct = -1,
-        .overflowLength = -1, .overflowFile = "overflow", .mode = 0
+        .overflowLength = -1, .overflowFile = "overflow", .mode = 0, .profile = NULL
 };
 
 int createCooccurArgs(CooccurArgs* emptyArgs) {
@@ -421,7 +460,8 @@ int createCooccurArgs(CooccurArgs* emptyArgs) {
     return 0;
 }
 
-int cooccur(const CooccurArgs* args, const char* corpusIn, const char* vocabIn, char* cooccurOut) {
+static int run_cooccur(const CooccurArgs* args, const char* corpusIn, const char* vocabIn, char* cooccurOut,
+                       const GLOVE_VOCAB* vocab, GLOVE_RECORD_SINK sink, void* sink_data) {
     /*if (args->verbose) {
         fprintf(stderr, "cooccur received the following args:\nsymmetric: %i\nwindowSize: %i\nmemory: %f\nmaxProduct: "
                 "%i\noverflowLength: %i\noverflowFile: %s\nmode: %i\ncorpusIn: %s\nvocabIn: %s\ncooccurOut: %s\n",
@@ -429,37 +469,56 @@ int cooccur(const CooccurArgs* args, const char* corpusIn, const char* vocabIn,
                 args->overflowFile, args->mode, corpusIn, vocabIn, cooccurOut);
     }*/
 
+    COOCCUR_CONTEXT ctx;
     real rlimit, n = 1e5;
-    vocab_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
-    file_head = malloc(sizeof(char) * MAX_STRING_LENGTH);
-
-    verbose = args->verbose;
-    symmetric = args->symmetric;
-    window_size = args->windowSize;
-//    strcpy(vocab_file, args->vocabFile);
-    strcpy(file_head, args->overflowFile);
-    memory_limit = args->memory;
-
-    strcpy(vocab_file, vocabIn);
-
-    in = fopen(corpusIn, "r");
-    if (in == NULL) { fprintf(stderr,"Unable to open file %s.\n", corpusIn); return 1; }
-    out = fopen(cooccurOut, "wb");
-    if (out == NULL) { fprintf(stderr,"Unable to open file %s.\n", cooccurOut); return 1; }
+    int result;
+
+    ctx.verbose = args->verbose;
+    ctx.symmetric = args->symmetric;
+    ctx.window_size = args->windowSize;
+//    strcpy(ctx.vocab_file, args->vocabFile);
+    glove_temp_name(ctx.file_head, MAX_STRING_LENGTH - 16, args->overflowFile); // Room for the _0000.bin suffixes
+    ctx.memory_limit = args->memory;
+    ctx.profile = args->profile;
+
+    strncpy(ctx.vocab_file, (vocabIn != NULL) ? vocabIn : "", MAX_STRING_LENGTH - 1);
+    ctx.vocab_file[MAX_STRING_LENGTH - 1] = '\0';
+    ctx.vocab = vocab;
+    ctx.sink = sink;
+    ctx.sink_data = sink_data;
+
+    ctx.in = fopen(corpusIn, "r");
+    if (ctx.in == NULL) { fprintf(stderr,"Unable to open file %s.\n", corpusIn); return 1; }
+    ctx.out = NULL;
+    if (sink == NULL) {
+        ctx.out = fopen(cooccurOut, "wb");
+        if (ctx.out == NULL) { fprintf(stderr,"Unable to open file %s.\n", cooccurOut); fclose(ctx.in); return 1; }
+    }
 
     /* The memory_limit determines a limit on the number of elements in bigram_table and the overflow buffer */
     /* Estimate the maximum value that max_product can take so that this limit is still satisfied */
-    rlimit = 0.85 * (real)memory_limit * 1073741824/(sizeof(CREC));
+    rlimit = 0.85 * (real)ctx.memory_limit * 1073741824/(sizeof(CREC));
     while (fabs(rlimit - n * (log(n) + 0.1544313298)) > 1e-3) n = rlimit / (log(n) + 0.1544313298);
-    max_product = (long long) n;
-    overflow_length = (long long) rlimit/6; // 0.85 + 1/6 ~= 1
+    ctx.max_product = (long long) n;
+    ctx.overflow_length = (long long) rlimit/6; // 0.85 + 1/6 ~= 1
 
     /* Override estimates by specifying limits explicitly on the command line */
-    if (args->maxProduct > 0) { max_product = args->maxProduct; }
-    if (args->overflowLength > 0) { overflow_length = args->overflowLength; }
-
-    int result = get_cooccurrence();
-    fclose(in);
-    fclose(out);
+    if (args->maxProduct > 0) { ctx.max_product = args->maxProduct; }
+    if (args->overflowLength > 0) { ctx.overflow_length = args->overflowLength; }
+
+    ctx.profile_span = gloveProfileBegin(ctx.profile, -1, "cooccur");
+    result = get_cooccurrence(&ctx);
+    fclose(ctx.in);
+    if (ctx.out != NULL) fclose(ctx.out);
+    gloveProfileEnd(ctx.profile, ctx.profile_span);
     return result;
 }
+
+int cooccur(const CooccurArgs* args, const char* corpusIn, const char* vocabIn, char* cooccurOut) {
+    return run_cooccur(args, corpusIn, vocabIn, cooccurOut, NULL, NULL, NULL);
+}
+
+int glove_count_cooccurrences(const CooccurArgs* args, const char* corpusIn, const GLOVE_VOCAB* vocab,
+                              GLOVE_RECORD_SINK sink, void* sinkData) {
+    return run_cooccur(args, corpusIn, NULL, NULL, vocab, sink, sinkData);
+}
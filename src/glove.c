@@ -24,6 +24,12 @@
 //    http://nlp.stanford.edu/projects/glove/
 
 
+#if defined(__linux__)
+#define _GNU_SOURCE // For CPU affinity and huge page flags
+#endif
+
+#include <float.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +37,7 @@
 #include <math.h>
 #include <time.h>
 #include "../include/glove.h"
+#include "pipeline.h"
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -40,10 +47,39 @@
 #else
 #include <pthread.h>
 #include <assert.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
 #endif
 
 #define _FILE_OFFSET_BITS 64
 #define MAX_STRING_LENGTH 1000
+#define HUGE_PAGE_SIZE (2LL * 1024 * 1024)
+#define MPOL_INTERLEAVE_POLICY 3 // MPOL_INTERLEAVE from linux/mempolicy.h
+#define PREFETCH_DISTANCE 8 // Records between issuing a prefetch for a row and updating it
+#define BLOCK_READ_LENGTH 1048576 // Records read at a time while bucketing for the block schedule
+#define BLOCK_BUFFER_LENGTH 1024 // Records buffered per block before writing them to the block file
+#define OUTPUT_BUFFER_SIZE (4 * 1024 * 1024) // stdio buffer for parameter output files
+#define EXPORT_CHUNK_ROWS 4096 // Vocabulary rows each export thread formats per round
+#define SAMPLE_BUCKETS 1024 // Buckets of the histogram of log2 record weights used to calibrate sampling
+#define SAMPLE_BUCKETS_PER_OCTAVE 16
+#define HASH_SEED 1159241 // Seed of the word hashes of model handles and warm starts
+#define MAX_REAL_TEXT 400 // Upper bound on the text of one " %lf" field, without the digits after the point
+#define BENCHMARK_PAIRS 1048576 // Distinct random records cycled through by gloveBenchmarkUpdates
+
+#if defined(_WIN32)
+#define LOCK_HOT_ROWS(ctx) AcquireSRWLockExclusive(&(ctx)->hot_rows_lock)
+#define UNLOCK_HOT_ROWS(ctx) ReleaseSRWLockExclusive(&(ctx)->hot_rows_lock)
+#else
+#define LOCK_HOT_ROWS(ctx) pthread_mutex_lock(&(ctx)->hot_rows_lock)
+#define UNLOCK_HOT_ROWS(ctx) pthread_mutex_unlock(&(ctx)->hot_rows_lock)
+#endif
 
 typedef double real;
 
@@ -53,140 +89,637 @@ typedef struct cooccur_rec {
     real val;
 } CREC;
 
-static int verbose; // 0, 1, or 2
-static int num_threads; // pthreads
-static int num_iter; // Number of full passes through cooccurrence matrix
-static int vector_size; // Word vector size
-static int save_gradsq; // By default don't save squared gradient values
-static int use_binary; // 0: save as text files; 1: save as binary; 2: both. For binary, save both word and context word vectors.
-static int model; // For text file output only. 0: concatenate word and context vectors (and biases) i.e. save everything; 1: Just save word vectors (no bias); 2: Save (word + context word) vectors (no biases)
-static int checkpoint_every; // checkpoint the model for every checkpoint_every iterations. Do nothing if checkpoint_every <= 0
-static real eta; // Initial learning rate
-static real alpha, x_max; // Weighting function parameters, not extremely sensitive to corpus, though may need adjustment for very small or very large corpora
-static real *W, *gradsq, *cost;
-static long long num_lines, *lines_per_thread, vocab_size;
-static char *vocab_file, *input_file, *save_W_file, *save_gradsq_file;
-static int use_unk_vec = 1; // 0 or 1
-
-/* Efficient string comparison */
-static int scmp( char *s1, char *s2 ) {
-    while (*s1 != '\0' && *s1 == *s2) {s1++; s2++;}
-    return(*s1 - *s2);
-}
-
-static void initialize_parameters() {
-	long long a, b;
-	vector_size++; // Temporarily increment to allocate space for bias
-    
-	/* Allocate space for word vectors and context word vectors, and correspodning gradsq */
+/* Progress counters of one training thread for the current iteration, padded to a cache line since each thread
+ * updates its own on every record while the monitor thread reads them all */
+typedef struct thread_counters {
+    long long records, skipped;
+    double io_wait;
+    unsigned long long rng; // State of the thread's generator for sampling records, reseeded every iteration
+    char pad[32];
+} THREAD_COUNTERS;
+
+/* Trained parameters handed to the caller of gloveTrain, in the layout they were trained in */
+struct _GloveModel {
+    long long vocab_size, row_stride;
+    int vector_size, interleave;
+    real *W, *gradsq;
+    long long W_mapped, gradsq_mapped;
+    real *combined; // vocab_size rows of word + context vectors, built on first request
+    char *words; // Vocabulary words, each NUL terminated, starting at word_offsets
+    long long *word_offsets;
+    long long *table, table_size; // Open addressing hash of words to rows, -1 for empty slots
+};
+
+typedef struct text_buffer {
+    char *text;
+    long long length, capacity;
+} TEXT_BUFFER;
+
+/* Header of a checkpoint file, which is followed by the 2 * vocab_size rows of W and then of gradsq, each
+ * vector_size + 1 reals, in native byte order */
+typedef struct checkpoint_header {
+    char magic[8];
+    int version;
+    int real_size; // sizeof(real) of the writer
+    long long vocab_size;
+    int vector_size;
+    int iter; // Iterations completed
+} CHECKPOINT_HEADER;
+
+static const char CHECKPOINT_MAGIC[8] = "GLVCKPT";
+#define CHECKPOINT_VERSION 1
+
+#if !defined(_WIN32)
+typedef struct shared_params {
+    pthread_barrier_t barrier;
+    long long slot_length; // Reals in each copy of W (and of gradsq, unless interleaved)
+    real *slots; // num_processes copies of W, followed by num_processes copies of gradsq unless interleaved
+    real cost[1]; // Cost of each process for the last iteration; actually num_processes long
+} SHARED_PARAMS;
+#endif
+
+/* State of one glove() call; each call has its own, and the threads it starts get a pointer to it, so concurrent calls
+ * in one process only share the C library random number generator */
+typedef struct glove_context {
+    int verbose; // 0, 1, or 2
+    int num_threads; // pthreads
+    int num_iter; // Number of full passes through cooccurrence matrix
+    int vector_size; // Word vector size
+    int save_gradsq; // By default don't save squared gradient values
+    int use_binary; // 0: save as text files; 1: save as binary; 2: both. For binary, save both word and context word vectors.
+    int model; // For text file output only. 0: concatenate word and context vectors (and biases) i.e. save everything; 1: Just save word vectors (no bias); 2: Save (word + context word) vectors (no biases)
+    int checkpoint_every; // checkpoint the model for every checkpoint_every iterations. Do nothing if checkpoint_every <= 0
+    real eta; // Initial learning rate
+    real alpha, x_max; // Weighting function parameters, not extremely sensitive to corpus, though may need adjustment for very small or very large corpora
+    int interleave; // 0: W and gradsq in separate arrays; 1: each word's vector, bias and gradsq stored together in one aligned block
+    int numa_policy; // 0: pages land wherever the main thread initializes them; 1: first-touch by the training threads; 2: interleave across NUMA nodes
+    int pin_threads; // 0: let the OS schedule threads; 1: pin training thread i to the i-th available processor
+    int batch_size; // Records read and prefetched at a time by each training thread; <= 0 processes one record at a time
+    int schedule; // 0: Hogwild, every thread updates any row; 1: stratified, threads run non-overlapping blocks of words and contexts
+    int block_round; // Round of the stratified schedule currently being run
+    long long *block_offsets; // First record of each block in block_file, plus a final end offset
+    long long hot_rows; // Number of most frequent words (and contexts) each Hogwild thread keeps a private replica of; 0 for none
+    long long sync_every; // Records a thread processes between merging its replica into the shared rows
+    int huge_pages; // 0: normal pages; 1: transparent 2 MB huge pages; 2: explicit 2 MB huge pages (hugetlbfs), falling back to 1
+    real *W, *gradsq, *cost;
+    long long W_mapped, gradsq_mapped; // Length of the mapping if W/gradsq came from mmap, else 0
+    long long row_stride; // Distance (in reals) between consecutive rows of W, and of gradsq
+    long long num_lines, *lines_per_thread, vocab_size;
+    long long segment_start, segment_lines; // Range of records the current Hogwild pass trains on
+    int num_processes; // Worker processes, each training on its own shard in its own copy of the parameters
+    int process_syncs; // Times per iteration the worker processes average their copies of the parameters
+    int process_id; // 0 in the calling process, 1 .. num_processes - 1 in forked workers
+    char *vocab_file, *input_file, *save_W_file, *save_gradsq_file, *file_head, *block_file, *resume_file;
+    char *warm_file, *warm_vocab_file; // Earlier model to initialize the rows of known words from, and its vocabulary
+    real warm_eta; // Learning rate of carried-over rows relative to new ones
+    char *vocab_words; // Vocabulary words, each NUL terminated, starting at vocab_word_offsets
+    long long *vocab_word_offsets;
+    GloveModel **trained_model; // Receives the parameters instead of freeing them after training; NULL for none
+    int use_unk_vec; // 0 or 1
+    int export_threads; // Threads formatting the text output; <= 0 to write it with fprintf on the calling thread
+    int precision; // Digits after the decimal point in text output
+    int model_file; // 0: no model file; 1: also write a .glvm model file of floats; 2: of doubles; 3: int8; 4: PQ
+    int pq_subspaces; // PQ codes per row of the model file; <= 0 for the default
+    const char *analogy_dir; // Analogy questions scored every analogy_every iterations; NULL for none
+    int analogy_every;
+    real *export_W, *export_gradsq; // Parameters being exported as text
+    int export_with_gradsq;
+    long long export_next_row; // First vocabulary row of the current round of export chunks
+    TEXT_BUFFER *export_text_W, *export_text_gradsq; // One per export thread
+    int async_checkpoint; // 0: checkpoints are written by the training loop; 1: by a background thread from a snapshot
+    real *snapshot_W, *snapshot_gradsq; // Copy of the parameters being written by the background checkpoint writer
+    int snapshot_iter, checkpoint_pending, checkpoint_result;
+    long long held_out_lines; // Records at the end of the cooccurrence file kept out of training to measure convergence
+    CREC *held_out;
+    real *held_out_log, *held_out_weight;
+    real stop_tolerance; // Relative drop in held-out loss that counts as an improvement
+    int stop_patience; // Iterations without improvement before training stops; 0 to never stop early
+    int keep_best; // 0: save the last parameters; 1: save those with the lowest held-out loss
+    real sample_fraction; // Expected fraction of records trained on per iteration; 0 to train on all of them
+    real sample_scale; // Records of weight f are kept with probability min(1, sample_scale * f); 0 when not sampling
+    real *best_W, *best_gradsq; // Copy of the parameters with the lowest held-out loss so far
+    GloveTelemetryCallback telemetry; // Receives progress reports during training; NULL for none
+    void *telemetry_data;
+    double telemetry_interval; // Seconds between reports within an iteration
+    THREAD_COUNTERS *counters; // One per training thread
+    GloveThreadStats *telemetry_threads;
+    double iter_start; // now_seconds() when the current iteration started
+    int telemetry_iter, monitor_stop;
+    GloveProfile *profile;
+    int profile_span; // Span of this call, -1 when not profiling
+#if defined(_WIN32)
+    HANDLE monitor_thread, checkpoint_thread;
+    SRWLOCK hot_rows_lock; // Serializes merges of hot row replicas
+#else
+    pthread_t monitor_thread, checkpoint_thread;
+    pthread_mutex_t hot_rows_lock; // Serializes merges of hot row replicas
+    SHARED_PARAMS *shared;
+    long long shared_bytes;
+    real *private_W, *private_gradsq;
+    pid_t *worker_pids;
+#endif
+#if defined(__linux__)
+    cpu_set_t allowed_cpus; // Processors available to the process when the call started
+    int num_allowed_cpus;
+#endif
+} GLOVE_CONTEXT;
+
+/* Argument of every thread started by run_threads */
+typedef struct thread_arg {
+    GLOVE_CONTEXT *ctx;
+    long long id;
+} THREAD_ARG;
+
+/* Simple bitwise hash function */
+static unsigned int bitwisehash(const char *word, long long tsize, unsigned int seed) {
+    char c;
+    unsigned int h;
+    h = seed;
+    for (; (c =* word) != '\0'; word++) h ^= ((h << 5) + c + (h >> 2));
+    return(((h&0x7fffffff) % tsize));
+}
+
+/* Round n up to a multiple of m */
+static long long round_up(long long n, long long m) {
+    return (n + m - 1) / m * m;
+}
+
+/* Seconds on a monotonic clock, for measuring intervals */
+static double now_seconds() {
+#if defined(_WIN32)
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* Pin the calling thread to the id-th processor this process is allowed to run on */
+static void pin_thread(GLOVE_CONTEXT *ctx, long long id) {
+#if defined (_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (id % (8 * sizeof(DWORD_PTR))));
+#elif defined (__linux__)
+    cpu_set_t mine;
+    int cpu, n = -1;
+    if (ctx->num_allowed_cpus == 0) return; // Affinity could not be read when the call started
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) if (CPU_ISSET(cpu, &ctx->allowed_cpus) && ++n == id % ctx->num_allowed_cpus) break;
+    CPU_ZERO(&mine);
+    CPU_SET(cpu, &mine);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(mine), &mine) != 0 && ctx->verbose > 1) fprintf(stderr, "Unable to pin thread %lld.\n", id);
+#endif
+}
+
+#if defined (__linux__)
+/* Spread the pages of [p, p + bytes) round-robin over all NUMA nodes; p must be page aligned */
+static void interleave_pages(GLOVE_CONTEXT *ctx, void *p, long long bytes) {
+    unsigned long nodemask[16];
+    int a, first = 0, last = 0;
+    FILE *fid = fopen("/sys/devices/system/node/possible", "r");
+    if (fid != NULL) {
+        if (fscanf(fid, "%d-%d", &first, &last) < 2) last = first;
+        fclose(fid);
+    }
+    if (last <= 0 || last >= (int)(8 * sizeof(nodemask))) return; // Single node, or more than we can describe
+    memset(nodemask, 0, sizeof(nodemask));
+    for (a = first; a <= last; a++) nodemask[a / (8 * sizeof(unsigned long))] |= 1UL << (a % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, p, (unsigned long)bytes, MPOL_INTERLEAVE_POLICY, nodemask, (unsigned long)last + 2, 0) != 0 && ctx->verbose > 0)
+        fprintf(stderr, "Unable to interleave parameters across NUMA nodes.\n");
+}
+#endif
+
+/* Allocate count reals, at least 128-byte aligned, honouring the huge page and NUMA options. *mapped is set to the
+ * length of the mapping if the memory came straight from mmap (so must be released with munmap), else 0 */
+static real *alloc_params(GLOVE_CONTEXT *ctx, long long count, long long *mapped) {
+    void *p = NULL;
+    long long bytes = count * sizeof(real);
+    *mapped = 0;
 #if defined (_WIN32)
-	W = _aligned_malloc(2 * vocab_size * (vector_size + 1) * sizeof(real), 128);
+    p = _aligned_malloc(bytes, 128);
 #else
-	a = posix_memalign((void **)&W, 128, 2 * vocab_size * (vector_size + 1) * sizeof(real)); // Might perform better than malloc
+#if defined (MAP_HUGETLB)
+    if (ctx->huge_pages == 2) {
+        p = mmap(NULL, round_up(bytes, HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            p = NULL;
+            if (ctx->verbose > 0) fprintf(stderr, "Unable to map explicit huge pages, using transparent huge pages instead.\n");
+        }
+        else *mapped = round_up(bytes, HUGE_PAGE_SIZE);
+    }
 #endif
-    if (W == NULL) {
-        fprintf(stderr, "Error allocating memory for W\n");
-        exit(1);
+    if (p == NULL && posix_memalign(&p, ctx->huge_pages > 0 ? HUGE_PAGE_SIZE : ctx->numa_policy == 2 ? 4096 : 128, bytes) != 0) p = NULL; // Might perform better than malloc
+#if defined (MADV_HUGEPAGE)
+    if (p != NULL && *mapped == 0 && ctx->huge_pages > 0) madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+#if defined (__linux__)
+    if (p != NULL && ctx->numa_policy == 2) interleave_pages(ctx, p, bytes);
+#endif
+#endif
+    return (real *)p;
+}
+
+static void free_params(real *p, long long mapped) {
+#if defined (_WIN32)
+    _aligned_free(p);
+#else
+    if (mapped > 0) munmap(p, mapped);
+    else free(p);
+#endif
+}
+
+#if defined(_WIN32)
+typedef void *(__stdcall *thread_fn)(void *);
+#else
+typedef void *(*thread_fn)(void *);
+#endif
+
+/* Run fn on count threads, passing each a THREAD_ARG with ctx and its id (0 .. count - 1), and wait for all of them */
+static void run_threads(GLOVE_CONTEXT *ctx, thread_fn fn, int count) {
+    long long a;
+    THREAD_ARG *thread_ids = (THREAD_ARG*)malloc(sizeof(THREAD_ARG) * count);
+    for (a = 0; a < count; a++) {
+        thread_ids[a].ctx = ctx;
+        thread_ids[a].id = a;
     }
 #if defined (_WIN32)
-	gradsq = _aligned_malloc(2 * vocab_size * (vector_size + 1) * sizeof(real), 128);
+    HANDLE *wt = (HANDLE*)malloc(count * sizeof(HANDLE));
+    for (a = 0; a < count; a++) wt[a] = (HANDLE)_beginthreadex(NULL, 0, (unsigned (__stdcall *)(void *))fn, (void*)&thread_ids[a], 0, NULL);
+    for (a = 0; a < count; a++) WaitForSingleObject(wt[a], INFINITE);
+    free(wt);
+#else
+    pthread_t *pt = (pthread_t *)malloc(count * sizeof(pthread_t));
+    for (a = 0; a < count; a++) pthread_create(&pt[a], NULL, fn, (void *)&thread_ids[a]);
+    for (a = 0; a < count; a++) pthread_join(pt[a], NULL);
+    free(pt);
+#endif
+    free(thread_ids);
+}
+
+/* Zero one slice of the parameter arrays from a (pinned) training thread, so its pages are placed on that thread's node */
+static void *
+#if defined(_WIN32)
+__stdcall
+#endif
+first_touch_thread(void *vid) {
+    THREAD_ARG *arg = (THREAD_ARG*)vid;
+    GLOVE_CONTEXT *ctx = arg->ctx;
+    long long id = arg->id;
+    long long len = 2 * ctx->vocab_size * ctx->row_stride;
+    long long start = len / ctx->num_threads * id, end = (id == ctx->num_threads - 1) ? len : len / ctx->num_threads * (id + 1);
+    if (ctx->pin_threads) pin_thread(ctx, id);
+    memset(ctx->W + start, 0, (end - start) * sizeof(real));
+    if (!ctx->interleave) memset(ctx->gradsq + start, 0, (end - start) * sizeof(real));
+#if defined (_WIN32)
+    _endthreadex(0);
 #else
-	a = posix_memalign((void **)&gradsq, 128, 2 * vocab_size * (vector_size + 1) * sizeof(real)); // Might perform better than malloc
+    pthread_exit(NULL);
 #endif
-	if (gradsq == NULL) {
-        fprintf(stderr, "Error allocating memory for gradsq\n");
-        exit(1);
+    return NULL;
+}
+
+static void first_touch_parameters(GLOVE_CONTEXT *ctx) {
+    run_threads(ctx, first_touch_thread, ctx->num_threads);
+}
+
+static void initialize_parameters(GLOVE_CONTEXT *ctx) {
+    long long a, b, block;
+    ctx->vector_size++; // Temporarily increment to allocate space for bias
+
+    /* Allocate space for word vectors and context word vectors, and correspodning gradsq */
+    if (ctx->interleave) {
+        /* One block per word: [vector + bias | pad][gradsq | pad], each half aligned for SIMD loads and the block
+         * padded to a whole number of cache lines, so an update touches two blocks instead of four rows */
+        block = round_up(ctx->vector_size, 32 / sizeof(real));
+        ctx->row_stride = round_up(2 * block, 64 / sizeof(real));
+        ctx->W = alloc_params(ctx, 2 * ctx->vocab_size * ctx->row_stride, &ctx->W_mapped);
+        if (ctx->W == NULL) {
+            fprintf(stderr, "Error allocating memory for W\n");
+            exit(1);
+        }
+        ctx->gradsq = ctx->W + block;
+    } else {
+        ctx->row_stride = ctx->vector_size;
+        ctx->W = alloc_params(ctx, 2 * ctx->vocab_size * ctx->row_stride, &ctx->W_mapped);
+        if (ctx->W == NULL) {
+            fprintf(stderr, "Error allocating memory for W\n");
+            exit(1);
+        }
+        ctx->gradsq = alloc_params(ctx, 2 * ctx->vocab_size * ctx->row_stride, &ctx->gradsq_mapped);
+        if (ctx->gradsq == NULL) {
+            fprintf(stderr, "Error allocating memory for gradsq\n");
+            exit(1);
+        }
     }
-	for (b = 0; b < vector_size; b++) for (a = 0; a < 2 * vocab_size; a++) W[a * vector_size + b] = (rand() / (real)RAND_MAX - 0.5) / vector_size;
-	for (b = 0; b < vector_size; b++) for (a = 0; a < 2 * vocab_size; a++) gradsq[a * vector_size + b] = 1.0; // So initial value of eta is equal to initial learning rate
-	vector_size--;
+    if (ctx->numa_policy == 1) first_touch_parameters(ctx); // Place pages before the main thread writes the initial values
+    if (ctx->interleave) memset(ctx->W, 0, 2 * ctx->vocab_size * ctx->row_stride * sizeof(real)); // Clear the padding
+    for (b = 0; b < ctx->vector_size; b++) for (a = 0; a < 2 * ctx->vocab_size; a++) ctx->W[a * ctx->row_stride + b] = (rand() / (real)RAND_MAX - 0.5) / ctx->vector_size;
+    for (b = 0; b < ctx->vector_size; b++) for (a = 0; a < 2 * ctx->vocab_size; a++) ctx->gradsq[a * ctx->row_stride + b] = 1.0; // So initial value of eta is equal to initial learning rate
+    ctx->vector_size--;
+}
+
+static void free_parameters(GLOVE_CONTEXT *ctx) {
+    free_params(ctx->W, ctx->W_mapped);
+    if (!ctx->interleave) free_params(ctx->gradsq, ctx->gradsq_mapped);
+    ctx->W = ctx->gradsq = NULL;
 }
 
-static inline real check_nan(real update) {
+static inline real check_nan(real update, int *caught) {
     if (isnan(update) || isinf(update)) {
         fprintf(stderr,"\ncaught NaN in update");
+        *caught = 1;
         return 0.;
     } else {
         return update;
     }
 }
 
-/* Train the GloVe model */
-static void *
-#if defined(_WIN32)
-__stdcall
+#if defined(__GNUC__)
+#define PREFETCH(addr) __builtin_prefetch((addr), 1, 3)
+#else
+#define PREFETCH(addr)
 #endif
-glove_thread(void *vid) {
-    long long a, b ,l1, l2;
-    long long id = *(long long*)vid;
-    CREC cr;
+
+/* Issue prefetches for every cache line of the word and context rows of W and gradsq */
+static inline void prefetch_rows(GLOVE_CONTEXT *ctx, real *w1, real *w2, real *g1, real *g2) {
+    long long b;
+    for (b = 0; b < ctx->vector_size; b += 64 / sizeof(real)) {
+        PREFETCH(w1 + b);
+        PREFETCH(w2 + b);
+        PREFETCH(g1 + b);
+        PREFETCH(g2 + b);
+    }
+    PREFETCH(w1 + ctx->vector_size); // Bias terms, which may spill into one more line
+    PREFETCH(w2 + ctx->vector_size);
+    PREFETCH(g1 + ctx->vector_size);
+    PREFETCH(g2 + ctx->vector_size);
+}
+
+/* Locate the W and gradsq rows of word w (of context word w if context = 1), using the calling thread's replica of the
+ * hot rows when it has one and w is among them */
+static inline void locate_rows(GLOVE_CONTEXT *ctx, real *hot, long long w, int context, real **wrow, real **grow) {
+    if (hot != NULL && w < ctx->hot_rows) {
+        *wrow = hot + (w + context * ctx->hot_rows) * (ctx->vector_size + 1);
+        *grow = *wrow + 2 * ctx->hot_rows * (ctx->vector_size + 1);
+    }
+    else {
+        *wrow = ctx->W + (w + context * ctx->vocab_size) * ctx->row_stride;
+        *grow = ctx->gradsq + (w + context * ctx->vocab_size) * ctx->row_stride;
+    }
+}
+
+/* Copy the shared hot rows into a thread's replica, which holds W rows, gradsq rows, and a snapshot of both taken at
+ * the last merge */
+static void load_hot_rows(GLOVE_CONTEXT *ctx, real *hot) {
+    long long a, len = (ctx->vector_size + 1) * sizeof(real);
+    real *snapshot = hot + 4 * ctx->hot_rows * (ctx->vector_size + 1);
+    for (a = 0; a < ctx->hot_rows; a++) {
+        memcpy(hot + a * (ctx->vector_size + 1), ctx->W + a * ctx->row_stride, len);
+        memcpy(hot + (a + ctx->hot_rows) * (ctx->vector_size + 1), ctx->W + (a + ctx->vocab_size) * ctx->row_stride, len);
+        memcpy(hot + (a + 2 * ctx->hot_rows) * (ctx->vector_size + 1), ctx->gradsq + a * ctx->row_stride, len);
+        memcpy(hot + (a + 3 * ctx->hot_rows) * (ctx->vector_size + 1), ctx->gradsq + (a + ctx->vocab_size) * ctx->row_stride, len);
+    }
+    memcpy(snapshot, hot, 4 * ctx->hot_rows * len);
+}
+
+/* Fold what a thread changed in its replica since the last merge into the shared rows, then refresh the replica. The
+ * changes are added in full: they are the thread's own updates, delayed, which Hogwild would have applied to the shared
+ * rows directly. Scaling the gradsq changes down would undercount the history of the hottest rows and keep their
+ * AdaGrad steps large */
+static void merge_hot_rows(GLOVE_CONTEXT *ctx, real *hot) {
+    long long a, b, r;
+    real *shared, *local, *snapshot = hot + 4 * ctx->hot_rows * (ctx->vector_size + 1);
+    LOCK_HOT_ROWS(ctx);
+    for (a = 0; a < 4 * ctx->hot_rows; a++) {
+        r = a % (2 * ctx->hot_rows); // Row of W (or of gradsq, for the second half of the replica)
+        shared = ((a < 2 * ctx->hot_rows) ? ctx->W : ctx->gradsq) + ((r < ctx->hot_rows) ? r : r - ctx->hot_rows + ctx->vocab_size) * ctx->row_stride;
+        local = hot + a * (ctx->vector_size + 1);
+        for (b = 0; b <= ctx->vector_size; b++) shared[b] += local[b] - snapshot[a * (ctx->vector_size + 1) + b];
+    }
+    load_hot_rows(ctx, hot);
+    UNLOCK_HOT_ROWS(ctx);
+}
+
+/* SplitMix64 finalizer, to turn a structured seed into a well mixed generator state */
+static inline unsigned long long mix_seed(unsigned long long x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* Next uniform number in [0, 1) from a thread's xorshift64* generator */
+static inline real next_uniform(unsigned long long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Keep a record of weight f with probability p = min(1, sample_scale * f) and reweight a kept one to f / p, so the
+ * expected update over the sample equals the full update; returns 0 for a record to skip */
+static inline int sample_record(GLOVE_CONTEXT *ctx, long long id, real *weight) {
+    real p = ctx->sample_scale * *weight;
+    if (p >= 1) return 1;
+    if (next_uniform(&ctx->counters[id].rng) >= p) return 0;
+    *weight /= p;
+    return 1;
+}
+
+/* Dot product of the first n entries of a word row and a context row; a single loop that the compiler vectorizes, shared
+ * by the updates and the held-out loss */
+static inline real row_dot(const real *w1, const real *w2, long long n) {
+    long long b;
+    real sum = 0;
+    for (b = 0; b < n; b++) sum += w1[b] * w2[b];
+    return sum;
+}
+
+/* One AdaGrad step for a word row and context row of W (w1, w2) and gradsq (g1, g2), given log(X_ij) and f(X_ij) */
+static inline void update_pair(GLOVE_CONTEXT *ctx, long long id, real *w1, real *w2, real *g1, real *g2, real log_val, real weight, real *W_updates1, real *W_updates2) {
+    long long b, vector_size = ctx->vector_size;
     real diff, fdiff, temp1, temp2;
-    FILE *fin;
-    fin = fopen(input_file, "rb");
-    fseek(fin, (num_lines / num_threads * id) * (sizeof(CREC)), SEEK_SET); //Threads spaced roughly equally throughout file
-    cost[id] = 0;
-    
-    real* W_updates1 = (real*)malloc(vector_size * sizeof(real));
-    real* W_updates2 = (real*)malloc(vector_size * sizeof(real));
-    for (a = 0; a < lines_per_thread[id]; a++) {
-        fread(&cr, sizeof(CREC), 1, fin);
-        if (feof(fin)) break;
-        if (cr.word1 < 1 || cr.word2 < 1) { continue; }
-        
-        /* Get location of words in W & gradsq */
-        l1 = (cr.word1 - 1LL) * (vector_size + 1); // cr word indices start at 1
-        l2 = ((cr.word2 - 1LL) + vocab_size) * (vector_size + 1); // shift by vocab_size to get separate vectors for context words
-        
-        /* Calculate cost, save diff for gradients */
-        diff = 0;
+    int caught = 0; // Set when part of the update is dropped for a NaN or inf
+
+    /* Calculate cost, save diff for gradients */
+    diff = row_dot(w1, w2, vector_size); // dot product of word and context word vector
+    diff += w1[vector_size] + w2[vector_size] - log_val; // add separate bias for each word
+    fdiff = weight * diff; // multiply weighting function (f) with diff
+
+    // Check for NaN and inf() in the diffs.
+    if (isnan(diff) || isnan(fdiff) || isinf(diff) || isinf(fdiff)) {
+        fprintf(stderr,"Caught NaN in diff for kdiff for thread. Skipping update");
+        ctx->counters[id].skipped++;
+        return;
+    }
+
+    ctx->cost[id] += 0.5 * fdiff * diff; // weighted squared error
+
+    /* Adaptive gradient updates */
+    fdiff *= ctx->eta; // for ease in calculating gradient
+    real W_updates1_sum = 0;
+    real W_updates2_sum = 0;
+    for (b = 0; b < vector_size; b++) {
+        // learning rate times gradient for word vectors
+        temp1 = fdiff * w2[b];
+        temp2 = fdiff * w1[b];
+        // adaptive updates
+        W_updates1[b] = temp1 / sqrt(g1[b]);
+        W_updates2[b] = temp2 / sqrt(g2[b]);
+        W_updates1_sum += W_updates1[b];
+        W_updates2_sum += W_updates2[b];
+        g1[b] += temp1 * temp1;
+        g2[b] += temp2 * temp2;
+    }
+    if (!isnan(W_updates1_sum) && !isinf(W_updates1_sum) && !isnan(W_updates2_sum) && !isinf(W_updates2_sum)) {
         for (b = 0; b < vector_size; b++) {
-			diff += W[b + l1] * W[b + l2];
-		} // dot product of word and context word vector
-        diff += W[vector_size + l1] + W[vector_size + l2] - log(cr.val); // add separate bias for each word
-        fdiff = (cr.val > x_max) ? diff : pow(cr.val / x_max, alpha) * diff; // multiply weighting function (f) with diff
-
-        // Check for NaN and inf() in the diffs.
-        if (isnan(diff) || isnan(fdiff) || isinf(diff) || isinf(fdiff)) {
-            fprintf(stderr,"Caught NaN in diff for kdiff for thread. Skipping update");
-            continue;
+            w1[b] -= W_updates1[b];
+            w2[b] -= W_updates2[b];
         }
+    }
+    else caught = 1;
 
-        cost[id] += 0.5 * fdiff * diff; // weighted squared error
-        
-        /* Adaptive gradient updates */
-        fdiff *= eta; // for ease in calculating gradient
-        real W_updates1_sum = 0;
-        real W_updates2_sum = 0;
-        for (b = 0; b < vector_size; b++) {
-            // learning rate times gradient for word vectors
-            temp1 = fdiff * W[b + l2];
-            temp2 = fdiff * W[b + l1];
-            // adaptive updates
-            W_updates1[b] = temp1 / sqrt(gradsq[b + l1]);
-            W_updates2[b] = temp2 / sqrt(gradsq[b + l2]);
-            W_updates1_sum += W_updates1[b];
-            W_updates2_sum += W_updates2[b];
-            gradsq[b + l1] += temp1 * temp1;
-            gradsq[b + l2] += temp2 * temp2;
-        }
-        if (!isnan(W_updates1_sum) && !isinf(W_updates1_sum) && !isnan(W_updates2_sum) && !isinf(W_updates2_sum)) {
-            for (b = 0; b < vector_size; b++) {
-                W[b + l1] -= W_updates1[b];
-                W[b + l2] -= W_updates2[b];
+    // updates for bias terms
+    w1[vector_size] -= check_nan(fdiff / sqrt(g1[vector_size]), &caught);
+    w2[vector_size] -= check_nan(fdiff / sqrt(g2[vector_size]), &caught);
+    ctx->counters[id].skipped += caught; // Once per record, however much of its update was dropped
+    fdiff *= fdiff;
+    g1[vector_size] += fdiff;
+    g2[vector_size] += fdiff;
+}
+
+/* fread up to n records, timing the call when telemetry is on */
+static inline long long read_records(GLOVE_CONTEXT *ctx, long long id, CREC *records, long long n, FILE *fin) {
+    double start;
+    if (ctx->telemetry == NULL) return (long long)fread(records, sizeof(CREC), n, fin);
+    start = now_seconds();
+    n = (long long)fread(records, sizeof(CREC), n, fin);
+    ctx->counters[id].io_wait += now_seconds() - start;
+    return n;
+}
+
+/* Train on the next count records of fin */
+static void train_records(GLOVE_CONTEXT *ctx, long long id, FILE *fin, long long count) {
+    long long a, c, n, since_merge = 0;
+    CREC cr;
+    real *w1, *w2, *g1, *g2, *hot = NULL;
+    real* W_updates1 = (real*)malloc(ctx->vector_size * sizeof(real));
+    real* W_updates2 = (real*)malloc(ctx->vector_size * sizeof(real));
+    if (ctx->hot_rows > 0 && ctx->schedule == 0) {
+        hot = (real*)malloc(8 * ctx->hot_rows * (ctx->vector_size + 1) * sizeof(real));
+        LOCK_HOT_ROWS(ctx);
+        load_hot_rows(ctx, hot);
+        UNLOCK_HOT_ROWS(ctx);
+    }
+    if (ctx->batch_size <= 0) {
+        real weight;
+        for (a = 0; a < count; a++) {
+            if (read_records(ctx, id, &cr, 1, fin) < 1) break;
+            ctx->counters[id].records++;
+            if (cr.word1 < 1 || cr.word2 < 1) { continue; }
+
+            weight = (cr.val > ctx->x_max) ? 1.0 : pow(cr.val / ctx->x_max, ctx->alpha);
+            if (ctx->sample_scale > 0 && !sample_record(ctx, id, &weight)) continue;
+
+            /* Get location of words in W & gradsq */
+            locate_rows(ctx, hot, cr.word1 - 1LL, 0, &w1, &g1); // cr word indices start at 1
+            locate_rows(ctx, hot, cr.word2 - 1LL, 1, &w2, &g2); // context words have separate vectors
+            update_pair(ctx, id, w1, w2, g1, g2, log(cr.val), weight, W_updates1, W_updates2);
+            if (hot != NULL && ++since_merge >= ctx->sync_every) { merge_hot_rows(ctx, hot); since_merge = 0; }
+        }
+    }
+    else {
+        /* Read batch_size records at a time and prefetch the rows of upcoming records while updating the current one,
+         * so the random row loads overlap instead of each record stalling on DRAM */
+        CREC *batch = (CREC*)malloc(ctx->batch_size * sizeof(CREC));
+        real *log_val = (real*)malloc(ctx->batch_size * sizeof(real));
+        real *weight = (real*)malloc(ctx->batch_size * sizeof(real));
+        for (a = 0; a < count; a += n) {
+            n = (count - a < ctx->batch_size) ? count - a : ctx->batch_size;
+            n = read_records(ctx, id, batch, n, fin);
+            if (n <= 0) break;
+            ctx->counters[id].records += n;
+            for (c = 0; c < n; c++) { // Vectorizable pass over the batch
+                log_val[c] = log(batch[c].val);
+                weight[c] = (batch[c].val > ctx->x_max) ? 1.0 : pow(batch[c].val / ctx->x_max, ctx->alpha);
+            }
+            if (ctx->sample_scale > 0) { // Records left out of the sample are skipped like invalid ones
+                for (c = 0; c < n; c++) if (!sample_record(ctx, id, &weight[c])) batch[c].word1 = 0;
+            }
+            for (c = 0; c < n + PREFETCH_DISTANCE; c++) {
+                if (c < n - PREFETCH_DISTANCE && batch[c + PREFETCH_DISTANCE].word1 > 0 && batch[c + PREFETCH_DISTANCE].word2 > 0) {
+                    cr = batch[c + PREFETCH_DISTANCE];
+                    locate_rows(ctx, hot, cr.word1 - 1LL, 0, &w1, &g1);
+                    locate_rows(ctx, hot, cr.word2 - 1LL, 1, &w2, &g2);
+                    prefetch_rows(ctx, w1, w2, g1, g2);
+                }
+                if (c < PREFETCH_DISTANCE) continue; // Still filling the prefetch pipeline
+                cr = batch[c - PREFETCH_DISTANCE];
+                if (cr.word1 < 1 || cr.word2 < 1) { continue; }
+                locate_rows(ctx, hot, cr.word1 - 1LL, 0, &w1, &g1);
+                locate_rows(ctx, hot, cr.word2 - 1LL, 1, &w2, &g2);
+                update_pair(ctx, id, w1, w2, g1, g2, log_val[c - PREFETCH_DISTANCE], weight[c - PREFETCH_DISTANCE], W_updates1, W_updates2);
+                if (hot != NULL && ++since_merge >= ctx->sync_every) { merge_hot_rows(ctx, hot); since_merge = 0; }
             }
         }
-
-        // updates for bias terms
-        W[vector_size + l1] -= check_nan(fdiff / sqrt(gradsq[vector_size + l1]));
-        W[vector_size + l2] -= check_nan(fdiff / sqrt(gradsq[vector_size + l2]));
-        fdiff *= fdiff;
-        gradsq[vector_size + l1] += fdiff;
-        gradsq[vector_size + l2] += fdiff;
-        
+        free(batch);
+        free(log_val);
+        free(weight);
+    }
+    if (hot != NULL) {
+        merge_hot_rows(ctx, hot);
+        free(hot);
     }
     free(W_updates1);
     free(W_updates2);
-    
+}
+
+/* Train the GloVe model */
+static void *
+#if defined(_WIN32)
+__stdcall
+#endif
+glove_thread(void *vid) {
+    THREAD_ARG *arg = (THREAD_ARG*)vid;
+    GLOVE_CONTEXT *ctx = arg->ctx;
+    long long id = arg->id;
+    FILE *fin;
+    if (ctx->pin_threads) pin_thread(ctx, id);
+    fin = fopen(ctx->input_file, "rb");
+    fseek(fin, (ctx->segment_start + ctx->segment_lines / ctx->num_threads * id) * (sizeof(CREC)), SEEK_SET); //Threads spaced roughly equally throughout file
+    train_records(ctx, id, fin, ctx->lines_per_thread[id]);
+    fclose(fin);
+#if defined (_WIN32)
+	_endthreadex(NULL);
+#else
+	pthread_exit(NULL);
+#endif
+	return NULL;
+}
+
+/* Block of the num_threads x num_threads grid that a record falls in: words and contexts are dealt round-robin by
+ * frequency rank into num_threads classes each, so the hot head of the vocabulary is spread evenly over the blocks */
+static inline long long block_of(GLOVE_CONTEXT *ctx, const CREC *cr) {
+    return ((cr->word1 - 1LL) % ctx->num_threads) * ctx->num_threads + (cr->word2 - 1LL) % ctx->num_threads;
+}
+
+/* Train on one block of the current round; no two threads of a round share a word class or a context class */
+static void *
+#if defined(_WIN32)
+__stdcall
+#endif
+glove_block_thread(void *vid) {
+    THREAD_ARG *arg = (THREAD_ARG*)vid;
+    GLOVE_CONTEXT *ctx = arg->ctx;
+    long long id = arg->id;
+    long long block = id * ctx->num_threads + (id + ctx->block_round) % ctx->num_threads;
+    FILE *fin;
+    if (ctx->pin_threads) pin_thread(ctx, id);
+    fin = fopen(ctx->block_file, "rb");
+    fseek(fin, ctx->block_offsets[block] * (sizeof(CREC)), SEEK_SET);
+    train_records(ctx, id, fin, ctx->block_offsets[block + 1] - ctx->block_offsets[block]);
     fclose(fin);
 #if defined (_WIN32)
 	_endthreadex(NULL);
@@ -196,8 +729,349 @@ glove_thread(void *vid) {
 	return NULL;
 }
 
-/* Save params to file */
-static int save_params(int nb_iter) {
+/* Write out the buffered records of one block at that block's next free position in the block file */
+static void flush_block(GLOVE_CONTEXT *ctx, FILE *fout, CREC *buffer, long long block, long long *fill, long long *written) {
+    fseek(fout, (ctx->block_offsets[block] + written[block]) * (sizeof(CREC)), SEEK_SET);
+    fwrite(buffer, sizeof(CREC), fill[block], fout);
+    written[block] += fill[block];
+    fill[block] = 0;
+}
+
+/* Read up to BLOCK_READ_LENGTH of the *remaining training records into chunk; records past num_lines are held out */
+static long long read_chunk(FILE *fin, CREC *chunk, long long *remaining) {
+    long long n = (long long)fread(chunk, sizeof(CREC), (*remaining < BLOCK_READ_LENGTH) ? *remaining : BLOCK_READ_LENGTH, fin);
+    if (n > 0) *remaining -= n;
+    return n;
+}
+
+/* Rewrite the cooccurrence records grouped by block, preserving their (shuffled) order within each block */
+static int bucket_by_blocks(GLOVE_CONTEXT *ctx) {
+    long long a, n, remaining, block, num_blocks = (long long)ctx->num_threads * ctx->num_threads;
+    long long *fill, *written;
+    CREC *chunk, *buffers;
+    FILE *fin, *fout;
+
+    if (ctx->verbose > 1) fprintf(stderr, "Bucketing cooccurrences into %d x %d blocks...", ctx->num_threads, ctx->num_threads);
+    fin = fopen(ctx->input_file, "rb");
+    if (fin == NULL) {fprintf(stderr,"Unable to open cooccurrence file %s.\n",ctx->input_file); return 1;}
+    fout = fopen(ctx->block_file, "wb");
+    if (fout == NULL) {fprintf(stderr,"Unable to open file %s.\n",ctx->block_file); fclose(fin); return 1;}
+    chunk = (CREC*)malloc(BLOCK_READ_LENGTH * sizeof(CREC));
+    buffers = (CREC*)malloc(num_blocks * BLOCK_BUFFER_LENGTH * sizeof(CREC));
+    fill = (long long*)calloc(num_blocks, sizeof(long long));
+    written = (long long*)calloc(num_blocks, sizeof(long long));
+    ctx->block_offsets = (long long*)calloc(num_blocks + 1, sizeof(long long));
+
+    /* Count records per block to find where each block starts */
+    for (remaining = ctx->num_lines; (n = read_chunk(fin, chunk, &remaining)) > 0; )
+        for (a = 0; a < n; a++) if (chunk[a].word1 > 0 && chunk[a].word2 > 0) ctx->block_offsets[block_of(ctx, &chunk[a]) + 1]++;
+    for (block = 0; block < num_blocks; block++) ctx->block_offsets[block + 1] += ctx->block_offsets[block];
+
+    /* Scatter records into their blocks through small per-block buffers */
+    rewind(fin);
+    for (remaining = ctx->num_lines; (n = read_chunk(fin, chunk, &remaining)) > 0; ) {
+        for (a = 0; a < n; a++) {
+            if (chunk[a].word1 < 1 || chunk[a].word2 < 1) continue;
+            block = block_of(ctx, &chunk[a]);
+            buffers[block * BLOCK_BUFFER_LENGTH + fill[block]++] = chunk[a];
+            if (fill[block] == BLOCK_BUFFER_LENGTH) flush_block(ctx, fout, buffers + block * BLOCK_BUFFER_LENGTH, block, fill, written);
+        }
+    }
+    for (block = 0; block < num_blocks; block++) flush_block(ctx, fout, buffers + block * BLOCK_BUFFER_LENGTH, block, fill, written);
+    fclose(fin);
+    fclose(fout);
+    free(chunk);
+    free(buffers);
+    free(fill);
+    free(written);
+    if (ctx->verbose > 1) fprintf(stderr, "done.\n");
+    return 0;
+}
+
+/* Open an output file with a large stdio buffer, so parameters go out in big writes */
+static FILE *open_output(const char *file_name) {
+    FILE *fout = fopen(file_name, "wb");
+    if (fout != NULL) setvbuf(fout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    return fout;
+}
+
+/* Write the 2 * vocab_size rows of W or gradsq (laid out like them) without padding, in as few writes as possible */
+static void write_rows(GLOVE_CONTEXT *ctx, const real *rows, FILE *fout) {
+    long long a;
+    if (ctx->row_stride == ctx->vector_size + 1) fwrite(rows, sizeof(real), 2 * ctx->vocab_size * ctx->row_stride, fout);
+    else for (a = 0; a < 2 * ctx->vocab_size; a++) fwrite(&rows[a * ctx->row_stride], sizeof(real), ctx->vector_size + 1, fout); // De-interleave
+}
+
+/* Make room for at least extra more bytes in a text buffer */
+static void reserve_text(TEXT_BUFFER *buf, long long extra) {
+    if (buf->length + extra <= buf->capacity) return;
+    buf->capacity = 2 * (buf->length + extra);
+    buf->text = (char*)realloc(buf->text, buf->capacity);
+}
+
+/* Append a space and x with precision digits after the decimal point, exactly as fprintf(" %.*lf") would. Ordinary
+ * magnitudes are converted with integer arithmetic; x scaled by 10^precision carries up to half an ulp of rounding
+ * error, so values whose scaled fraction lies that close to .5, where the error could change the rounding, go through
+ * snprintf instead */
+static void append_real(GLOVE_CONTEXT *ctx, TEXT_BUFFER *buf, real x) {
+    static const real powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+    char digits[24], *p;
+    unsigned long long r, whole, frac;
+    int a, n = 0;
+    real scaled = fabs(x) * powers[ctx->precision], whole_part = floor(scaled);
+    reserve_text(buf, MAX_REAL_TEXT + ctx->precision);
+    p = buf->text + buf->length;
+    if (!(scaled < 9e15) || fabs(scaled - whole_part - 0.5) <= scaled * DBL_EPSILON) { // Too large (or not a number), or too near a tie
+        buf->length += snprintf(p, MAX_REAL_TEXT + ctx->precision, " %.*lf", ctx->precision, x);
+        return;
+    }
+    *p++ = ' ';
+    memcpy(&r, &x, sizeof(r)); // The sign bit itself, which -ffast-math lets signbit() ignore for zeros
+    if (r >> 63) *p++ = '-';
+    r = (unsigned long long)whole_part + (scaled - whole_part > 0.5);
+    whole = r / (unsigned long long)powers[ctx->precision];
+    frac = r % (unsigned long long)powers[ctx->precision];
+    do { digits[n++] = '0' + whole % 10; whole /= 10; } while (whole > 0);
+    while (n > 0) *p++ = digits[--n];
+    if (ctx->precision > 0) {
+        *p++ = '.';
+        for (a = ctx->precision - 1; a >= 0; a--) { p[a] = '0' + frac % 10; frac /= 10; }
+        p += ctx->precision;
+    }
+    buf->length = p - buf->text;
+}
+
+static void append_text(TEXT_BUFFER *buf, const char *text, long long length) {
+    reserve_text(buf, length);
+    memcpy(buf->text + buf->length, text, length);
+    buf->length += length;
+}
+
+/* Read the count words of the vocabulary file into one arena, each NUL terminated and starting at (*offsets)[a];
+ * (*offsets)[count] is the end of the last word. Returns 1 on a short file or a reserved <unk> entry */
+static int read_words(FILE *fid, long long count, char **words, long long **offsets) {
+    long long a, vocab_bytes, used = 0;
+    char format[20];
+    int result = 0;
+
+    fseek(fid, 0, SEEK_END);
+    vocab_bytes = ftell(fid);
+    rewind(fid);
+    *words = (char*)malloc(vocab_bytes + MAX_STRING_LENGTH + 2);
+    *offsets = (long long*)malloc((count + 1) * sizeof(long long));
+    sprintf(format,"%%%ds %%*s",MAX_STRING_LENGTH); // Word, then skip the irrelevant frequency entry
+    for (a = 0; a < count && result == 0; a++) {
+        (*offsets)[a] = used;
+        if (fscanf(fid,format,*words + used) != 1) result = 1;
+        // input vocab cannot contain special <unk> keyword
+        else if (strcmp(*words + used, "<unk>") == 0) result = 1;
+        else used += strlen(*words + used) + 1;
+    }
+    (*offsets)[a] = used;
+    return result;
+}
+
+/* Whether a file starts like a binary model file */
+static int is_model_file(const char *file_name) {
+    char magic[8];
+    int result;
+    FILE *fin = fopen(file_name, "rb");
+    if (fin == NULL) return 0;
+    result = fread(magic, 1, sizeof(magic), fin) == sizeof(magic) && memcmp(magic, "GLOVEMDL", sizeof(magic)) == 0;
+    fclose(fin);
+    return result;
+}
+
+/* Count the entries of a vocabulary file and read its words as read_words does; prints an error and returns 1 on failure */
+static int read_vocab(const char *file_name, long long *count, char **words, long long **offsets) {
+    int i, result = 0;
+    FILE *fid = fopen(file_name, "r");
+    *words = NULL;
+    *offsets = NULL;
+    if (fid == NULL) { fprintf(stderr, "Unable to open vocab file %s.\n",file_name); return 1; }
+    *count = 0;
+    while ((i = getc(fid)) != EOF) if (i == '\n') (*count)++; // Count number of entries in vocab_file
+    if (read_words(fid, *count, words, offsets) != 0) {
+        fprintf(stderr, "Vocab file %s is truncated or contains the reserved word <unk>.\n", file_name);
+        result = 1;
+    }
+    fclose(fid);
+    return result;
+}
+
+/* Hash count words, as laid out by read_words, into a new open addressing table of *table_size slots holding their
+ * indices, -1 for empty slots */
+static long long *build_word_table(const char *words, const long long *offsets, long long count, long long *table_size) {
+    long long a, slot, *table;
+    *table_size = 2 * count + 1;
+    table = (long long*)malloc(*table_size * sizeof(long long));
+    for (a = 0; a < *table_size; a++) table[a] = -1;
+    for (a = 0; a < count; a++) {
+        slot = bitwisehash(words + offsets[a], *table_size, HASH_SEED);
+        while (table[slot] >= 0) slot = (slot + 1) % *table_size;
+        table[slot] = a;
+    }
+    return table;
+}
+
+/* Index of word in a table built by build_word_table, or -1 if it is not there */
+static long long find_word(const long long *table, long long table_size, const char *words, const long long *offsets,
+                           const char *word) {
+    long long slot = bitwisehash(word, table_size, HASH_SEED), index;
+    while ((index = table[slot]) >= 0) {
+        if (strcmp(words + offsets[index], word) == 0) return index;
+        slot = (slot + 1) % table_size;
+    }
+    return -1;
+}
+
+/* Format one chunk of vocabulary rows of the parameters being exported into this thread's buffers */
+static void *
+#if defined(_WIN32)
+__stdcall
+#endif
+export_thread(void *vid) {
+    THREAD_ARG *arg = (THREAD_ARG*)vid;
+    GLOVE_CONTEXT *ctx = arg->ctx;
+    long long id = arg->id;
+    long long a, b, start = ctx->export_next_row + id * EXPORT_CHUNK_ROWS, end = start + EXPORT_CHUNK_ROWS;
+    real *word_row, *context_row;
+    TEXT_BUFFER *text = &ctx->export_text_W[id], *text_gsq = &ctx->export_text_gradsq[id];
+    text->length = text_gsq->length = 0;
+    if (end > ctx->vocab_size) end = ctx->vocab_size;
+    for (a = start; a < end; a++) {
+        const char *word = ctx->vocab_words + ctx->vocab_word_offsets[a];
+        long long word_length = ctx->vocab_word_offsets[a + 1] - ctx->vocab_word_offsets[a] - 1;
+        word_row = ctx->export_W + a * ctx->row_stride;
+        context_row = ctx->export_W + (ctx->vocab_size + a) * ctx->row_stride;
+        append_text(text, word, word_length);
+        if (ctx->model == 0) { // Save all parameters (including bias)
+            for (b = 0; b < (ctx->vector_size + 1); b++) append_real(ctx, text, word_row[b]);
+            for (b = 0; b < (ctx->vector_size + 1); b++) append_real(ctx, text, context_row[b]);
+        }
+        if (ctx->model == 1) // Save only "word" vectors (without bias)
+            for (b = 0; b < ctx->vector_size; b++) append_real(ctx, text, word_row[b]);
+        if (ctx->model == 2) // Save "word + context word" vectors (without bias)
+            for (b = 0; b < ctx->vector_size; b++) append_real(ctx, text, word_row[b] + context_row[b]);
+        append_text(text, "\n", 1);
+        if (ctx->export_with_gradsq) {
+            append_text(text_gsq, word, word_length);
+            for (b = 0; b < (ctx->vector_size + 1); b++) append_real(ctx, text_gsq, ctx->export_gradsq[a * ctx->row_stride + b]);
+            for (b = 0; b < (ctx->vector_size + 1); b++) append_real(ctx, text_gsq, ctx->export_gradsq[(ctx->vocab_size + a) * ctx->row_stride + b]);
+            append_text(text_gsq, "\n", 1);
+        }
+    }
+#if defined (_WIN32)
+    _endthreadex(0);
+#else
+    pthread_exit(NULL);
+#endif
+    return NULL;
+}
+
+/* Write the vocabulary rows of the text output (and of the gradsq text output, if fgs is not NULL) with export_threads
+ * threads, each formatting a chunk of rows into its own buffer; the buffers are then written out in order */
+static int export_text(GLOVE_CONTEXT *ctx, real *W, real *gradsq, FILE *fout, FILE *fgs) {
+    long long a;
+
+    ctx->export_W = W;
+    ctx->export_gradsq = gradsq;
+    ctx->export_with_gradsq = (fgs != NULL);
+    ctx->export_text_W = (TEXT_BUFFER*)calloc(ctx->export_threads, sizeof(TEXT_BUFFER));
+    ctx->export_text_gradsq = (TEXT_BUFFER*)calloc(ctx->export_threads, sizeof(TEXT_BUFFER));
+    for (ctx->export_next_row = 0; ctx->export_next_row < ctx->vocab_size; ctx->export_next_row += (long long)ctx->export_threads * EXPORT_CHUNK_ROWS) {
+        run_threads(ctx, export_thread, ctx->export_threads);
+        for (a = 0; a < ctx->export_threads; a++) {
+            if (ctx->export_text_W[a].length == 0) continue; // A thread past the last row formatted nothing
+            fwrite(ctx->export_text_W[a].text, 1, ctx->export_text_W[a].length, fout);
+            if (fgs != NULL) fwrite(ctx->export_text_gradsq[a].text, 1, ctx->export_text_gradsq[a].length, fgs);
+        }
+    }
+    for (a = 0; a < ctx->export_threads; a++) {
+        free(ctx->export_text_W[a].text);
+        free(ctx->export_text_gradsq[a].text);
+    }
+    free(ctx->export_text_W);
+    free(ctx->export_text_gradsq);
+    return 0;
+}
+
+/* Average the word and context rows of the (up to) 100 rarest words, which stand in for <unk> */
+static void average_rare_rows(GLOVE_CONTEXT *ctx, const real *W, real *unk_vec, real *unk_context) {
+    long long a, b;
+    int num_rare_words = ctx->vocab_size < 100 ? ctx->vocab_size : 100;
+
+    for (a = ctx->vocab_size - num_rare_words; a < ctx->vocab_size; a++) {
+        for (b = 0; b < (ctx->vector_size + 1); b++) {
+            unk_vec[b] += W[a * ctx->row_stride + b] / num_rare_words;
+            unk_context[b] += W[(ctx->vocab_size + a) * ctx->row_stride + b] / num_rare_words;
+        }
+    }
+}
+
+/* Fill one output row, laid out as in the text output for the current model, from a word row and its context row */
+static void model_row(GLOVE_CONTEXT *ctx, const real *word_row, const real *context_row, double *out) {
+    long long b;
+    if (ctx->model == 0) { // All parameters (including bias)
+        for (b = 0; b < (ctx->vector_size + 1); b++) out[b] = word_row[b];
+        for (b = 0; b < (ctx->vector_size + 1); b++) out[ctx->vector_size + 1 + b] = context_row[b];
+    }
+    if (ctx->model == 1) // Only "word" vectors (without bias)
+        for (b = 0; b < ctx->vector_size; b++) out[b] = word_row[b];
+    if (ctx->model == 2) // "word + context word" vectors (without bias)
+        for (b = 0; b < ctx->vector_size; b++) out[b] = word_row[b] + context_row[b];
+}
+
+/* Value type of the model file for each modelFile setting */
+static const int MODEL_FILE_DTYPES[5] = {GLOVE_DTYPE_FLOAT32, GLOVE_DTYPE_FLOAT32, GLOVE_DTYPE_FLOAT64, GLOVE_DTYPE_INT8, GLOVE_DTYPE_PQ};
+
+/* Write the vectors of the current model, with the vocabulary, to <save_W_file>.glvm (or .<nb_iter>.glvm) in the
+ * self-describing binary model format, and the perfect hash of its words to the same name ending in .mph */
+static int write_model_file(GLOVE_CONTEXT *ctx, real *W, int nb_iter) {
+    long long a;
+    int result;
+    char output_file[MAX_STRING_LENGTH];
+    const char **row_words;
+    double *row;
+    GloveModelWriter *writer;
+
+    if (nb_iter <= 0)
+        sprintf(output_file,"%s.glvm",ctx->save_W_file);
+    else
+        sprintf(output_file,"%s.%03d.glvm",ctx->save_W_file,nb_iter);
+    row_words = (const char**)malloc((ctx->vocab_size + 1) * sizeof(char*));
+    for (a = 0; a < ctx->vocab_size; a++) row_words[a] = ctx->vocab_words + ctx->vocab_word_offsets[a];
+    row_words[ctx->vocab_size] = "<unk>";
+    result = gloveModelWriterOpenPQ(output_file, ctx->vocab_size + ctx->use_unk_vec, ctx->vector_size, ctx->model,
+                                    MODEL_FILE_DTYPES[ctx->model_file], ctx->pq_subspaces, row_words, &writer);
+    if (result == 0) {
+        row = (double*)malloc(2 * (ctx->vector_size + 1) * sizeof(double));
+        for (a = 0; a < ctx->vocab_size; a++) {
+            model_row(ctx, W + a * ctx->row_stride, W + (ctx->vocab_size + a) * ctx->row_stride, row);
+            gloveModelWriterAddRow(writer, row);
+        }
+        if (ctx->use_unk_vec) {
+            real *unk_vec = (real*)calloc((ctx->vector_size + 1), sizeof(real));
+            real *unk_context = (real*)calloc((ctx->vector_size + 1), sizeof(real));
+            average_rare_rows(ctx, W, unk_vec, unk_context);
+            model_row(ctx, unk_vec, unk_context, row);
+            gloveModelWriterAddRow(writer, row);
+            free(unk_vec);
+            free(unk_context);
+        }
+        result = gloveModelWriterClose(writer);
+        free(row);
+    }
+    if (result == 0) {
+        strcpy(output_file + strlen(output_file) - strlen("glvm"), "mph");
+        result = gloveWordHashWrite(row_words, ctx->vocab_size + ctx->use_unk_vec, output_file);
+    }
+    free(row_words);
+    return result;
+}
+
+/* Save params to file; W and gradsq may be the live parameters or a snapshot of them */
+static int save_params(GLOVE_CONTEXT *ctx, real *W, real *gradsq, int nb_iter) {
     /*
      * nb_iter is the number of iteration (= a full pass through the cooccurrence matrix).
      *   nb_iter > 0 => checkpointing the intermediate parameters, so nb_iter is in the filename of output file.
@@ -205,188 +1079,880 @@ static int save_params(int nb_iter) {
      */
 
     long long a, b;
-    char format[20];
     char output_file[MAX_STRING_LENGTH], output_file_gsq[MAX_STRING_LENGTH];
-    char *word = malloc(sizeof(char) * MAX_STRING_LENGTH + 1);
-    FILE *fid, *fout, *fgs;
+    const char *word;
+    FILE *fout, *fgs = NULL;
     
-    if (use_binary > 0) { // Save parameters in binary file
+    if (ctx->use_binary > 0) { // Save parameters in binary file
         if (nb_iter <= 0)
-            sprintf(output_file,"%s.bin",save_W_file);
+            sprintf(output_file,"%s.bin",ctx->save_W_file);
         else
-            sprintf(output_file,"%s.%03d.bin",save_W_file,nb_iter);
+            sprintf(output_file,"%s.%03d.bin",ctx->save_W_file,nb_iter);
 
-        fout = fopen(output_file,"wb");
-        if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n",save_W_file); return 1;}
-        for (a = 0; a < 2 * (long long)vocab_size * (vector_size + 1); a++) fwrite(&W[a], sizeof(real), 1,fout);
+        fout = open_output(output_file);
+        if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n",ctx->save_W_file); return 1;}
+        write_rows(ctx, W, fout);
         fclose(fout);
-        if (save_gradsq > 0) {
+        if (ctx->save_gradsq > 0) {
             if (nb_iter <= 0)
-                sprintf(output_file_gsq,"%s.bin",save_gradsq_file);
+                sprintf(output_file_gsq,"%s.bin",ctx->save_gradsq_file);
             else
-                sprintf(output_file_gsq,"%s.%03d.bin",save_gradsq_file,nb_iter);
+                sprintf(output_file_gsq,"%s.%03d.bin",ctx->save_gradsq_file,nb_iter);
 
-            fgs = fopen(output_file_gsq,"wb");
-            if (fgs == NULL) {fprintf(stderr, "Unable to open file %s.\n",save_gradsq_file); return 1;}
-            for (a = 0; a < 2 * (long long)vocab_size * (vector_size + 1); a++) fwrite(&gradsq[a], sizeof(real), 1,fgs);
+            fgs = open_output(output_file_gsq);
+            if (fgs == NULL) {fprintf(stderr, "Unable to open file %s.\n",ctx->save_gradsq_file); return 1;}
+            write_rows(ctx, gradsq, fgs);
             fclose(fgs);
         }
     }
-    if (use_binary != 1) { // Save parameters in text file
+    if (ctx->use_binary != 1) { // Save parameters in text file
         if (nb_iter <= 0)
-            sprintf(output_file,"%s.txt",save_W_file);
+            sprintf(output_file,"%s.txt",ctx->save_W_file);
         else
-            sprintf(output_file,"%s.%03d.txt",save_W_file,nb_iter);
-        if (save_gradsq > 0) {
+            sprintf(output_file,"%s.%03d.txt",ctx->save_W_file,nb_iter);
+        if (ctx->save_gradsq > 0) {
             if (nb_iter <= 0)
-                sprintf(output_file_gsq,"%s.txt",save_gradsq_file);
+                sprintf(output_file_gsq,"%s.txt",ctx->save_gradsq_file);
             else
-                sprintf(output_file_gsq,"%s.%03d.txt",save_gradsq_file,nb_iter);
-
-            fgs = fopen(output_file_gsq,"wb");
-            if (fgs == NULL) {fprintf(stderr, "Unable to open file %s.\n",save_gradsq_file); return 1;}
-        }
-        fout = fopen(output_file,"wb");
-        if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n",save_W_file); return 1;}
-        fid = fopen(vocab_file, "r");
-        sprintf(format,"%%%ds",MAX_STRING_LENGTH);
-        if (fid == NULL) {fprintf(stderr, "Unable to open file %s.\n",vocab_file); return 1;}
-        for (a = 0; a < vocab_size; a++) {
-            if (fscanf(fid,format,word) == 0) return 1;
-            // input vocab cannot contain special <unk> keyword
-            if (strcmp(word, "<unk>") == 0) return 1;
+                sprintf(output_file_gsq,"%s.%03d.txt",ctx->save_gradsq_file,nb_iter);
+
+            fgs = open_output(output_file_gsq);
+            if (fgs == NULL) {fprintf(stderr, "Unable to open file %s.\n",ctx->save_gradsq_file); return 1;}
+        }
+        fout = open_output(output_file);
+        if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n",ctx->save_W_file); return 1;}
+        if (ctx->export_threads > 0) {
+            if (export_text(ctx, W, gradsq, fout, (ctx->save_gradsq > 0) ? fgs : NULL) != 0) return 1;
+        }
+        else for (a = 0; a < ctx->vocab_size; a++) {
+            word = ctx->vocab_words + ctx->vocab_word_offsets[a];
             fprintf(fout, "%s",word);
-            if (model == 0) { // Save all parameters (including bias)
-                for (b = 0; b < (vector_size + 1); b++) fprintf(fout," %lf", W[a * (vector_size + 1) + b]);
-                for (b = 0; b < (vector_size + 1); b++) fprintf(fout," %lf", W[(vocab_size + a) * (vector_size + 1) + b]);
+            if (ctx->model == 0) { // Save all parameters (including bias)
+                for (b = 0; b < (ctx->vector_size + 1); b++) fprintf(fout," %.*lf", ctx->precision, W[a * ctx->row_stride + b]);
+                for (b = 0; b < (ctx->vector_size + 1); b++) fprintf(fout," %.*lf", ctx->precision, W[(ctx->vocab_size + a) * ctx->row_stride + b]);
             }
-            if (model == 1) // Save only "word" vectors (without bias)
-                for (b = 0; b < vector_size; b++) fprintf(fout," %lf", W[a * (vector_size + 1) + b]);
-            if (model == 2) // Save "word + context word" vectors (without bias)
-                for (b = 0; b < vector_size; b++) fprintf(fout," %lf", W[a * (vector_size + 1) + b] + W[(vocab_size + a) * (vector_size + 1) + b]);
+            if (ctx->model == 1) // Save only "word" vectors (without bias)
+                for (b = 0; b < ctx->vector_size; b++) fprintf(fout," %.*lf", ctx->precision, W[a * ctx->row_stride + b]);
+            if (ctx->model == 2) // Save "word + context word" vectors (without bias)
+                for (b = 0; b < ctx->vector_size; b++) fprintf(fout," %.*lf", ctx->precision, W[a * ctx->row_stride + b] + W[(ctx->vocab_size + a) * ctx->row_stride + b]);
             fprintf(fout,"\n");
-            if (save_gradsq > 0) { // Save gradsq
+            if (ctx->save_gradsq > 0) { // Save gradsq
                 fprintf(fgs, "%s",word);
-                for (b = 0; b < (vector_size + 1); b++) fprintf(fgs," %lf", gradsq[a * (vector_size + 1) + b]);
-                for (b = 0; b < (vector_size + 1); b++) fprintf(fgs," %lf", gradsq[(vocab_size + a) * (vector_size + 1) + b]);
+                for (b = 0; b < (ctx->vector_size + 1); b++) fprintf(fgs," %.*lf", ctx->precision, gradsq[a * ctx->row_stride + b]);
+                for (b = 0; b < (ctx->vector_size + 1); b++) fprintf(fgs," %.*lf", ctx->precision, gradsq[(ctx->vocab_size + a) * ctx->row_stride + b]);
                 fprintf(fgs,"\n");
             }
-            if (fscanf(fid,format,word) == 0) return 1; // Eat irrelevant frequency entry
         }
 
-        if (use_unk_vec) {
-            real* unk_vec = (real*)calloc((vector_size + 1), sizeof(real));
-            real* unk_context = (real*)calloc((vector_size + 1), sizeof(real));
+        if (ctx->use_unk_vec) {
+            real* unk_vec = (real*)calloc((ctx->vector_size + 1), sizeof(real));
+            real* unk_context = (real*)calloc((ctx->vector_size + 1), sizeof(real));
             word = "<unk>";
-
-            int num_rare_words = vocab_size < 100 ? vocab_size : 100;
-
-            for (a = vocab_size - num_rare_words; a < vocab_size; a++) {
-                for (b = 0; b < (vector_size + 1); b++) {
-                    unk_vec[b] += W[a * (vector_size + 1) + b] / num_rare_words;
-                    unk_context[b] += W[(vocab_size + a) * (vector_size + 1) + b] / num_rare_words;
-                }
-            }
+            average_rare_rows(ctx, W, unk_vec, unk_context);
 
             fprintf(fout, "%s",word);
-            if (model == 0) { // Save all parameters (including bias)
-                for (b = 0; b < (vector_size + 1); b++) fprintf(fout," %lf", unk_vec[b]);
-                for (b = 0; b < (vector_size + 1); b++) fprintf(fout," %lf", unk_context[b]);
+            if (ctx->model == 0) { // Save all parameters (including bias)
+                for (b = 0; b < (ctx->vector_size + 1); b++) fprintf(fout," %.*lf", ctx->precision, unk_vec[b]);
+                for (b = 0; b < (ctx->vector_size + 1); b++) fprintf(fout," %.*lf", ctx->precision, unk_context[b]);
             }
-            if (model == 1) // Save only "word" vectors (without bias)
-                for (b = 0; b < vector_size; b++) fprintf(fout," %lf", unk_vec[b]);
-            if (model == 2) // Save "word + context word" vectors (without bias)
-                for (b = 0; b < vector_size; b++) fprintf(fout," %lf", unk_vec[b] + unk_context[b]);
+            if (ctx->model == 1) // Save only "word" vectors (without bias)
+                for (b = 0; b < ctx->vector_size; b++) fprintf(fout," %.*lf", ctx->precision, unk_vec[b]);
+            if (ctx->model == 2) // Save "word + context word" vectors (without bias)
+                for (b = 0; b < ctx->vector_size; b++) fprintf(fout," %.*lf", ctx->precision, unk_vec[b] + unk_context[b]);
             fprintf(fout,"\n");
 
             free(unk_vec);
             free(unk_context);
         }
 
-        fclose(fid);
         fclose(fout);
-        if (save_gradsq > 0) fclose(fgs);
+        if (ctx->save_gradsq > 0) fclose(fgs);
+    }
+    if (ctx->model_file > 0) return write_model_file(ctx, W, nb_iter);
+    return 0;
+}
+
+#if !defined(_WIN32)
+
+/* Average the slice of the parameters owned by this process across all copies, and write it back to every copy */
+static void average_params(GLOVE_CONTEXT *ctx) {
+    long long a, k, arrays = ctx->interleave ? 1 : 2, len = arrays * ctx->shared->slot_length;
+    long long start = len / ctx->num_processes * ctx->process_id, end = (ctx->process_id == ctx->num_processes - 1) ? len : len / ctx->num_processes * (ctx->process_id + 1);
+    real sum, *copy;
+    for (a = start; a < end; a++) {
+        copy = ctx->shared->slots + (a / ctx->shared->slot_length) * ctx->num_processes * ctx->shared->slot_length + a % ctx->shared->slot_length;
+        for (sum = 0, k = 0; k < ctx->num_processes; k++) sum += copy[k * ctx->shared->slot_length];
+        for (sum /= ctx->num_processes, k = 0; k < ctx->num_processes; k++) copy[k * ctx->shared->slot_length] = sum;
+    }
+}
+
+static int stop_workers(GLOVE_CONTEXT *ctx, int abort);
+
+/* Copy the initialized parameters into a shared mapping and fork num_processes - 1 workers; on return each process
+ * (including this one, as process 0) trains in its own copy */
+static int start_workers(GLOVE_CONTEXT *ctx) {
+    long long k, header = round_up(sizeof(SHARED_PARAMS) + ctx->num_processes * sizeof(real), 4096);
+    long long slot_length = 2 * ctx->vocab_size * ctx->row_stride, arrays = ctx->interleave ? 1 : 2;
+    pthread_barrierattr_t attr;
+    pid_t pid;
+
+    ctx->shared_bytes = header + arrays * ctx->num_processes * slot_length * sizeof(real);
+    ctx->shared = mmap(NULL, ctx->shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ctx->shared == MAP_FAILED) {fprintf(stderr, "Unable to map shared memory for %d worker processes.\n", ctx->num_processes); return 1;}
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&ctx->shared->barrier, &attr, ctx->num_processes);
+    pthread_barrierattr_destroy(&attr);
+    ctx->shared->slot_length = slot_length;
+    ctx->shared->slots = (real*)((char*)ctx->shared + header);
+    for (k = 0; k < ctx->num_processes; k++) {
+        memcpy(ctx->shared->slots + k * slot_length, ctx->W, slot_length * sizeof(real));
+        if (!ctx->interleave) memcpy(ctx->shared->slots + (ctx->num_processes + k) * slot_length, ctx->gradsq, slot_length * sizeof(real));
+    }
+    ctx->private_W = ctx->W;
+    ctx->private_gradsq = ctx->gradsq;
+
+    fflush(stdout);
+    fflush(stderr);
+    ctx->worker_pids = (pid_t*)calloc(ctx->num_processes, sizeof(pid_t));
+    if (ctx->worker_pids == NULL) {
+        fprintf(stderr, "Out of memory for %d worker processes.\n", ctx->num_processes);
+        pthread_barrier_destroy(&ctx->shared->barrier);
+        munmap(ctx->shared, ctx->shared_bytes);
+        return 1;
+    }
+    for (k = 1; k < ctx->num_processes; k++) {
+        pid = fork();
+        if (pid < 0) { // The workers started so far would wait at the barrier forever
+            fprintf(stderr, "Unable to start worker process %lld.\n", k);
+            ctx->num_processes = (int)k;
+            ctx->W = ctx->shared->slots;
+            ctx->gradsq = ctx->interleave ? ctx->W + (ctx->private_gradsq - ctx->private_W) : ctx->shared->slots + ctx->num_processes * slot_length;
+            stop_workers(ctx, 1);
+            return 1;
+        }
+        if (pid == 0) {
+            ctx->process_id = (int)k;
+            ctx->verbose = 0;
+            break;
+        }
+        ctx->worker_pids[k] = pid;
+    }
+    ctx->W = ctx->shared->slots + ctx->process_id * slot_length;
+    ctx->gradsq = ctx->interleave ? ctx->W + (ctx->private_gradsq - ctx->private_W) : ctx->shared->slots + (ctx->num_processes + ctx->process_id) * slot_length;
+    return 0;
+}
+
+/* Wait for the workers to finish and take the (averaged) parameters back into private memory. After an error in this
+ * process the workers may be waiting at the barrier for it, so with abort set they are killed rather than waited for */
+static int stop_workers(GLOVE_CONTEXT *ctx, int abort) {
+    int k, status, result = 0;
+    for (k = 1; k < ctx->num_processes; k++) {
+        if (abort) {
+            kill(ctx->worker_pids[k], SIGKILL);
+            waitpid(ctx->worker_pids[k], &status, 0);
+        }
+        else if (waitpid(ctx->worker_pids[k], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Worker process %d failed.\n", k);
+            result = 1;
+        }
+    }
+    memcpy(ctx->private_W, ctx->W, ctx->shared->slot_length * sizeof(real));
+    if (!ctx->interleave) memcpy(ctx->private_gradsq, ctx->gradsq, ctx->shared->slot_length * sizeof(real));
+    ctx->W = ctx->private_W;
+    ctx->gradsq = ctx->private_gradsq;
+    if (!abort) pthread_barrier_destroy(&ctx->shared->barrier); // Would wait for killed workers to leave the barrier
+    munmap(ctx->shared, ctx->shared_bytes);
+    free(ctx->worker_pids);
+    return result;
+}
+#endif
+
+/* One Hogwild pass over the records of this process's shard; with several processes, the shard is trained in
+ * process_syncs segments, after each of which the processes average their parameters */
+static real train_hogwild(GLOVE_CONTEXT *ctx) {
+    long long a, k, shard_start = ctx->num_lines / ctx->num_processes * ctx->process_id;
+    long long shard_lines = (ctx->process_id == ctx->num_processes - 1) ? ctx->num_lines - shard_start : ctx->num_lines / ctx->num_processes;
+    int s, syncs = (ctx->num_processes > 1) ? ctx->process_syncs : 1;
+    real total_cost = 0;
+    for (s = 0; s < syncs; s++) {
+        ctx->segment_start = shard_start + shard_lines / syncs * s;
+        ctx->segment_lines = (s == syncs - 1) ? shard_start + shard_lines - ctx->segment_start : shard_lines / syncs;
+        for (a = 0; a < ctx->num_threads - 1; a++) ctx->lines_per_thread[a] = ctx->segment_lines / ctx->num_threads;
+        ctx->lines_per_thread[a] = ctx->segment_lines / ctx->num_threads + ctx->segment_lines % ctx->num_threads;
+        run_threads(ctx, glove_thread, ctx->num_threads);
+#if !defined(_WIN32)
+        if (ctx->num_processes > 1) {
+            pthread_barrier_wait(&ctx->shared->barrier);
+            average_params(ctx);
+            pthread_barrier_wait(&ctx->shared->barrier);
+        }
+#endif
+    }
+    for (a = 0; a < ctx->num_threads; a++) total_cost += ctx->cost[a];
+#if !defined(_WIN32)
+    if (ctx->num_processes > 1) { // Gather the cost of every process
+        ctx->shared->cost[ctx->process_id] = total_cost;
+        pthread_barrier_wait(&ctx->shared->barrier);
+        for (total_cost = 0, k = 0; k < ctx->num_processes; k++) total_cost += ctx->shared->cost[k];
+    }
+#endif
+    return total_cost;
+}
+
+/* Write W, gradsq and the iteration count to <save_W_file>.<nb_iter>.ckpt so training can be resumed from it */
+static int save_checkpoint(GLOVE_CONTEXT *ctx, real *W, real *gradsq, int nb_iter) {
+    char output_file[MAX_STRING_LENGTH];
+    CHECKPOINT_HEADER header;
+    FILE *fout;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.real_size = sizeof(real);
+    header.vocab_size = ctx->vocab_size;
+    header.vector_size = ctx->vector_size;
+    header.iter = nb_iter;
+    sprintf(output_file,"%s.%03d.ckpt",ctx->save_W_file,nb_iter);
+    fout = open_output(output_file);
+    if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n",output_file); return 1;}
+    fwrite(&header, sizeof(header), 1, fout);
+    write_rows(ctx, W, fout);
+    write_rows(ctx, gradsq, fout);
+    if (fclose(fout) != 0) {fprintf(stderr, "Unable to write file %s.\n",output_file); return 1;}
+    return 0;
+}
+
+/* Restore W and gradsq from a checkpoint; returns the number of iterations it had completed, or -1 on error */
+static int load_checkpoint(GLOVE_CONTEXT *ctx, const char *file_name) {
+    long long a;
+    CHECKPOINT_HEADER header;
+    FILE *fin = fopen(file_name, "rb");
+    if (fin == NULL) {fprintf(stderr, "Unable to open checkpoint file %s.\n",file_name); return -1;}
+    if (fread(&header, sizeof(header), 1, fin) != 1 || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CHECKPOINT_VERSION) {
+        fprintf(stderr, "%s is not a GloVe checkpoint file.\n", file_name);
+        fclose(fin);
+        return -1;
+    }
+    if (header.real_size != sizeof(real) || header.vocab_size != ctx->vocab_size || header.vector_size != ctx->vector_size) {
+        fprintf(stderr, "Checkpoint %s has vocab size %lld, vector size %d and %d-byte reals; expected %lld, %d and %d.\n",
+                file_name, header.vocab_size, header.vector_size, header.real_size, ctx->vocab_size, ctx->vector_size, (int)sizeof(real));
+        fclose(fin);
+        return -1;
+    }
+    for (a = 0; a < 2 * ctx->vocab_size; a++) {
+        if (fread(&ctx->W[a * ctx->row_stride], sizeof(real), ctx->vector_size + 1, fin) != (size_t)ctx->vector_size + 1) break;
+    }
+    for (; a < 4 * ctx->vocab_size; a++) {
+        if (fread(&ctx->gradsq[(a - 2 * ctx->vocab_size) * ctx->row_stride], sizeof(real), ctx->vector_size + 1, fin) != (size_t)ctx->vector_size + 1) break;
+    }
+    fclose(fin);
+    if (a < 4 * ctx->vocab_size) {fprintf(stderr, "Checkpoint file %s is truncated.\n", file_name); return -1;}
+    return header.iter;
+}
+
+/* Warm start from a binary model file, which holds its own words: files of model 0 restore the word and context rows
+ * of matching words with their biases, files of the other models (such as pretrained vectors converted with
+ * gloveVectorsConvert) only their word vectors. Returns the number of words carried over, or -1 on error */
+static long long warm_start_model_file(GLOVE_CONTEXT *ctx) {
+    long long a, b, row, matched = 0, table_size, *table;
+    real gradsq_scale = 1.0 / (ctx->warm_eta * ctx->warm_eta);
+    float *values;
+    GloveModelFile *model;
+    GloveModelInfo info;
+
+    if (gloveModelFileOpen(ctx->warm_file, &model) != 0) return -1;
+    gloveModelFileInfo(model, &info);
+    if (info.vectorSize != ctx->vector_size) {
+        fprintf(stderr, "Model file %s has vector size %d; expected %d.\n", ctx->warm_file, info.vectorSize, ctx->vector_size);
+        gloveModelFileClose(model);
+        return -1;
+    }
+    table = build_word_table(ctx->vocab_words, ctx->vocab_word_offsets, ctx->vocab_size, &table_size);
+    values = (float*)malloc(info.dim * sizeof(float));
+    for (a = 0; a < info.rows; a++) {
+        row = find_word(table, table_size, ctx->vocab_words, ctx->vocab_word_offsets, gloveModelFileWord(model, a));
+        if (row < 0) continue;
+        gloveModelFileDecode(model, a, values);
+        matched++;
+        if (info.model == 0) {
+            for (b = 0; b <= ctx->vector_size; b++) {
+                ctx->W[row * ctx->row_stride + b] = values[b];
+                ctx->W[(ctx->vocab_size + row) * ctx->row_stride + b] = values[ctx->vector_size + 1 + b];
+                if (gradsq_scale != 1.0) ctx->gradsq[(ctx->vocab_size + row) * ctx->row_stride + b] = gradsq_scale;
+            }
+        }
+        else for (b = 0; b < ctx->vector_size; b++) ctx->W[row * ctx->row_stride + b] = values[b];
+        if (gradsq_scale != 1.0) for (b = 0; b <= ctx->vector_size; b++) ctx->gradsq[row * ctx->row_stride + b] = gradsq_scale;
+    }
+    free(values);
+    free(table);
+    gloveModelFileClose(model);
+    return matched;
+}
+
+/* Initialize the rows of words that were also in an earlier model from it, matching words by string since their ranks
+ * shift between vocabulary builds; rows of new words keep their random initialization. The model is a checkpoint or a
+ * binary parameter file, and the squared gradients of carried-over rows are divided by warm_eta^2 so that AdaGrad
+ * steps on them are warm_eta times smaller. Returns the number of words carried over, or -1 on error */
+static long long warm_start(GLOVE_CONTEXT *ctx) {
+    long long a, b, row, old_size, matched = 0, file_size, table_size, *old_offsets, *table, *new_row;
+    char *old_words;
+    int has_gradsq = 0, valid;
+    real *buffer, gradsq_scale = 1.0 / (ctx->warm_eta * ctx->warm_eta);
+    CHECKPOINT_HEADER header;
+    FILE *fin;
+
+    if (is_model_file(ctx->warm_file)) return warm_start_model_file(ctx);
+    if (read_vocab(ctx->warm_vocab_file, &old_size, &old_words, &old_offsets) != 0) {
+        free(old_words);
+        free(old_offsets);
+        return -1;
+    }
+    fin = fopen(ctx->warm_file, "rb");
+    if (fin == NULL) {
+        fprintf(stderr, "Unable to open model file %s.\n",ctx->warm_file);
+        free(old_words);
+        free(old_offsets);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, fin) == 1 && memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0) {
+        has_gradsq = 1;
+        valid = (header.version == CHECKPOINT_VERSION && header.real_size == sizeof(real) && header.vocab_size == old_size
+                 && header.vector_size == ctx->vector_size);
     }
+    else { // Binary parameter file: the 2 * vocab_size rows of W, without a header
+        fseek(fin, 0, SEEK_END);
+        file_size = ftell(fin);
+        rewind(fin);
+        valid = (file_size == 2 * old_size * (ctx->vector_size + 1) * (long long)sizeof(real));
+    }
+    if (!valid) {
+        fprintf(stderr, "%s is not a checkpoint or binary parameter file of %lld words (%s) and vector size %d.\n",
+                ctx->warm_file, old_size, ctx->warm_vocab_file, ctx->vector_size);
+        fclose(fin);
+        free(old_words);
+        free(old_offsets);
+        return -1;
+    }
+
+    table = build_word_table(ctx->vocab_words, ctx->vocab_word_offsets, ctx->vocab_size, &table_size);
+    new_row = (long long*)malloc(old_size * sizeof(long long));
+    for (a = 0; a < old_size; a++) {
+        new_row[a] = find_word(table, table_size, ctx->vocab_words, ctx->vocab_word_offsets, old_words + old_offsets[a]);
+        if (new_row[a] >= 0) matched++;
+    }
+    buffer = (real*)malloc((ctx->vector_size + 1) * sizeof(real));
+    for (a = 0; a < (has_gradsq ? 4 : 2) * old_size; a++) { // Word rows, then context rows, of W and then of gradsq
+        if (fread(buffer, sizeof(real), ctx->vector_size + 1, fin) != (size_t)ctx->vector_size + 1) break;
+        if ((row = new_row[a % old_size]) < 0) continue;
+        if ((a / old_size) % 2 == 1) row += ctx->vocab_size;
+        if (a < 2 * old_size) memcpy(&ctx->W[row * ctx->row_stride], buffer, (ctx->vector_size + 1) * sizeof(real));
+        else for (b = 0; b <= ctx->vector_size; b++) ctx->gradsq[row * ctx->row_stride + b] = buffer[b] * gradsq_scale;
+    }
+    fclose(fin);
+    if (a < (has_gradsq ? 4 : 2) * old_size) {
+        fprintf(stderr, "Model file %s is truncated.\n", ctx->warm_file);
+        matched = -1;
+    }
+    else if (!has_gradsq && gradsq_scale != 1.0) {
+        for (a = 0; a < old_size; a++) {
+            if ((row = new_row[a]) < 0) continue;
+            for (b = 0; b <= ctx->vector_size; b++) {
+                ctx->gradsq[row * ctx->row_stride + b] = gradsq_scale;
+                ctx->gradsq[(ctx->vocab_size + row) * ctx->row_stride + b] = gradsq_scale;
+            }
+        }
+    }
+    free(buffer);
+    free(new_row);
+    free(table);
+    free(old_words);
+    free(old_offsets);
+    return matched;
+}
+
+/* Background writer for an asynchronous checkpoint of the snapshot */
+static void *
+#if defined(_WIN32)
+__stdcall
+#endif
+checkpoint_writer(void *vctx) {
+    GLOVE_CONTEXT *ctx = (GLOVE_CONTEXT*)vctx;
+    ctx->checkpoint_result = save_params(ctx, ctx->snapshot_W, ctx->snapshot_gradsq, ctx->snapshot_iter);
+    if (ctx->checkpoint_result == 0) ctx->checkpoint_result = save_checkpoint(ctx, ctx->snapshot_W, ctx->snapshot_gradsq, ctx->snapshot_iter);
+#if defined (_WIN32)
+    _endthreadex(0);
+#else
+    pthread_exit(NULL);
+#endif
+    return NULL;
+}
+
+/* Allocate a plain (not mapped) buffer for a copy of W and gradsq, laid out like them */
+static int alloc_param_copy(GLOVE_CONTEXT *ctx, real **copy_W, real **copy_gradsq) {
+    long long len = 2 * ctx->vocab_size * ctx->row_stride;
+    *copy_W = (real*)malloc((ctx->interleave ? len : 2 * len) * sizeof(real));
+    if (*copy_W == NULL) return 1;
+    *copy_gradsq = ctx->interleave ? *copy_W + (ctx->gradsq - ctx->W) : *copy_W + len;
+    return 0;
+}
+
+static void copy_params(GLOVE_CONTEXT *ctx, real *to_W, real *to_gradsq, const real *from_W, const real *from_gradsq) {
+    long long len = 2 * ctx->vocab_size * ctx->row_stride;
+    memcpy(to_W, from_W, len * sizeof(real));
+    if (!ctx->interleave) memcpy(to_gradsq, from_gradsq, len * sizeof(real));
+}
+
+/* Read the last held_out_lines records of the cooccurrence file, with their logs and weights, and remove them from
+ * the records trained on */
+static int load_held_out(GLOVE_CONTEXT *ctx) {
+    long long a;
+    FILE *fin = fopen(ctx->input_file, "rb");
+    if (fin == NULL) {fprintf(stderr,"Unable to open cooccurrence file %s.\n",ctx->input_file); return 1;}
+    ctx->num_lines -= ctx->held_out_lines;
+    ctx->held_out = (CREC*)malloc(ctx->held_out_lines * sizeof(CREC));
+    ctx->held_out_log = (real*)malloc(ctx->held_out_lines * sizeof(real));
+    ctx->held_out_weight = (real*)malloc(ctx->held_out_lines * sizeof(real));
+    fseek(fin, ctx->num_lines * (sizeof(CREC)), SEEK_SET);
+    if ((long long)fread(ctx->held_out, sizeof(CREC), ctx->held_out_lines, fin) != ctx->held_out_lines) {
+        fprintf(stderr,"Unable to read held-out records from %s.\n",ctx->input_file);
+        fclose(fin);
+        return 1;
+    }
+    fclose(fin);
+    for (a = 0; a < ctx->held_out_lines; a++) {
+        ctx->held_out_log[a] = log(ctx->held_out[a].val);
+        ctx->held_out_weight[a] = (ctx->held_out[a].val > ctx->x_max) ? 1.0 : pow(ctx->held_out[a].val / ctx->x_max, ctx->alpha);
+    }
+    return 0;
+}
+
+/* Records kept per iteration with sampling scale, from the histogram of record weights */
+static real expected_kept(const long long *count, const real *sum, real scale) {
+    int b;
+    real kept = 0;
+    for (b = 0; b < SAMPLE_BUCKETS; b++) kept += (scale * sum[b] < count[b]) ? scale * sum[b] : count[b];
+    return kept;
+}
+
+/* Choose sample_scale so that about sample_fraction of the training records are kept per iteration, from a histogram of
+ * their weights built in one pass over the cooccurrence file; leaves it 0 if the sample would be every record */
+static int calibrate_sampling(GLOVE_CONTEXT *ctx) {
+    long long a, n, bucket, remaining = ctx->num_lines, count[SAMPLE_BUCKETS] = {0};
+    real weight, octaves, low = 0, high = 1, target = ctx->sample_fraction * ctx->num_lines, sum[SAMPLE_BUCKETS] = {0};
+    int step;
+    CREC *chunk;
+    FILE *fin = fopen(ctx->input_file, "rb");
+    if (fin == NULL) {fprintf(stderr,"Unable to open cooccurrence file %s.\n",ctx->input_file); return 1;}
+    chunk = (CREC*)malloc(BLOCK_READ_LENGTH * sizeof(CREC));
+    while ((n = read_chunk(fin, chunk, &remaining)) > 0) {
+        for (a = 0; a < n; a++) {
+            if (chunk[a].word1 < 1 || chunk[a].word2 < 1) continue;
+            weight = (chunk[a].val > ctx->x_max) ? 1.0 : pow(chunk[a].val / ctx->x_max, ctx->alpha);
+            octaves = -log2(weight);
+            bucket = (octaves < SAMPLE_BUCKETS / SAMPLE_BUCKETS_PER_OCTAVE) ? (long long)(octaves * SAMPLE_BUCKETS_PER_OCTAVE) : SAMPLE_BUCKETS - 1;
+            count[bucket]++;
+            sum[bucket] += weight;
+        }
+    }
+    fclose(fin);
+    free(chunk);
+
+    ctx->sample_scale = 0;
+    if (expected_kept(count, sum, 1e300) <= target) return 0;
+    while (expected_kept(count, sum, high) < target) high *= 2;
+    for (step = 0; step < 100; step++) { // Kept records grow with the scale
+        if (expected_kept(count, sum, (low + high) / 2) < target) low = (low + high) / 2;
+        else high = (low + high) / 2;
+    }
+    ctx->sample_scale = high;
     return 0;
 }
 
+/* Mean weighted squared error of the current parameters on the held-out records, with the dot product kernel of the
+ * updates and the rows of each record prefetched PREFETCH_DISTANCE records ahead, as train_records does */
+static real held_out_loss(GLOVE_CONTEXT *ctx) {
+    long long a, b;
+    real diff, loss = 0;
+    const real *w1, *w2;
+    const CREC *cr;
+    for (a = 0; a < ctx->held_out_lines; a++) {
+        if (a + PREFETCH_DISTANCE < ctx->held_out_lines) {
+            cr = &ctx->held_out[a + PREFETCH_DISTANCE];
+            if (cr->word1 >= 1 && cr->word2 >= 1) {
+                w1 = ctx->W + (cr->word1 - 1LL) * ctx->row_stride;
+                w2 = ctx->W + (ctx->vocab_size + cr->word2 - 1LL) * ctx->row_stride;
+                for (b = 0; b <= ctx->vector_size; b += 64 / sizeof(real)) {
+                    PREFETCH(w1 + b);
+                    PREFETCH(w2 + b);
+                }
+            }
+        }
+        if (ctx->held_out[a].word1 < 1 || ctx->held_out[a].word2 < 1) continue;
+        w1 = ctx->W + (ctx->held_out[a].word1 - 1LL) * ctx->row_stride;
+        w2 = ctx->W + (ctx->vocab_size + ctx->held_out[a].word2 - 1LL) * ctx->row_stride;
+        diff = row_dot(w1, w2, ctx->vector_size);
+        diff += w1[ctx->vector_size] + w2[ctx->vector_size] - ctx->held_out_log[a];
+        loss += 0.5 * ctx->held_out_weight[a] * diff * diff;
+    }
+    return loss / ctx->held_out_lines;
+}
+
+/* Wait for the background checkpoint writer, if one is running, and return its result */
+static int finish_checkpoint(GLOVE_CONTEXT *ctx) {
+    if (!ctx->checkpoint_pending) return 0;
+#if defined (_WIN32)
+    WaitForSingleObject(ctx->checkpoint_thread, INFINITE);
+    CloseHandle(ctx->checkpoint_thread);
+#else
+    pthread_join(ctx->checkpoint_thread, NULL);
+#endif
+    ctx->checkpoint_pending = 0;
+    return ctx->checkpoint_result;
+}
+
+/* Checkpoint the parameters after nb_iter iterations. If async_checkpoint is set, they are copied to a snapshot that a
+ * background thread writes out while training continues; at most one such write is in flight */
+static int checkpoint(GLOVE_CONTEXT *ctx, int nb_iter) {
+    int result = finish_checkpoint(ctx);
+    if (result != 0) return result;
+    if (!ctx->async_checkpoint) {
+        result = save_params(ctx, ctx->W, ctx->gradsq, nb_iter);
+        return (result == 0) ? save_checkpoint(ctx, ctx->W, ctx->gradsq, nb_iter) : result;
+    }
+    if (ctx->snapshot_W == NULL && alloc_param_copy(ctx, &ctx->snapshot_W, &ctx->snapshot_gradsq) != 0) {
+        fprintf(stderr, "Error allocating memory for checkpoint snapshot\n");
+        return 1;
+    }
+    copy_params(ctx, ctx->snapshot_W, ctx->snapshot_gradsq, ctx->W, ctx->gradsq);
+    ctx->snapshot_iter = nb_iter;
+    ctx->checkpoint_pending = 1;
+#if defined (_WIN32)
+    ctx->checkpoint_thread = (HANDLE)_beginthreadex(NULL, 0, (unsigned (__stdcall *)(void *))checkpoint_writer, ctx, 0, NULL);
+#else
+    pthread_create(&ctx->checkpoint_thread, NULL, checkpoint_writer, ctx);
+#endif
+    return 0;
+}
+
+/* Fill in the per-thread and aggregate statistics of the current iteration and pass them to the telemetry callback */
+static void report_telemetry(GLOVE_CONTEXT *ctx, int iteration_done) {
+    long long a;
+    double elapsed = now_seconds() - ctx->iter_start;
+    GloveTelemetry report;
+    GloveThreadStats *total = &report.total;
+    memset(&report, 0, sizeof(report));
+    report.iter = ctx->telemetry_iter;
+    report.iterationDone = iteration_done;
+    report.elapsed = elapsed;
+    report.threads = ctx->num_threads;
+    report.thread = ctx->telemetry_threads;
+    for (a = 0; a < ctx->num_threads; a++) {
+        GloveThreadStats *t = &ctx->telemetry_threads[a];
+        t->records = ctx->counters[a].records;
+        t->cost = ctx->cost[a];
+        t->skipped = ctx->counters[a].skipped;
+        t->bytesRead = t->records * (long long)sizeof(CREC);
+        t->ioWait = ctx->counters[a].io_wait;
+        t->recordsPerSecond = (elapsed > 0) ? t->records / elapsed : 0;
+        total->records += t->records;
+        total->cost += t->cost;
+        total->skipped += t->skipped;
+        total->bytesRead += t->bytesRead;
+        total->ioWait += t->ioWait;
+    }
+    total->recordsPerSecond = (elapsed > 0) ? total->records / elapsed : 0;
+    ctx->telemetry(&report, ctx->telemetry_data);
+}
+
+/* Report every telemetry_interval seconds until monitor_stop is set; counters are read without synchronization, so
+ * reports within an iteration are approximate */
+static void *
+#if defined(_WIN32)
+__stdcall
+#endif
+monitor(void *vctx) {
+    GLOVE_CONTEXT *ctx = (GLOVE_CONTEXT*)vctx;
+    double next = ctx->iter_start + ctx->telemetry_interval, now;
+    while (!ctx->monitor_stop) {
+        now = now_seconds();
+        if (now >= next) {
+            report_telemetry(ctx, 0);
+            next += ctx->telemetry_interval;
+            if (next < now) next = now + ctx->telemetry_interval;
+        }
+#if defined(_WIN32)
+        Sleep(10);
+#else
+        usleep(10000);
+#endif
+    }
+#if defined (_WIN32)
+    _endthreadex(0);
+#else
+    pthread_exit(NULL);
+#endif
+    return NULL;
+}
+
+/* Reset the counters for a new iteration and, with telemetry on, start the monitor thread */
+static void start_iteration(GLOVE_CONTEXT *ctx, int iter) {
+    long long a;
+    memset(ctx->counters, 0, ctx->num_threads * sizeof(THREAD_COUNTERS));
+    for (a = 0; a < ctx->num_threads; a++) // Each iteration, process and thread draws a different sample
+        ctx->counters[a].rng = mix_seed(((unsigned long long)iter << 32) ^ ((unsigned long long)ctx->process_id << 16) ^ a) | 1;
+    ctx->iter_start = now_seconds();
+    ctx->telemetry_iter = iter;
+    if (ctx->telemetry == NULL || ctx->telemetry_interval <= 0 || ctx->process_id > 0) return;
+    ctx->monitor_stop = 0;
+#if defined (_WIN32)
+    ctx->monitor_thread = (HANDLE)_beginthreadex(NULL, 0, (unsigned (__stdcall *)(void *))monitor, ctx, 0, NULL);
+#else
+    pthread_create(&ctx->monitor_thread, NULL, monitor, ctx);
+#endif
+}
+
+/* Stop the monitor thread, if running, and send the report for the whole iteration */
+static void finish_iteration(GLOVE_CONTEXT *ctx) {
+    if (ctx->telemetry == NULL || ctx->process_id > 0) return;
+    if (ctx->telemetry_interval > 0) {
+        ctx->monitor_stop = 1;
+#if defined (_WIN32)
+        WaitForSingleObject(ctx->monitor_thread, INFINITE);
+        CloseHandle(ctx->monitor_thread);
+#else
+        pthread_join(ctx->monitor_thread, NULL);
+#endif
+    }
+    report_telemetry(ctx, 1);
+}
+
+/* Move the trained parameters and the vocabulary into a new model handle, with a hash of its words */
+static GloveModel *take_model(GLOVE_CONTEXT *ctx) {
+    GloveModel *m = (GloveModel*)calloc(1, sizeof(GloveModel));
+    m->vocab_size = ctx->vocab_size;
+    m->row_stride = ctx->row_stride;
+    m->vector_size = ctx->vector_size;
+    m->interleave = ctx->interleave;
+    m->W = ctx->W;
+    m->gradsq = ctx->gradsq;
+    m->W_mapped = ctx->W_mapped;
+    m->gradsq_mapped = ctx->gradsq_mapped;
+    m->words = ctx->vocab_words;
+    m->word_offsets = ctx->vocab_word_offsets;
+    ctx->W = ctx->gradsq = NULL;
+    ctx->vocab_words = NULL;
+    ctx->vocab_word_offsets = NULL;
+
+    m->table = build_word_table(m->words, m->word_offsets, m->vocab_size, &m->table_size);
+    return m;
+}
+
+/* Score the word + context vectors being trained on the analogy questions and print the accuracies */
+static void report_analogies(GLOVE_CONTEXT *ctx) {
+    GloveModel view; // The parameters as gloveTrain would return them, without taking them over
+    GloveVectors *vectors;
+    GloveAnalogyResult result;
+
+    memset(&view, 0, sizeof(GloveModel));
+    view.vocab_size = ctx->vocab_size;
+    view.row_stride = ctx->row_stride;
+    view.vector_size = ctx->vector_size;
+    view.interleave = ctx->interleave;
+    view.W = ctx->W;
+    view.words = ctx->vocab_words;
+    view.word_offsets = ctx->vocab_word_offsets;
+    if (gloveVectorsFromModel(&view, &vectors) == 0) {
+        if (gloveAnalogyEvaluate(vectors, ctx->analogy_dir, ctx->num_threads, &result) == 0 && result.fullCount > 0)
+            fprintf(stderr, "    analogy accuracy: semantic %.2f%%, syntactic %.2f%%, total %.2f%% (%lld of %lld questions seen)\n",
+                    100.0 * result.semanticCorrect / ((result.semanticCount > 0) ? result.semanticCount : 1),
+                    100.0 * result.syntacticCorrect / ((result.syntacticCount > 0) ? result.syntacticCount : 1),
+                    100.0 * result.totalCorrect / ((result.totalCount > 0) ? result.totalCount : 1), result.totalCount, result.fullCount);
+        gloveVectorsFree(vectors);
+    }
+    free(view.combined);
+}
+
 /* Train model */
-static int train_glove() {
+static int train_glove(GLOVE_CONTEXT *ctx) {
     long long a, file_size;
-    int save_params_return_code;
-    int b;
+    int save_params_return_code = 0;
+    int b, first_iter = 0, best_iter = 0, stale_iters = 0, stop = 0, span;
     FILE *fin;
-    real total_cost = 0;
+    real total_cost = 0, loss = 0, best_loss = 0;
 
     fprintf(stderr, "TRAINING MODEL\n");
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "setup");
     
-    fin = fopen(input_file, "rb");
-    if (fin == NULL) {fprintf(stderr,"Unable to open cooccurrence file %s.\n",input_file); return 1;}
+    fin = fopen(ctx->input_file, "rb");
+    if (fin == NULL) {fprintf(stderr,"Unable to open cooccurrence file %s.\n",ctx->input_file); return 1;}
     fseek(fin, 0, SEEK_END);
     file_size = ftell(fin);
-    num_lines = file_size/(sizeof(CREC)); // Assuming the file isn't corrupt and consists only of CREC's
+    ctx->num_lines = file_size/(sizeof(CREC)); // Assuming the file isn't corrupt and consists only of CREC's
     fclose(fin);
-    fprintf(stderr,"Read %lld lines.\n", num_lines);
-    if (verbose > 1) fprintf(stderr,"Initializing parameters...");
-    initialize_parameters();
-    if (verbose > 1) fprintf(stderr,"done.\n");
-    if (verbose > 0) fprintf(stderr,"vector size: %d\n", vector_size);
-    if (verbose > 0) fprintf(stderr,"vocab size: %lld\n", vocab_size);
-    if (verbose > 0) fprintf(stderr,"x_max: %lf\n", x_max);
-    if (verbose > 0) fprintf(stderr,"alpha: %lf\n", alpha);
-#if defined (_WIN32)
-	HANDLE *wt = (HANDLE*)malloc(num_threads * sizeof(HANDLE));
-#else
-	pthread_t *pt = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    fprintf(stderr,"Read %lld lines.\n", ctx->num_lines);
+    if (ctx->held_out_lines > ctx->num_lines / 2) ctx->held_out_lines = ctx->num_lines / 2;
+    if (ctx->held_out_lines > 0) {
+        if (load_held_out(ctx) != 0) return 1;
+        fprintf(stderr,"Holding out %lld lines.\n", ctx->held_out_lines);
+    }
+    if (ctx->sample_fraction > 0) {
+        if (calibrate_sampling(ctx) != 0) return 1;
+        if (ctx->sample_scale > 0) fprintf(stderr,"Sampling about %lld lines per iteration.\n", (long long)(ctx->sample_fraction * ctx->num_lines));
+    }
+    if (ctx->verbose > 1) fprintf(stderr,"Initializing parameters...");
+    initialize_parameters(ctx);
+    if (ctx->verbose > 1) fprintf(stderr,"done.\n");
+    if (ctx->resume_file != NULL) {
+        if ((first_iter = load_checkpoint(ctx, ctx->resume_file)) < 0) return 1;
+        fprintf(stderr,"Resuming from %s after iter %03d.\n", ctx->resume_file, first_iter);
+    }
+    else if (ctx->warm_file != NULL) {
+        if ((a = warm_start(ctx)) < 0) return 1;
+        fprintf(stderr,"Warm start from %s: %lld words carried over, %lld new.\n", ctx->warm_file, a, ctx->vocab_size - a);
+    }
+    if (ctx->verbose > 0) fprintf(stderr,"vector size: %d\n", ctx->vector_size);
+    if (ctx->verbose > 0) fprintf(stderr,"vocab size: %lld\n", ctx->vocab_size);
+    if (ctx->verbose > 0) fprintf(stderr,"x_max: %lf\n", ctx->x_max);
+    if (ctx->verbose > 0) fprintf(stderr,"alpha: %lf\n", ctx->alpha);
+    if (ctx->hot_rows > ctx->vocab_size) ctx->hot_rows = ctx->vocab_size;
+    ctx->lines_per_thread = (long long *) malloc(ctx->num_threads * sizeof(long long));
+    ctx->counters = (THREAD_COUNTERS *) calloc(ctx->num_threads, sizeof(THREAD_COUNTERS));
+    if (ctx->telemetry != NULL) ctx->telemetry_threads = (GloveThreadStats *) calloc(ctx->num_threads, sizeof(GloveThreadStats));
+#if defined(_WIN32)
+    if (ctx->num_processes > 1) { fprintf(stderr, "Multi-process training is not supported on Windows; using one process.\n"); ctx->num_processes = 1; }
+#endif
+    if (ctx->num_processes > 1 && ctx->schedule == 1) { fprintf(stderr, "Multi-process training uses the Hogwild schedule.\n"); ctx->schedule = 0; }
+    if (ctx->schedule == 1) {
+        sprintf(ctx->block_file, "%s.bin", ctx->file_head);
+        if (bucket_by_blocks(ctx) != 0) return 1;
+        gloveProfileAddTempFile(ctx->profile, span, ctx->block_file);
+    }
+#if !defined(_WIN32)
+    if (ctx->num_processes > 1) {
+        if (ctx->verbose > 0) fprintf(stderr,"worker processes: %d\n", ctx->num_processes);
+        if (start_workers(ctx) != 0) return 1;
+    }
 #endif
-    lines_per_thread = (long long *) malloc(num_threads * sizeof(long long));
     
     time_t rawtime;
-    struct tm *info;
+    struct tm info;
     char time_buffer[80];
-    // Lock-free asynchronous SGD
-    for (b = 0; b < num_iter; b++) {
+    gloveProfileEnd(ctx->profile, span);
+    for (b = first_iter; b < ctx->num_iter; b++) {
+        span = gloveProfileBegin(ctx->profile, ctx->profile_span, "iter");
         total_cost = 0;
-        for (a = 0; a < num_threads - 1; a++) lines_per_thread[a] = num_lines / num_threads;
-        lines_per_thread[a] = num_lines / num_threads + num_lines % num_threads;
-        long long *thread_ids = (long long*)malloc(sizeof(long long) * num_threads);
-        for (a = 0; a < num_threads; a++) thread_ids[a] = a;
-#if defined (_WIN32)
-		for (a = 0; a < num_threads; a++) wt[a] = (HANDLE)_beginthreadex(NULL, 0, &glove_thread, (void*)&thread_ids[a], 0, NULL);
-		for (a = 0; a < num_threads; a++) WaitForSingleObject(wt[a], INFINITE);
-#else
-		for (a = 0; a < num_threads; a++) pthread_create(&pt[a], NULL, glove_thread, (void *)&thread_ids[a]);
-		for (a = 0; a < num_threads; a++) pthread_join(pt[a], NULL);
-#endif
-        for (a = 0; a < num_threads; a++) total_cost += cost[a];
-        free(thread_ids);
+        for (a = 0; a < ctx->num_threads; a++) ctx->cost[a] = 0;
+        start_iteration(ctx, b + 1);
+        if (ctx->schedule == 1) {
+            // Stratified SGD: num_threads rounds, each running num_threads blocks that share no rows
+            for (ctx->block_round = 0; ctx->block_round < ctx->num_threads; ctx->block_round++) run_threads(ctx, glove_block_thread, ctx->num_threads);
+            for (a = 0; a < ctx->num_threads; a++) total_cost += ctx->cost[a];
+        }
+        else {
+            // Lock-free asynchronous SGD
+            total_cost = train_hogwild(ctx);
+        }
+        finish_iteration(ctx);
+        for (a = 0; a < ctx->num_threads; a++) {
+            gloveProfileAddRecords(ctx->profile, span, ctx->counters[a].records);
+            gloveProfileAddRecords(ctx->profile, ctx->profile_span, ctx->counters[a].records);
+        }
+        gloveProfileEnd(ctx->profile, span);
+        if (ctx->held_out_lines > 0) {
+            /* Every process holds the same averaged parameters here, so all of them reach the same decision */
+            loss = held_out_loss(ctx);
+            if (best_iter == 0 || loss < best_loss) {
+                stale_iters = (best_iter == 0 || loss < best_loss * (1 - ctx->stop_tolerance)) ? 0 : stale_iters + 1;
+                best_loss = loss;
+                best_iter = b + 1;
+                if (ctx->keep_best && ctx->process_id == 0) {
+                    if (ctx->best_W == NULL && alloc_param_copy(ctx, &ctx->best_W, &ctx->best_gradsq) != 0) {
+                        fprintf(stderr, "Error allocating memory for best parameters\n");
+                        save_params_return_code = 1;
+                        break;
+                    }
+                    copy_params(ctx, ctx->best_W, ctx->best_gradsq, ctx->W, ctx->gradsq);
+                }
+            }
+            else stale_iters++;
+            stop = (ctx->stop_patience > 0 && stale_iters >= ctx->stop_patience);
+        }
+        if (ctx->process_id > 0) { // Only the calling process reports and checkpoints
+            if (stop) break;
+            continue;
+        }
 
         time(&rawtime);
-        info = localtime(&rawtime);
-        strftime(time_buffer,80,"%x - %I:%M.%S%p", info);
-        fprintf(stderr, "%s, iter: %03d, cost: %lf\n", time_buffer,  b+1, total_cost/num_lines);
+#if defined(_WIN32)
+        localtime_s(&info, &rawtime);
+#else
+        localtime_r(&rawtime, &info); // localtime() shares one buffer between concurrent calls
+#endif
+        strftime(time_buffer,80,"%x - %I:%M.%S%p", &info);
+        if (ctx->held_out_lines > 0) fprintf(stderr, "%s, iter: %03d, cost: %lf, held-out: %lf\n", time_buffer,  b+1, total_cost/ctx->num_lines, loss);
+        else fprintf(stderr, "%s, iter: %03d, cost: %lf\n", time_buffer,  b+1, total_cost/ctx->num_lines);
 
-        if (checkpoint_every > 0 && (b + 1) % checkpoint_every == 0) {
+        if (ctx->checkpoint_every > 0 && (b + 1) % ctx->checkpoint_every == 0) {
             fprintf(stderr,"    saving itermediate parameters for iter %03d...", b+1);
-            save_params_return_code = save_params(b+1);
-            if (save_params_return_code != 0)
-                return save_params_return_code;
-            fprintf(stderr,"done.\n");
+            save_params_return_code = checkpoint(ctx, b+1);
+            if (save_params_return_code != 0) break;
+            fprintf(stderr, ctx->async_checkpoint ? "writing in background.\n" : "done.\n");
+        }
+        if (ctx->analogy_dir != NULL && (b + 1) % ctx->analogy_every == 0) report_analogies(ctx);
+        if (stop) {
+            fprintf(stderr, "Held-out loss has not improved by %g for %d iterations; stopping after iter %03d.\n", ctx->stop_tolerance, stale_iters, b+1);
+            break;
         }
-
     }
-#if defined (_WIN32)
-	free(wt);
-#else
-    free(pt);
+    free(ctx->lines_per_thread);
+    free(ctx->counters);
+    free(ctx->telemetry_threads);
+    ctx->telemetry_threads = NULL;
+#if !defined(_WIN32)
+    if (ctx->process_id > 0) _exit(0);
+    if (ctx->num_processes > 1 && stop_workers(ctx, save_params_return_code != 0) != 0) save_params_return_code = 1;
 #endif
-    free(lines_per_thread);
-    return save_params(0);
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "save");
+    if (ctx->schedule == 1) {
+        remove(ctx->block_file);
+        free(ctx->block_offsets);
+    }
+    if (finish_checkpoint(ctx) != 0) save_params_return_code = 1;
+    free(ctx->snapshot_W);
+    ctx->snapshot_W = ctx->snapshot_gradsq = NULL;
+    if (ctx->best_W != NULL) {
+        if (save_params_return_code == 0) {
+            if (ctx->verbose > 0) fprintf(stderr, "Saving parameters of iter %03d, held-out loss %lf.\n", best_iter, best_loss);
+            copy_params(ctx, ctx->W, ctx->gradsq, ctx->best_W, ctx->best_gradsq);
+        }
+        free(ctx->best_W);
+        ctx->best_W = ctx->best_gradsq = NULL;
+    }
+    if (ctx->held_out_lines > 0) {
+        free(ctx->held_out);
+        free(ctx->held_out_log);
+        free(ctx->held_out_weight);
+    }
+    if (save_params_return_code == 0 && ctx->save_W_file != NULL) save_params_return_code = save_params(ctx, ctx->W, ctx->gradsq, 0);
+    if (save_params_return_code == 0 && ctx->trained_model != NULL) *ctx->trained_model = take_model(ctx);
+    else free_parameters(ctx);
+    gloveProfileEnd(ctx->profile, span);
+    return save_params_return_code;
 }
 
 static const GloveArgs DEFAULT_GLOVE_ARGS = {
         .verbose = 0, .vectorSize = 50, .threads = 8, .iter = 25, .eta = 0.05f, .alpha = 0.75f, .xMax = 100.f,
-        .binary = 0, .model = 2, .saveGradsq = 0, .checkpointEvery = 0, .mode = 0
+        .binary = 0, .model = 2, .saveGradsq = 0, .checkpointEvery = 0, .mode = 0,
+        .interleave = 0, .numaPolicy = 0, .pinThreads = 0, .hugePages = 0, .batchSize = 0, .schedule = 0,
+        .hotRows = 0, .syncEvery = 100000, .processes = 1, .processSyncs = 1, .tempFile = "temp_glove",
+        .resumeFrom = NULL, .asyncCheckpoint = 0, .exportThreads = 0,
+        .precision = 6, .modelFile = 0, .heldOut = 0, .stopTolerance = 0.001f, .stopPatience = 2,
+        .keepBest = 0, .telemetry = NULL, .telemetryData = NULL, .telemetryInterval = 1.f, .warmStartFrom = NULL,
+        .warmStartVocab = NULL, .warmStartEta = 1.f, .sampleFraction = 0, .pqSubspaces = 0, .analogyDir = NULL,
+        .analogyEvery = 1, .profile = NULL
 };
 
 int createGloveArgs(GloveArgs* emptyArgs) {
@@ -394,47 +1960,281 @@ int createGloveArgs(GloveArgs* emptyArgs) {
     return 0;
 }
 
-int glove(const GloveArgs* args, const char* shufCooccurIn, const char* vocabIn, char* gloveOut, char* gradsqOut) {
-    FILE *fid;
-    vocab_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
-    input_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
-    save_W_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
-    save_gradsq_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
+/* glove and gloveTrain, with the vocabulary read from vocabIn or taken over from vocab */
+static int run_glove(const GloveArgs* args, const char* shufCooccurIn, const char* vocabIn, GLOVE_VOCAB* vocab,
+                     char* gloveOut, char* gradsqOut, GloveModel** handle) {
+    GLOVE_CONTEXT *ctx = (GLOVE_CONTEXT*)calloc(1, sizeof(GLOVE_CONTEXT));
+    ctx->vocab_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
+    ctx->input_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
+    ctx->save_W_file = (gloveOut != NULL) ? malloc(sizeof(char) * MAX_STRING_LENGTH) : NULL;
+    ctx->save_gradsq_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
+    ctx->file_head = malloc(sizeof(char) * MAX_STRING_LENGTH);
+    ctx->block_file = malloc(sizeof(char) * MAX_STRING_LENGTH);
     int result = 0;
 
-    verbose = args->verbose;
-    vector_size = args->vectorSize;
-    num_iter = args->iter;
-    num_threads = args->threads;
-    alpha = args->alpha;
-    x_max = args->xMax;
-    eta = args->eta;
-    use_binary = args->binary;
-    model = args->model;
-    save_gradsq = args->saveGradsq;
-    checkpoint_every = args->checkpointEvery;
-
-    strcpy(input_file, shufCooccurIn);
-    strcpy(vocab_file, vocabIn);
-    strcpy(save_W_file, gloveOut);
-    strcpy(save_gradsq_file, gradsqOut);
-
-    cost = malloc(sizeof(real) * num_threads);
-    if (model != 0 && model != 1 && model != 2) model = DEFAULT_GLOVE_ARGS.model;
-
-    vocab_size = 0;
-    fid = fopen(vocab_file, "r");
-    if (fid == NULL) { fprintf(stderr, "Unable to open vocab file %s.\n",vocab_file); return 1; }
-    int i;
-    while ((i = getc(fid)) != EOF) if (i == '\n') vocab_size++; // Count number of entries in vocab_file
-    fclose(fid);
+    ctx->verbose = args->verbose;
+    ctx->vector_size = args->vectorSize;
+    ctx->num_iter = args->iter;
+    ctx->num_threads = args->threads;
+    ctx->alpha = args->alpha;
+    ctx->x_max = args->xMax;
+    ctx->eta = args->eta;
+    ctx->use_binary = args->binary;
+    ctx->model = args->model;
+    ctx->save_gradsq = args->saveGradsq;
+    ctx->checkpoint_every = args->checkpointEvery;
+    ctx->interleave = args->interleave;
+    ctx->numa_policy = args->numaPolicy;
+    ctx->pin_threads = args->pinThreads;
+    ctx->huge_pages = args->hugePages;
+    ctx->batch_size = args->batchSize;
+    ctx->schedule = args->schedule;
+    ctx->hot_rows = args->hotRows;
+    ctx->num_processes = (args->processes > 1) ? args->processes : 1;
+    ctx->process_syncs = (args->processSyncs > 1) ? args->processSyncs : 1;
+    ctx->process_id = 0;
+    ctx->use_unk_vec = 1;
+    ctx->sync_every = (args->syncEvery > 0) ? args->syncEvery : DEFAULT_GLOVE_ARGS.syncEvery;
 
-    result = train_glove();
-    free(cost);
+    strcpy(ctx->input_file, shufCooccurIn);
+    strcpy(ctx->vocab_file, (vocabIn != NULL) ? vocabIn : "");
+    if (gloveOut != NULL) strcpy(ctx->save_W_file, gloveOut);
+    else if (ctx->checkpoint_every > 0) {
+        fprintf(stderr, "No output file given; not checkpointing.\n");
+        ctx->checkpoint_every = 0;
+    }
+    if (gradsqOut != NULL) strcpy(ctx->save_gradsq_file, gradsqOut);
+    else ctx->save_gradsq = 0;
+    ctx->trained_model = handle;
+    glove_temp_name(ctx->file_head, MAX_STRING_LENGTH - 4, args->tempFile); // Room for the .bin of the block file
+    ctx->resume_file = args->resumeFrom;
+    ctx->warm_file = args->warmStartFrom;
+    ctx->warm_vocab_file = args->warmStartVocab;
+    ctx->warm_eta = (args->warmStartEta > 0) ? args->warmStartEta : 1;
+    if (ctx->warm_file != NULL && ctx->warm_vocab_file == NULL && !is_model_file(ctx->warm_file)) {
+        fprintf(stderr, "warmStartFrom needs warmStartVocab; starting from random initialization.\n");
+        ctx->warm_file = NULL;
+    }
+    ctx->async_checkpoint = args->asyncCheckpoint;
+    ctx->export_threads = args->exportThreads;
+    ctx->precision = (args->precision < 0) ? 0 : (args->precision > 15) ? 15 : args->precision;
+    ctx->model_file = (args->modelFile >= 0 && args->modelFile <= 4) ? args->modelFile : 0;
+    ctx->pq_subspaces = args->pqSubspaces;
+    ctx->analogy_dir = args->analogyDir;
+    ctx->analogy_every = (args->analogyEvery > 0) ? args->analogyEvery : 1;
+    ctx->held_out_lines = (args->heldOut > 0) ? args->heldOut : 0;
+    ctx->stop_tolerance = args->stopTolerance;
+    ctx->stop_patience = args->stopPatience;
+    ctx->keep_best = args->keepBest;
+    ctx->sample_fraction = (args->sampleFraction > 0 && args->sampleFraction < 1) ? args->sampleFraction : 0;
+    ctx->telemetry = args->telemetry;
+    ctx->telemetry_data = args->telemetryData;
+    ctx->telemetry_interval = args->telemetryInterval;
+    ctx->profile = args->profile;
+
+    ctx->cost = malloc(sizeof(real) * ctx->num_threads);
+    if (ctx->model != 0 && ctx->model != 1 && ctx->model != 2) ctx->model = DEFAULT_GLOVE_ARGS.model;
+
+#if defined(_WIN32)
+    InitializeSRWLock(&ctx->hot_rows_lock);
+#else
+    pthread_mutex_init(&ctx->hot_rows_lock, NULL);
+#endif
+#if defined(__linux__)
+    if (sched_getaffinity(0, sizeof(ctx->allowed_cpus), &ctx->allowed_cpus) == 0) ctx->num_allowed_cpus = CPU_COUNT(&ctx->allowed_cpus);
+#endif
 
-    free(vocab_file);
-    free(input_file);
-    free(save_W_file);
-    free(save_gradsq_file);
+    ctx->profile_span = gloveProfileBegin(ctx->profile, -1, "glove");
+    if (vocab != NULL) {
+        ctx->vocab_size = vocab->size;
+        ctx->vocab_words = vocab->words;
+        ctx->vocab_word_offsets = vocab->offsets;
+        vocab->words = NULL;
+        vocab->offsets = NULL;
+    }
+    else result = read_vocab(ctx->vocab_file, &ctx->vocab_size, &ctx->vocab_words, &ctx->vocab_word_offsets);
+
+    if (result == 0) result = train_glove(ctx);
+    /* train_glove joins the checkpoint writer before saving, but on any path out of it the writer must be done with ctx
+     * and the snapshot before they are freed */
+    if (finish_checkpoint(ctx) != 0 && result == 0) result = 1;
+    free(ctx->snapshot_W);
+    free(ctx->best_W);
+    gloveProfileEnd(ctx->profile, ctx->profile_span);
+    free(ctx->cost);
+    free(ctx->vocab_words);
+    free(ctx->vocab_word_offsets);
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&ctx->hot_rows_lock);
+#endif
+
+    free(ctx->vocab_file);
+    free(ctx->input_file);
+    free(ctx->save_W_file);
+    free(ctx->save_gradsq_file);
+    free(ctx->file_head);
+    free(ctx->block_file);
+    free(ctx);
     return result;
 }
+
+int glove(const GloveArgs* args, const char* shufCooccurIn, const char* vocabIn, char* gloveOut, char* gradsqOut) {
+    return run_glove(args, shufCooccurIn, vocabIn, NULL, gloveOut, gradsqOut, NULL);
+}
+
+int gloveTrain(const GloveArgs* args, const char* shufCooccurIn, const char* vocabIn, char* gloveOut, char* gradsqOut,
+               GloveModel** model) {
+    *model = NULL;
+    return run_glove(args, shufCooccurIn, vocabIn, NULL, gloveOut, gradsqOut, model);
+}
+
+int glove_train_vocab(const GloveArgs* args, const char* shufCooccurIn, GLOVE_VOCAB* vocab, char* gloveOut,
+                      char* gradsqOut, GloveModel** model) {
+    if (model != NULL) *model = NULL;
+    return run_glove(args, shufCooccurIn, NULL, vocab, gloveOut, gradsqOut, model);
+}
+
+long long gloveModelVocabSize(const GloveModel* model) {
+    return model->vocab_size;
+}
+
+int gloveModelVectorSize(const GloveModel* model) {
+    return model->vector_size;
+}
+
+const char* gloveModelWord(const GloveModel* model, long long row) {
+    if (row < 0 || row >= model->vocab_size) return NULL;
+    return model->words + model->word_offsets[row];
+}
+
+long long gloveModelFind(const GloveModel* model, const char* word) {
+    return find_word(model->table, model->table_size, model->words, model->word_offsets, word);
+}
+
+const double* gloveModelWordRow(const GloveModel* model, long long row) {
+    if (row < 0 || row >= model->vocab_size) return NULL;
+    return model->W + row * model->row_stride;
+}
+
+const double* gloveModelContextRow(const GloveModel* model, long long row) {
+    if (row < 0 || row >= model->vocab_size) return NULL;
+    return model->W + (model->vocab_size + row) * model->row_stride;
+}
+
+const double* gloveModelCombined(GloveModel* model) {
+    long long a, b;
+    const real *word_row, *context_row;
+    if (model->combined != NULL) return model->combined;
+    model->combined = (real*)malloc(model->vocab_size * model->vector_size * sizeof(real));
+    if (model->combined == NULL) return NULL;
+    for (a = 0; a < model->vocab_size; a++) {
+        word_row = model->W + a * model->row_stride;
+        context_row = model->W + (model->vocab_size + a) * model->row_stride;
+        for (b = 0; b < model->vector_size; b++) model->combined[a * model->vector_size + b] = word_row[b] + context_row[b];
+    }
+    return model->combined;
+}
+
+int gloveModelSave(const GloveModel* handle, const GloveArgs* args, char* gloveOut, char* gradsqOut) {
+    int result;
+    GLOVE_CONTEXT *ctx;
+
+    if (handle == NULL || args == NULL || gloveOut == NULL) {
+        fprintf(stderr, "gloveModelSave needs a model, args and an output file.\n");
+        return 1;
+    }
+    ctx = (GLOVE_CONTEXT*)calloc(1, sizeof(GLOVE_CONTEXT));
+    if (ctx == NULL) {fprintf(stderr, "Out of memory saving a model.\n"); return 1;}
+    ctx->use_unk_vec = 1;
+    ctx->vocab_size = handle->vocab_size;
+    ctx->vector_size = handle->vector_size;
+    ctx->row_stride = handle->row_stride;
+    ctx->interleave = handle->interleave;
+    ctx->vocab_words = handle->words;
+    ctx->vocab_word_offsets = handle->word_offsets;
+    ctx->use_binary = args->binary;
+    ctx->save_gradsq = (gradsqOut != NULL) ? args->saveGradsq : 0;
+    ctx->model = args->model;
+    if (ctx->model != 0 && ctx->model != 1 && ctx->model != 2) ctx->model = DEFAULT_GLOVE_ARGS.model;
+    ctx->verbose = args->verbose;
+    ctx->export_threads = args->exportThreads;
+    ctx->precision = (args->precision < 0) ? 0 : (args->precision > 15) ? 15 : args->precision;
+    ctx->model_file = (args->modelFile >= 0 && args->modelFile <= 4) ? args->modelFile : 0;
+    ctx->pq_subspaces = args->pqSubspaces;
+    ctx->save_W_file = gloveOut;
+    ctx->save_gradsq_file = gradsqOut;
+    result = save_params(ctx, handle->W, handle->gradsq, 0);
+    free(ctx);
+    return result;
+}
+
+void gloveModelFree(GloveModel* model) {
+    if (model == NULL) return;
+    free_params(model->W, model->W_mapped);
+    if (!model->interleave) free_params(model->gradsq, model->gradsq_mapped);
+    free(model->combined);
+    free(model->words);
+    free(model->word_offsets);
+    free(model->table);
+    free(model);
+}
+
+int gloveBenchmarkUpdates(const GloveArgs* args, long long vocabSize, long long updates, double* seconds) {
+    GLOVE_CONTEXT *ctx;
+    CREC *pairs, cr;
+    real *log_val, *weight, *w1, *w2, *g1, *g2, *W_updates1, *W_updates2;
+    unsigned long long state = mix_seed(1);
+    long long a, c, n = (updates < BENCHMARK_PAIRS) ? updates : BENCHMARK_PAIRS;
+    double start;
+
+    if (vocabSize < 1 || vocabSize > INT_MAX || updates < 1 || args->vectorSize < 1) {
+        fprintf(stderr, "gloveBenchmarkUpdates needs a vocabulary, updates and a vector size of at least 1.\n");
+        return 1;
+    }
+    ctx = (GLOVE_CONTEXT*)calloc(1, sizeof(GLOVE_CONTEXT));
+    ctx->vector_size = args->vectorSize;
+    ctx->vocab_size = vocabSize;
+    ctx->interleave = args->interleave;
+    ctx->huge_pages = args->hugePages;
+    ctx->eta = args->eta;
+    ctx->num_threads = 1;
+    ctx->cost = (real*)calloc(1, sizeof(real));
+    ctx->counters = (THREAD_COUNTERS*)calloc(1, sizeof(THREAD_COUNTERS));
+    initialize_parameters(ctx);
+    pairs = (CREC*)malloc(n * sizeof(CREC));
+    log_val = (real*)malloc(n * sizeof(real));
+    weight = (real*)malloc(n * sizeof(real));
+    W_updates1 = (real*)malloc(ctx->vector_size * sizeof(real));
+    W_updates2 = (real*)malloc(ctx->vector_size * sizeof(real));
+    for (c = 0; c < n; c++) { // Counts spread over the whole range of the weighting function
+        pairs[c].word1 = 1 + (int)(next_uniform(&state) * vocabSize);
+        pairs[c].word2 = 1 + (int)(next_uniform(&state) * vocabSize);
+        pairs[c].val = exp(next_uniform(&state) * log(2 * args->xMax));
+        log_val[c] = log(pairs[c].val);
+        weight[c] = (pairs[c].val > args->xMax) ? 1.0 : pow(pairs[c].val / args->xMax, args->alpha);
+    }
+
+    start = now_seconds();
+    for (a = 0; a < updates; a++) { // The update loop of train_records with batchSize > 0
+        cr = pairs[(a + PREFETCH_DISTANCE) % n];
+        locate_rows(ctx, NULL, cr.word1 - 1LL, 0, &w1, &g1);
+        locate_rows(ctx, NULL, cr.word2 - 1LL, 1, &w2, &g2);
+        prefetch_rows(ctx, w1, w2, g1, g2);
+        c = a % n;
+        locate_rows(ctx, NULL, pairs[c].word1 - 1LL, 0, &w1, &g1);
+        locate_rows(ctx, NULL, pairs[c].word2 - 1LL, 1, &w2, &g2);
+        update_pair(ctx, 0, w1, w2, g1, g2, log_val[c], weight[c], W_updates1, W_updates2);
+    }
+    *seconds = now_seconds() - start;
+
+    free(pairs);
+    free(log_val);
+    free(weight);
+    free(W_updates1);
+    free(W_updates2);
+    free_parameters(ctx);
+    free(ctx->cost);
+    free(ctx->counters);
+    free(ctx);
+    return 0;
+}
@@ -0,0 +1,700 @@
+//  Approximate nearest neighbor index (hierarchical navigable small world graph) over trained word vectors
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  Every row is a node of layer 0; a node drawn at level L also belongs to layers 1 .. L, each sparser than the one
+//  below. A search descends greedily from the entry point through the upper layers and then runs a best-first search
+//  of width ef on layer 0 (Malkov and Yashunin, 2016). Similarity is the dot product of unit length rows.
+//
+//  The graph is built directly in the layout of the file, so writing it is a copy and opening it a mapping.
+//  File layout (native byte order, recorded in the header):
+//    header                   INDEX_FILE_HEADER
+//    rows                     count * stride floats, unit length, zero padded, starting 64-byte aligned
+//    levels                   count bytes, the top layer of each node
+//    upper index              count uint64, start of each node's links of layers 1 .. level within the upper links
+//    layer 0 links            count lists of 1 + m0 uint32: the number of links, then the linked nodes
+//    upper links              lists of 1 + m uint32, level of them per node, in node order
+//  Each section after the header starts 64-byte aligned.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/glove.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define INDEX_FILE_VERSION 1
+#define INDEX_FILE_ALIGNMENT 64
+#define BYTE_ORDER_MARK 0x01020304u
+#define MAX_LEVEL 32 // Cap on drawn levels; reaching it takes m^32 nodes
+#define NODE_LOCKS 65536 // Link lists are guarded by one of these, chosen by node, while the graph is built
+#define VISITED_INITIAL_CAPACITY 4096
+
+#if defined(_WIN32)
+#define LOCK(lock) AcquireSRWLockExclusive(lock)
+#define UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+typedef SRWLOCK LOCK_T;
+#else
+#define LOCK(lock) pthread_mutex_lock(lock)
+#define UNLOCK(lock) pthread_mutex_unlock(lock)
+typedef pthread_mutex_t LOCK_T;
+#endif
+
+static const char INDEX_FILE_MAGIC[8] = "GLOVEHNS";
+
+typedef struct index_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t count, size, stride;
+    uint32_t m, m0; // Most links per node on the upper layers and on layer 0
+    uint32_t max_level, reserved;
+    uint64_t entry_point;
+    uint64_t rows_offset, levels_offset, upper_index_offset, links0_offset, upper_offset;
+    uint64_t upper_length; // uint32 values of upper links
+    uint64_t file_size;
+} INDEX_FILE_HEADER;
+
+/* The graph, mapped from a file or being built */
+typedef struct graph {
+    INDEX_FILE_HEADER h;
+    float *rows;
+    unsigned char *levels;
+    uint64_t *upper_index;
+    uint32_t *links0, *upper;
+    LOCK_T *locks; // NODE_LOCKS locks while building, NULL once the graph is read only
+} GRAPH;
+
+struct _GloveIndex {
+    GRAPH g;
+    const char *base;
+    uint64_t length;
+#if defined(_WIN32)
+    HANDLE file, mapping;
+#endif
+};
+
+typedef struct candidate {
+    float sim;
+    uint32_t node;
+} CANDIDATE;
+
+/* Working memory of one thread's searches */
+typedef struct scratch {
+    CANDIDATE *frontier; // Max-heap of nodes still to expand
+    CANDIDATE *results; // Min-heap of the best ef nodes found
+    int frontier_size, frontier_capacity, results_size;
+    uint32_t *visited; // Open addressing set of node + 1, 0 for empty slots
+    uint64_t visited_capacity, visited_count;
+    uint32_t *links; // Copy of the link list being expanded
+    CANDIDATE *selected;
+} SCRATCH;
+
+/* State of one gloveIndexBuild or gloveIndexSearch call */
+typedef struct index_context {
+    GRAPH *g;
+    int verbose, threads, ef, k, count;
+    LOCK_T global_lock; // Guards the entry point and max level while building
+    const float *queries; // Normalized and padded queries of a search
+    long long *rows;
+    float *scores;
+} INDEX_CONTEXT;
+
+typedef struct thread_arg {
+    INDEX_CONTEXT *ctx;
+    long long id;
+} THREAD_ARG;
+
+#if defined(_WIN32)
+typedef void *(__stdcall *thread_fn)(void *);
+#else
+typedef void *(*thread_fn)(void *);
+#endif
+
+/* Run fn on count threads, passing each a THREAD_ARG with ctx and its id (0 .. count - 1), and wait for all of them */
+static void run_threads(INDEX_CONTEXT *ctx, thread_fn fn, int count) {
+    long long a;
+    THREAD_ARG *thread_ids = (THREAD_ARG*)malloc(sizeof(THREAD_ARG) * count);
+    for (a = 0; a < count; a++) {
+        thread_ids[a].ctx = ctx;
+        thread_ids[a].id = a;
+    }
+#if defined (_WIN32)
+    HANDLE *wt = (HANDLE*)malloc(count * sizeof(HANDLE));
+    for (a = 0; a < count; a++) wt[a] = (HANDLE)_beginthreadex(NULL, 0, (unsigned (__stdcall *)(void *))fn, (void*)&thread_ids[a], 0, NULL);
+    for (a = 0; a < count; a++) WaitForSingleObject(wt[a], INFINITE);
+    free(wt);
+#else
+    pthread_t *pt = (pthread_t *)malloc(count * sizeof(pthread_t));
+    for (a = 0; a < count; a++) pthread_create(&pt[a], NULL, fn, (void *)&thread_ids[a]);
+    for (a = 0; a < count; a++) pthread_join(pt[a], NULL);
+    free(pt);
+#endif
+    free(thread_ids);
+}
+
+/* Processors available to this process, for threads <= 0 */
+static int processor_count() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+#endif
+}
+
+static uint64_t align_up(uint64_t n) {
+    return (n + INDEX_FILE_ALIGNMENT - 1) / INDEX_FILE_ALIGNMENT * INDEX_FILE_ALIGNMENT;
+}
+
+/* splitmix64, a well mixed function of x */
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* Dot product over whole padded rows, so the loop vectorizes without a remainder */
+static float dot(const float *a, const float *b, uint64_t stride) {
+    uint64_t j;
+    float s = 0;
+    for (j = 0; j < stride; j++) s += a[j] * b[j];
+    return s;
+}
+
+static const float *row_of(const GRAPH *g, uint32_t node) {
+    return g->rows + node * g->h.stride;
+}
+
+/* Link list of node on layer: its length, then the linked nodes */
+static uint32_t *links_of(const GRAPH *g, uint32_t node, int layer) {
+    if (layer == 0) return g->links0 + (uint64_t)node * (1 + g->h.m0);
+    return g->upper + g->upper_index[node] + (uint64_t)(layer - 1) * (1 + g->h.m);
+}
+
+static LOCK_T *lock_of(const GRAPH *g, uint32_t node) {
+    return &g->locks[node % NODE_LOCKS];
+}
+
+/* Copy the link list of node on layer into s->links, under its lock while the graph is being built */
+static uint32_t copy_links(const GRAPH *g, SCRATCH *s, uint32_t node, int layer) {
+    uint32_t *links = links_of(g, node, layer), n;
+    if (g->locks != NULL) LOCK(lock_of(g, node));
+    n = links[0];
+    if (n > ((layer == 0) ? g->h.m0 : g->h.m)) n = 0; // Only a damaged file holds longer lists
+    memcpy(s->links + 1, links + 1, n * sizeof(uint32_t));
+    if (g->locks != NULL) UNLOCK(lock_of(g, node));
+    return s->links[0] = n;
+}
+
+static void init_scratch(SCRATCH *s, const GRAPH *g, long long ef) {
+    s->frontier_capacity = (int)ef + 1;
+    s->frontier = (CANDIDATE*)malloc(s->frontier_capacity * sizeof(CANDIDATE));
+    s->results = (CANDIDATE*)malloc((ef + 1) * sizeof(CANDIDATE));
+    s->visited_capacity = VISITED_INITIAL_CAPACITY;
+    s->visited = (uint32_t*)calloc(s->visited_capacity, sizeof(uint32_t));
+    s->links = (uint32_t*)malloc((g->h.m0 + 1) * sizeof(uint32_t));
+    s->selected = (CANDIDATE*)malloc((ef + g->h.m0 + 2) * sizeof(CANDIDATE));
+}
+
+static void free_scratch(SCRATCH *s) {
+    free(s->frontier);
+    free(s->results);
+    free(s->visited);
+    free(s->links);
+    free(s->selected);
+}
+
+/* Add node to the visited set; returns 1 if it was already there */
+static int visit(SCRATCH *s, uint32_t node) {
+    uint64_t slot, a, old_capacity;
+    uint32_t *old;
+    if (2 * (s->visited_count + 1) > s->visited_capacity) { // Keep the set at most half full
+        old = s->visited;
+        old_capacity = s->visited_capacity;
+        s->visited_capacity *= 2;
+        s->visited = (uint32_t*)calloc(s->visited_capacity, sizeof(uint32_t));
+        for (a = 0; a < old_capacity; a++) if (old[a] != 0) {
+            for (slot = mix(old[a]) & (s->visited_capacity - 1); s->visited[slot] != 0; slot = (slot + 1) & (s->visited_capacity - 1));
+            s->visited[slot] = old[a];
+        }
+        free(old);
+    }
+    for (slot = mix(node + 1) & (s->visited_capacity - 1); s->visited[slot] != 0; slot = (slot + 1) & (s->visited_capacity - 1))
+        if (s->visited[slot] == node + 1) return 1;
+    s->visited[slot] = node + 1;
+    s->visited_count++;
+    return 0;
+}
+
+/* Push onto a heap ordered by sim, largest on top if max, else smallest */
+static void heap_push(CANDIDATE *heap, int *size, CANDIDATE c, int max) {
+    int a = (*size)++, parent;
+    while (a > 0) {
+        parent = (a - 1) / 2;
+        if (max ? heap[parent].sim >= c.sim : heap[parent].sim <= c.sim) break;
+        heap[a] = heap[parent];
+        a = parent;
+    }
+    heap[a] = c;
+}
+
+static CANDIDATE heap_pop(CANDIDATE *heap, int *size, int max) {
+    CANDIDATE top = heap[0], last = heap[--(*size)];
+    int a = 0, child;
+    while ((child = 2 * a + 1) < *size) {
+        if (child + 1 < *size && (max ? heap[child + 1].sim > heap[child].sim : heap[child + 1].sim < heap[child].sim)) child++;
+        if (max ? last.sim >= heap[child].sim : last.sim <= heap[child].sim) break;
+        heap[a] = heap[child];
+        a = child;
+    }
+    heap[a] = last;
+    return top;
+}
+
+/* Follow the most similar links on layer from *node until no link improves on it */
+static void greedy_search(const GRAPH *g, SCRATCH *s, const float *q, uint32_t *node, float *sim, int layer) {
+    uint32_t a, n, changed = 1;
+    float x;
+    while (changed) {
+        changed = 0;
+        n = copy_links(g, s, *node, layer);
+        for (a = 1; a <= n; a++) if ((x = dot(q, row_of(g, s->links[a]), g->h.stride)) > *sim) {
+            *sim = x;
+            *node = s->links[a];
+            changed = 1;
+        }
+    }
+}
+
+/* Best-first search of width ef on layer from entry; leaves the best (up to) ef nodes in the min-heap s->results */
+static void search_layer(const GRAPH *g, SCRATCH *s, const float *q, CANDIDATE entry, int ef, int layer) {
+    uint32_t a, n;
+    CANDIDATE c, next;
+    memset(s->visited, 0, s->visited_capacity * sizeof(uint32_t));
+    s->visited_count = 0;
+    s->frontier_size = s->results_size = 0;
+    visit(s, entry.node);
+    heap_push(s->frontier, &s->frontier_size, entry, 1);
+    heap_push(s->results, &s->results_size, entry, 0);
+    while (s->frontier_size > 0) {
+        c = heap_pop(s->frontier, &s->frontier_size, 1);
+        if (s->results_size == ef && c.sim < s->results[0].sim) break; // Nothing left can improve the results
+        n = copy_links(g, s, c.node, layer);
+        for (a = 1; a <= n; a++) {
+            if (visit(s, s->links[a])) continue;
+            next.node = s->links[a];
+            next.sim = dot(q, row_of(g, next.node), g->h.stride);
+            if (s->results_size == ef && next.sim <= s->results[0].sim) continue;
+            if (s->frontier_size == s->frontier_capacity) {
+                s->frontier_capacity *= 2;
+                s->frontier = (CANDIDATE*)realloc(s->frontier, s->frontier_capacity * sizeof(CANDIDATE));
+            }
+            heap_push(s->frontier, &s->frontier_size, next, 1);
+            heap_push(s->results, &s->results_size, next, 0);
+            if (s->results_size > ef) heap_pop(s->results, &s->results_size, 0);
+        }
+    }
+}
+
+/* Most similar first; equal similarities in node order */
+static int compare_candidates(const void *a, const void *b) {
+    const CANDIDATE *x = (const CANDIDATE*)a, *y = (const CANDIDATE*)b;
+    if (x->sim != y->sim) return (x->sim < y->sim) ? 1 : -1;
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+/* Pick up to max_links of the n candidates, sorted most similar first, as links: a candidate is kept only if it is
+ * more similar to the base node than to every candidate kept before it, which spreads the links in all directions
+ * instead of spending them on one tight cluster. The kept candidates are moved to the front; returns how many */
+static int select_links(const GRAPH *g, CANDIDATE *candidates, int n, int max_links) {
+    int a, b, kept = 0;
+    for (a = 0; a < n && kept < max_links; a++) {
+        for (b = 0; b < kept; b++)
+            if (dot(row_of(g, candidates[a].node), row_of(g, candidates[b].node), g->h.stride) > candidates[a].sim) break;
+        if (b == kept) candidates[kept++] = candidates[a];
+    }
+    return kept;
+}
+
+/* Add a link from node to new_node on layer, pruning node's links with select_links if the list is full */
+static void connect(const GRAPH *g, SCRATCH *s, uint32_t node, uint32_t new_node, int layer) {
+    uint32_t *links = links_of(g, node, layer), max_links = (layer == 0) ? g->h.m0 : g->h.m, a;
+    const float *base = row_of(g, node);
+    int n;
+    LOCK(lock_of(g, node));
+    if (links[0] < max_links) links[++links[0]] = new_node;
+    else {
+        for (a = 0; a < links[0]; a++) {
+            s->selected[a].node = links[a + 1];
+            s->selected[a].sim = dot(base, row_of(g, links[a + 1]), g->h.stride);
+        }
+        s->selected[a].node = new_node;
+        s->selected[a].sim = dot(base, row_of(g, new_node), g->h.stride);
+        qsort(s->selected, links[0] + 1, sizeof(CANDIDATE), compare_candidates);
+        n = select_links(g, s->selected, links[0] + 1, max_links);
+        for (links[0] = n, a = 0; a < (uint32_t)n; a++) links[a + 1] = s->selected[a].node;
+    }
+    UNLOCK(lock_of(g, node));
+}
+
+/* Insert node into the graph of ctx, linking it on every layer up to its level */
+static void insert_node(INDEX_CONTEXT *ctx, SCRATCH *s, uint32_t node, int ef_construction) {
+    GRAPH *g = ctx->g;
+    const float *q = row_of(g, node);
+    int level = g->levels[node], top, layer, n, a, holding_global;
+    uint32_t *links;
+    CANDIDATE entry;
+
+    LOCK(&ctx->global_lock);
+    top = (int)g->h.max_level;
+    entry.node = (uint32_t)g->h.entry_point;
+    holding_global = level > top; // A new top layer is linked before other threads may enter through it
+    if (!holding_global) UNLOCK(&ctx->global_lock);
+    entry.sim = dot(q, row_of(g, entry.node), g->h.stride);
+    for (layer = top; layer > level; layer--) greedy_search(g, s, q, &entry.node, &entry.sim, layer);
+    for (layer = (level < top) ? level : top; layer >= 0; layer--) {
+        search_layer(g, s, q, entry, ef_construction, layer);
+        for (n = 0; s->results_size > 0; n++) s->selected[n] = heap_pop(s->results, &s->results_size, 0);
+        qsort(s->selected, n, sizeof(CANDIDATE), compare_candidates);
+        entry = s->selected[0];
+        n = select_links(g, s->selected, n, (int)g->h.m);
+        links = links_of(g, node, layer);
+        LOCK(lock_of(g, node));
+        for (links[0] = n, a = 0; a < n; a++) links[a + 1] = s->selected[a].node;
+        UNLOCK(lock_of(g, node));
+        for (a = 0; a < n; a++) connect(g, s, links[a + 1], node, layer);
+    }
+    if (holding_global) {
+        g->h.max_level = level;
+        g->h.entry_point = node;
+        UNLOCK(&ctx->global_lock);
+    }
+}
+
+/* Insert this thread's share of the nodes, every threads-th one after node 0 */
+static void *build_thread(void *arg) {
+    INDEX_CONTEXT *ctx = ((THREAD_ARG*)arg)->ctx;
+    long long id = ((THREAD_ARG*)arg)->id, node, done = 0;
+    SCRATCH s;
+    init_scratch(&s, ctx->g, ctx->ef);
+    for (node = 1 + id; node < (long long)ctx->g->h.count; node += ctx->threads) {
+        insert_node(ctx, &s, (uint32_t)node, ctx->ef);
+        if (id == 0 && ctx->verbose > 1 && (++done % 10000) == 0)
+            fprintf(stderr, "\033[0GInserted about %lld of %llu rows.", done * ctx->threads, (unsigned long long)ctx->g->h.count);
+    }
+    free_scratch(&s);
+    return NULL;
+}
+
+static const GloveIndexArgs DEFAULT_INDEX_ARGS = {
+        .verbose = 0, .m = 16, .efConstruction = 200, .threads = 0, .seed = 0
+};
+
+int createGloveIndexArgs(GloveIndexArgs* emptyArgs) {
+    *emptyArgs = DEFAULT_INDEX_ARGS;
+    return 0;
+}
+
+/* Write the header and every section of a built graph to file_name */
+static int write_index(const GRAPH *g, const char *file_name) {
+    static const char zeros[INDEX_FILE_ALIGNMENT] = {0};
+    const INDEX_FILE_HEADER *h = &g->h;
+    FILE *fout = fopen(file_name, "wb");
+    int ok;
+    if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n", file_name); return 1;}
+    ok = fwrite(h, sizeof(INDEX_FILE_HEADER), 1, fout) == 1
+        && fwrite(zeros, 1, h->rows_offset - sizeof(INDEX_FILE_HEADER), fout) == h->rows_offset - sizeof(INDEX_FILE_HEADER)
+        && fwrite(g->rows, sizeof(float), h->count * h->stride, fout) == h->count * h->stride
+        && fwrite(g->levels, 1, h->count, fout) == h->count
+        && fwrite(zeros, 1, h->upper_index_offset - h->levels_offset - h->count, fout) == h->upper_index_offset - h->levels_offset - h->count
+        && fwrite(g->upper_index, sizeof(uint64_t), h->count, fout) == h->count
+        && fwrite(zeros, 1, h->links0_offset - h->upper_index_offset - h->count * sizeof(uint64_t), fout) == h->links0_offset - h->upper_index_offset - h->count * sizeof(uint64_t)
+        && fwrite(g->links0, sizeof(uint32_t), h->count * (1 + h->m0), fout) == h->count * (1 + h->m0)
+        && fwrite(zeros, 1, h->upper_offset - h->links0_offset - h->count * (1 + h->m0) * sizeof(uint32_t), fout) == h->upper_offset - h->links0_offset - h->count * (1 + h->m0) * sizeof(uint32_t)
+        && fwrite(g->upper, sizeof(uint32_t), h->upper_length, fout) == h->upper_length;
+    if (fclose(fout) != 0) ok = 0;
+    if (!ok) {fprintf(stderr, "Unable to write file %s.\n", file_name); return 1;}
+    return 0;
+}
+
+int gloveIndexBuild(const GloveIndexArgs* args, const GloveVectors* vectors, const char* indexOut) {
+    INDEX_CONTEXT ctx;
+    GRAPH g;
+    INDEX_FILE_HEADER *h = &g.h;
+    long long a, count = gloveVectorsCount(vectors);
+    int size = gloveVectorsSize(vectors), level, result;
+    double level_scale;
+
+    if (count < 1 || count > UINT32_MAX || args->m < 2 || args->efConstruction < 1) {
+        fprintf(stderr, "gloveIndexBuild needs 1 to %u rows, m >= 2 and efConstruction >= 1.\n", UINT32_MAX);
+        return 1;
+    }
+    memset(&g, 0, sizeof(GRAPH));
+    memcpy(h->magic, INDEX_FILE_MAGIC, sizeof(h->magic));
+    h->version = INDEX_FILE_VERSION;
+    h->byte_order = BYTE_ORDER_MARK;
+    h->count = count;
+    h->size = size;
+    h->stride = align_up(size * sizeof(float)) / sizeof(float);
+    h->m = args->m;
+    h->m0 = 2 * args->m;
+
+    g.rows = (float*)calloc(h->count * h->stride, sizeof(float));
+    g.levels = (unsigned char*)malloc(h->count);
+    g.upper_index = (uint64_t*)malloc(h->count * sizeof(uint64_t));
+    g.links0 = (uint32_t*)calloc(h->count * (1 + h->m0), sizeof(uint32_t));
+    g.locks = (LOCK_T*)malloc(NODE_LOCKS * sizeof(LOCK_T));
+    if (g.rows == NULL || g.levels == NULL || g.upper_index == NULL || g.links0 == NULL || g.locks == NULL) {
+        fprintf(stderr, "Out of memory building an index of %lld rows.\n", count);
+        result = 1;
+        goto cleanup;
+    }
+    level_scale = 1 / log((double)args->m);
+    for (a = 0; a < count; a++) {
+        memcpy(g.rows + a * h->stride, gloveVectorsRow(vectors, a), size * sizeof(float));
+        level = (int)(-log(((mix(args->seed * 0x100000001b3ULL ^ a) >> 11) + 1) * (1.0 / 9007199254740992.0)) * level_scale);
+        g.levels[a] = (unsigned char)((level > MAX_LEVEL) ? MAX_LEVEL : level);
+        g.upper_index[a] = h->upper_length;
+        h->upper_length += (uint64_t)g.levels[a] * (1 + h->m);
+    }
+    g.upper = (uint32_t*)calloc(h->upper_length + 1, sizeof(uint32_t));
+    if (g.upper == NULL) {fprintf(stderr, "Out of memory building an index of %lld rows.\n", count); result = 1; goto cleanup;}
+    h->entry_point = 0;
+    h->max_level = g.levels[0];
+    h->rows_offset = align_up(sizeof(INDEX_FILE_HEADER));
+    h->levels_offset = h->rows_offset + h->count * h->stride * sizeof(float);
+    h->upper_index_offset = align_up(h->levels_offset + h->count);
+    h->links0_offset = align_up(h->upper_index_offset + h->count * sizeof(uint64_t));
+    h->upper_offset = align_up(h->links0_offset + h->count * (1 + h->m0) * sizeof(uint32_t));
+    h->file_size = h->upper_offset + h->upper_length * sizeof(uint32_t);
+
+    for (a = 0; a < NODE_LOCKS; a++) {
+#if defined(_WIN32)
+        InitializeSRWLock(&g.locks[a]);
+#else
+        pthread_mutex_init(&g.locks[a], NULL);
+#endif
+    }
+#if defined(_WIN32)
+    InitializeSRWLock(&ctx.global_lock);
+#else
+    pthread_mutex_init(&ctx.global_lock, NULL);
+#endif
+    ctx.g = &g;
+    ctx.verbose = args->verbose;
+    ctx.ef = args->efConstruction;
+    ctx.threads = (args->threads > 0) ? args->threads : processor_count();
+    if (ctx.verbose > 0) fprintf(stderr, "Building index of %lld rows with m %d and efConstruction %d on %d threads.\n",
+                                 count, args->m, args->efConstruction, ctx.threads);
+    run_threads(&ctx, build_thread, ctx.threads);
+    if (ctx.verbose > 1) fprintf(stderr, "\033[0GInserted %lld rows.                    \n", count);
+#if !defined(_WIN32)
+    for (a = 0; a < NODE_LOCKS; a++) pthread_mutex_destroy(&g.locks[a]);
+    pthread_mutex_destroy(&ctx.global_lock);
+#endif
+    result = write_index(&g, indexOut);
+    if (result == 0 && ctx.verbose > 0)
+        fprintf(stderr, "Wrote index %s: %llu layers, %.1f MB.\n", indexOut, (unsigned long long)h->max_level + 1, h->file_size / 1048576.0);
+
+cleanup:
+    free(g.rows);
+    free(g.levels);
+    free(g.upper_index);
+    free(g.links0);
+    free(g.upper);
+    free(g.locks);
+    return result;
+}
+
+static void unmap_index(GloveIndex* index) {
+#if defined(_WIN32)
+    UnmapViewOfFile(index->base);
+    CloseHandle(index->mapping);
+    CloseHandle(index->file);
+#else
+    munmap((void*)index->base, index->length);
+#endif
+}
+
+/* Whether every link list of a mapped graph is no longer than its layer allows and links only nodes that are on that
+ * layer, so a search never leaves the rows or the lists; the entry point must be on the top layer */
+static int valid_links(const GRAPH *g) {
+    uint64_t a;
+    uint32_t *links, b, n;
+    int layer;
+    if (g->levels[g->h.entry_point] != g->h.max_level) return 0;
+    for (a = 0; a < g->h.count; a++) {
+        for (layer = 0; layer <= g->levels[a]; layer++) {
+            links = links_of(g, (uint32_t)a, layer);
+            n = links[0];
+            if (n > ((layer == 0) ? g->h.m0 : g->h.m)) return 0;
+            for (b = 1; b <= n; b++) if (links[b] >= g->h.count || g->levels[links[b]] < layer) return 0;
+        }
+    }
+    return 1;
+}
+
+int gloveIndexOpen(const char* fileName, GloveIndex** index) {
+    GloveIndex *x = (GloveIndex*)calloc(1, sizeof(GloveIndex));
+    INDEX_FILE_HEADER *h = &x->g.h;
+    uint64_t a;
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+#else
+    struct stat st;
+    int fd;
+#endif
+    *index = NULL;
+
+#if defined(_WIN32)
+    x->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (x->file == INVALID_HANDLE_VALUE) {fprintf(stderr, "Unable to open file %s.\n", fileName); free(x); return 1;}
+    GetFileSizeEx(x->file, &size);
+    x->length = size.QuadPart;
+    x->mapping = (x->length < sizeof(INDEX_FILE_HEADER)) ? NULL : CreateFileMappingA(x->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    x->base = (x->mapping == NULL) ? NULL : (const char*)MapViewOfFile(x->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (x->base == NULL) {
+        fprintf(stderr, "Unable to map file %s.\n", fileName);
+        if (x->mapping != NULL) CloseHandle(x->mapping);
+        CloseHandle(x->file);
+        free(x);
+        return 1;
+    }
+#else
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {fprintf(stderr, "Unable to open file %s.\n", fileName); free(x); return 1;}
+    if (fstat(fd, &st) != 0 || (x->length = st.st_size) < sizeof(INDEX_FILE_HEADER)
+        || (x->base = (const char*)mmap(NULL, x->length, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Unable to map file %s.\n", fileName);
+        close(fd);
+        free(x);
+        return 1;
+    }
+    close(fd); // The mapping keeps the file alive
+#endif
+
+    memcpy(h, x->base, sizeof(INDEX_FILE_HEADER));
+    if (memcmp(h->magic, INDEX_FILE_MAGIC, sizeof(h->magic)) != 0 || h->version != INDEX_FILE_VERSION
+        || h->byte_order != BYTE_ORDER_MARK || h->file_size != x->length || h->count == 0 || h->count > UINT32_MAX
+        || h->stride < h->size || h->m < 2 || h->m0 < h->m || h->entry_point >= h->count || h->max_level > MAX_LEVEL
+        || h->rows_offset % INDEX_FILE_ALIGNMENT != 0 || h->rows_offset < sizeof(INDEX_FILE_HEADER)
+        || h->levels_offset != h->rows_offset + h->count * h->stride * sizeof(float)
+        || h->upper_index_offset != align_up(h->levels_offset + h->count)
+        || h->links0_offset != align_up(h->upper_index_offset + h->count * sizeof(uint64_t))
+        || h->upper_offset != align_up(h->links0_offset + h->count * (1 + h->m0) * sizeof(uint32_t))
+        || h->file_size != h->upper_offset + h->upper_length * sizeof(uint32_t)) {
+        fprintf(stderr, "%s is not a GloVe index file of a supported version.\n", fileName);
+        unmap_index(x);
+        free(x);
+        return 1;
+    }
+    x->g.rows = (float*)(x->base + h->rows_offset);
+    x->g.levels = (unsigned char*)(x->base + h->levels_offset);
+    x->g.upper_index = (uint64_t*)(x->base + h->upper_index_offset);
+    x->g.links0 = (uint32_t*)(x->base + h->links0_offset);
+    x->g.upper = (uint32_t*)(x->base + h->upper_offset);
+    for (a = 0; a < h->count; a++) // Links must stay inside the file whatever it holds
+        if (x->g.levels[a] > h->max_level || x->g.upper_index[a] + (uint64_t)x->g.levels[a] * (1 + h->m) > h->upper_length) break;
+    if (a < h->count || !valid_links(&x->g)) {
+        fprintf(stderr, "%s is corrupt.\n", fileName);
+        unmap_index(x);
+        free(x);
+        return 1;
+    }
+    *index = x;
+    return 0;
+}
+
+void gloveIndexClose(GloveIndex* index) {
+    if (index == NULL) return;
+    unmap_index(index);
+    free(index);
+}
+
+/* Answer this thread's share of the queries, every threads-th one */
+static void *search_thread(void *arg) {
+    INDEX_CONTEXT *ctx = ((THREAD_ARG*)arg)->ctx;
+    long long id = ((THREAD_ARG*)arg)->id, q;
+    const GRAPH *g = ctx->g;
+    const float *query;
+    CANDIDATE entry;
+    int layer, n, a;
+    SCRATCH s;
+
+    init_scratch(&s, g, ctx->ef);
+    for (q = id; q < ctx->count; q += ctx->threads) {
+        query = ctx->queries + q * g->h.stride;
+        entry.node = (uint32_t)g->h.entry_point;
+        entry.sim = dot(query, row_of(g, entry.node), g->h.stride);
+        for (layer = (int)g->h.max_level; layer > 0; layer--) greedy_search(g, &s, query, &entry.node, &entry.sim, layer);
+        search_layer(g, &s, query, entry, ctx->ef, 0);
+        for (n = 0; s.results_size > 0; n++) s.selected[n] = heap_pop(s.results, &s.results_size, 0);
+        qsort(s.selected, n, sizeof(CANDIDATE), compare_candidates);
+        for (a = 0; a < ctx->k; a++) {
+            ctx->rows[q * ctx->k + a] = (a < n) ? (long long)s.selected[a].node : -1;
+            ctx->scores[q * ctx->k + a] = (a < n) ? s.selected[a].sim : 0;
+        }
+    }
+    free_scratch(&s);
+    return NULL;
+}
+
+int gloveIndexSearch(const GloveIndex* index, const float* queries, int count, int k, int ef, int threads,
+                     long long* rows, float* scores) {
+    INDEX_CONTEXT ctx;
+    const INDEX_FILE_HEADER *h = &index->g.h;
+    float *normalized;
+    double norm;
+    long long q;
+    uint64_t a;
+
+    if (k < 1) {fprintf(stderr, "gloveIndexSearch needs k >= 1.\n"); return 1;}
+    if (count <= 0) return 0;
+    normalized = (float*)calloc((uint64_t)count * h->stride, sizeof(float));
+    if (normalized == NULL) {fprintf(stderr, "Out of memory for %d queries.\n", count); return 1;}
+    for (q = 0; q < count; q++) {
+        for (a = 0, norm = 0; a < h->size; a++) norm += (double)queries[q * h->size + a] * queries[q * h->size + a];
+        norm = (norm > 0) ? 1 / sqrt(norm) : 0;
+        for (a = 0; a < h->size; a++) normalized[q * h->stride + a] = (float)(queries[q * h->size + a] * norm);
+    }
+    ctx.g = (GRAPH*)&index->g;
+    ctx.queries = normalized;
+    ctx.count = count;
+    ctx.k = k;
+    ctx.ef = (ef > k) ? ef : k;
+    ctx.rows = rows;
+    ctx.scores = scores;
+    ctx.threads = (threads < 1) ? 1 : (threads > count) ? count : threads;
+    run_threads(&ctx, search_thread, ctx.threads);
+    free(normalized);
+    return 0;
+}
@@ -0,0 +1,557 @@
+//  Self-describing binary model files for trained word vectors
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  File layout (native byte order, recorded in the header):
+//    header                   MODEL_FILE_HEADER
+//    word offsets             (rows + 1) uint64, byte offsets of each word in the string table
+//    string table             NUL terminated words
+//    vector data              rows * row_bytes, starting 64-byte aligned; each row holds dim values of the stored type
+//                             followed by zero padding to a multiple of 64 bytes. An int8 row is a float scale and
+//                             dim signed codes, value = scale * code; a PQ row is pq_subspaces unpadded centroid codes
+//    codebook (PQ only)       pq_subspaces * pq_centroids centroids of pq_sub_dim floats, starting 64-byte aligned
+//
+//  Version 1 files have the header without the fields from pq_subspaces on and hold float32 or float64 rows only.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/glove.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MODEL_FILE_VERSION 2
+#define PQ_CENTROIDS 256 // Centroids per subspace, so each code is one byte
+#define PQ_TRAIN_ROWS 65536 // Rows, evenly spaced through the file, the codebook is trained on
+#define PQ_ITERATIONS 10 // Lloyd iterations of the k-means of each subspace
+#define PQ_DEFAULT_SUB_DIM 4 // Values per subspace when the caller does not choose the number of subspaces
+#define MODEL_FILE_ALIGNMENT 64
+#define BYTE_ORDER_MARK 0x01020304u
+
+static const char MODEL_FILE_MAGIC[8] = "GLOVEMDL";
+
+typedef struct model_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // BYTE_ORDER_MARK as written by the producer
+    uint32_t dtype; // GLOVE_DTYPE_*
+    uint32_t model; // 0, 1 or 2, as GloveArgs.model
+    uint32_t vector_size; // Trained dimension, excluding bias
+    uint32_t dim; // Values per row
+    uint64_t rows;
+    uint64_t row_bytes;
+    uint64_t offsets_offset;
+    uint64_t strings_offset;
+    uint64_t data_offset;
+    uint64_t file_size;
+    /* Version 2 */
+    uint32_t pq_subspaces; // PQ: code bytes per row
+    uint32_t pq_centroids; // PQ: centroids per subspace
+    uint32_t pq_sub_dim; // PQ: values per subspace; rows are zero padded to pq_subspaces * pq_sub_dim values
+    uint32_t reserved;
+    uint64_t codebook_offset; // PQ: start of the codebook
+    double error; // Relative RMS error of the quantized rows against the values written; 0 for float rows
+} MODEL_FILE_HEADER;
+
+#define MODEL_FILE_HEADER_V1_SIZE offsetof(MODEL_FILE_HEADER, pq_subspaces)
+
+struct _GloveModelWriter {
+    FILE *fout;
+    MODEL_FILE_HEADER header;
+    uint64_t rows_written;
+    char *row; // One padded row in the stored type
+    double *values; // One row converted from floats, for quantized types
+    float *pq_rows; // PQ: all rows, zero padded, kept until the codebook is trained at close
+    double error_sum, norm_sum; // Squared quantization error and squared values of the rows so far
+};
+
+struct _GloveModelFile {
+    const char *base; // Start of the mapping
+    MODEL_FILE_HEADER header; // Copy of the file's header, with the version 2 fields zeroed for version 1 files
+    const uint64_t *offsets;
+    const char *strings;
+    const float *codebook; // PQ only
+#if defined(_WIN32)
+    HANDLE file, mapping;
+#endif
+};
+
+static uint64_t align_up(uint64_t n) {
+    return (n + MODEL_FILE_ALIGNMENT - 1) / MODEL_FILE_ALIGNMENT * MODEL_FILE_ALIGNMENT;
+}
+
+static int dtype_size(int dtype) {
+    return (dtype == GLOVE_DTYPE_FLOAT64) ? 8 : (dtype == GLOVE_DTYPE_FLOAT32) ? 4 : 1;
+}
+
+/* Bytes of one row's data, before padding */
+static uint64_t row_data_bytes(const MODEL_FILE_HEADER *h) {
+    if (h->dtype == GLOVE_DTYPE_INT8) return sizeof(float) + h->dim;
+    if (h->dtype == GLOVE_DTYPE_PQ) return h->pq_subspaces;
+    return (uint64_t)h->dim * dtype_size(h->dtype);
+}
+
+int gloveModelWriterOpen(const char* fileName, long long rows, int vectorSize, int model, int dtype,
+                         const char* const* words, GloveModelWriter** writer) {
+    return gloveModelWriterOpenPQ(fileName, rows, vectorSize, model, dtype, 0, words, writer);
+}
+
+int gloveModelWriterOpenPQ(const char* fileName, long long rows, int vectorSize, int model, int dtype, int subspaces,
+                           const char* const* words, GloveModelWriter** writer) {
+    static const char zeros[MODEL_FILE_ALIGNMENT] = {0};
+    long long a;
+    uint64_t offset = 0, strings_bytes = 0;
+    GloveModelWriter *w;
+
+    *writer = NULL;
+    if (rows < 0 || vectorSize < 1 || model < 0 || model > 2 || dtype < GLOVE_DTYPE_FLOAT32 || dtype > GLOVE_DTYPE_PQ) {
+        fprintf(stderr, "Invalid model file parameters for %s.\n", fileName);
+        return 1;
+    }
+    w = (GloveModelWriter*)calloc(1, sizeof(GloveModelWriter));
+    if (w == NULL) {fprintf(stderr, "Error allocating memory for the writer of %s.\n", fileName); return 1;}
+    for (a = 0; a < rows; a++) strings_bytes += strlen(words[a]) + 1;
+    memcpy(w->header.magic, MODEL_FILE_MAGIC, sizeof(w->header.magic));
+    w->header.version = MODEL_FILE_VERSION;
+    w->header.byte_order = BYTE_ORDER_MARK;
+    w->header.dtype = dtype;
+    w->header.model = model;
+    w->header.vector_size = vectorSize;
+    w->header.dim = (model == 0) ? 2 * (vectorSize + 1) : vectorSize;
+    w->header.rows = rows;
+    if (dtype == GLOVE_DTYPE_PQ) {
+        if (subspaces <= 0) subspaces = (w->header.dim + PQ_DEFAULT_SUB_DIM - 1) / PQ_DEFAULT_SUB_DIM;
+        if ((uint32_t)subspaces > w->header.dim) subspaces = w->header.dim;
+        w->header.pq_subspaces = subspaces;
+        w->header.pq_sub_dim = (w->header.dim + subspaces - 1) / subspaces;
+        w->header.pq_centroids = PQ_CENTROIDS;
+        w->header.row_bytes = w->header.pq_subspaces; // Codes are packed; padding them would undo the compression
+    }
+    else w->header.row_bytes = align_up(row_data_bytes(&w->header));
+    w->header.offsets_offset = sizeof(MODEL_FILE_HEADER);
+    w->header.strings_offset = w->header.offsets_offset + (rows + 1) * sizeof(uint64_t);
+    w->header.data_offset = align_up(w->header.strings_offset + strings_bytes);
+    w->header.file_size = w->header.data_offset + rows * w->header.row_bytes;
+    if (dtype == GLOVE_DTYPE_PQ) {
+        w->header.codebook_offset = align_up(w->header.file_size);
+        w->header.file_size = w->header.codebook_offset + (uint64_t)w->header.pq_subspaces * w->header.pq_centroids * w->header.pq_sub_dim * sizeof(float);
+        w->pq_rows = (float*)calloc(rows * w->header.pq_subspaces * w->header.pq_sub_dim + 1, sizeof(float));
+        if (w->pq_rows == NULL) {
+            fprintf(stderr, "Error allocating memory for the rows of %s.\n", fileName);
+            free(w);
+            return 1;
+        }
+    }
+
+    w->fout = fopen(fileName, "wb");
+    if (w->fout == NULL) {
+        fprintf(stderr, "Unable to open file %s.\n", fileName);
+        free(w->pq_rows);
+        free(w);
+        return 1;
+    }
+    w->row = (char*)calloc(1, w->header.row_bytes);
+    w->values = (double*)malloc(w->header.dim * sizeof(double));
+    if (w->row == NULL || w->values == NULL) {
+        fprintf(stderr, "Error allocating memory for the writer of %s.\n", fileName);
+        fclose(w->fout);
+        free(w->row);
+        free(w->values);
+        free(w->pq_rows);
+        free(w);
+        return 1;
+    }
+    setvbuf(w->fout, NULL, _IOFBF, 4 * 1024 * 1024);
+    fwrite(&w->header, sizeof(w->header), 1, w->fout);
+    for (a = 0; a <= rows; a++) {
+        fwrite(&offset, sizeof(offset), 1, w->fout);
+        if (a < rows) offset += strlen(words[a]) + 1;
+    }
+    for (a = 0; a < rows; a++) fwrite(words[a], 1, strlen(words[a]) + 1, w->fout);
+    fwrite(zeros, 1, w->header.data_offset - w->header.strings_offset - strings_bytes, w->fout);
+    *writer = w;
+    return 0;
+}
+
+/* Scale a row to signed bytes by its largest magnitude, accumulating the squared error */
+static void quantize_int8(GloveModelWriter* writer, const double* values) {
+    uint32_t b;
+    double peak = 0, scale, x;
+    signed char *codes = (signed char*)(writer->row + sizeof(float));
+    for (b = 0; b < writer->header.dim; b++) if (fabs(values[b]) > peak) peak = fabs(values[b]);
+    scale = (float)(peak / 127);
+    *(float*)writer->row = (float)scale;
+    for (b = 0; b < writer->header.dim; b++) {
+        codes[b] = (scale > 0) ? (signed char)lrint(values[b] / scale) : 0;
+        x = values[b] - scale * codes[b];
+        writer->error_sum += x * x;
+        writer->norm_sum += values[b] * values[b];
+    }
+}
+
+int gloveModelWriterAddRow(GloveModelWriter* writer, const double* values) {
+    uint32_t b;
+    float *pq_row;
+    if (writer->rows_written >= writer->header.rows) return 1;
+    if (writer->header.dtype == GLOVE_DTYPE_PQ) { // Encoded at close, once the codebook is trained on all rows
+        pq_row = writer->pq_rows + writer->rows_written * writer->header.pq_subspaces * writer->header.pq_sub_dim;
+        for (b = 0; b < writer->header.dim; b++) pq_row[b] = (float)values[b];
+        writer->rows_written++;
+        return 0;
+    }
+    if (writer->header.dtype == GLOVE_DTYPE_INT8) quantize_int8(writer, values);
+    else if (writer->header.dtype == GLOVE_DTYPE_FLOAT64) memcpy(writer->row, values, writer->header.dim * sizeof(double));
+    else for (b = 0; b < writer->header.dim; b++) ((float*)writer->row)[b] = (float)values[b];
+    fwrite(writer->row, 1, writer->header.row_bytes, writer->fout);
+    writer->rows_written++;
+    return 0;
+}
+
+int gloveModelWriterAddRowF(GloveModelWriter* writer, const float* values) {
+    uint32_t b;
+    if (writer->rows_written >= writer->header.rows) return 1;
+    if (writer->header.dtype == GLOVE_DTYPE_INT8 || writer->header.dtype == GLOVE_DTYPE_PQ) {
+        for (b = 0; b < writer->header.dim; b++) writer->values[b] = values[b];
+        return gloveModelWriterAddRow(writer, writer->values);
+    }
+    if (writer->header.dtype == GLOVE_DTYPE_FLOAT32) memcpy(writer->row, values, writer->header.dim * sizeof(float));
+    else for (b = 0; b < writer->header.dim; b++) ((double*)writer->row)[b] = values[b];
+    fwrite(writer->row, 1, writer->header.row_bytes, writer->fout);
+    writer->rows_written++;
+    return 0;
+}
+
+/* Index of the centroid nearest to x among k centroids stored transposed (value s of centroid c at s * k + c), so the
+ * distance loop runs over contiguous centroids and vectorizes */
+static int nearest_centroid(const float *transposed, int k, uint32_t sub_dim, const float *x, float *distances) {
+    int c, best = 0;
+    uint32_t s;
+    float diff;
+    for (c = 0; c < k; c++) distances[c] = 0;
+    for (s = 0; s < sub_dim; s++) {
+        for (c = 0; c < k; c++) {
+            diff = x[s] - transposed[s * k + c];
+            distances[c] += diff * diff;
+        }
+    }
+    for (c = 1; c < k; c++) if (distances[c] < distances[best]) best = c; // A NaN distance never wins, so best stays valid
+    return best;
+}
+
+/* Train the k-means codebook of each subspace on evenly spaced rows, then write the code of every row and the codebook.
+ * Deterministic, so the same rows always give the same file. 1 if it runs out of memory */
+static int write_pq(GloveModelWriter* writer) {
+    static const char zeros[MODEL_FILE_ALIGNMENT] = {0};
+    const MODEL_FILE_HEADER *h = &writer->header;
+    uint64_t a, t, n_train = (h->rows < PQ_TRAIN_ROWS) ? h->rows : PQ_TRAIN_ROWS, stride = (uint64_t)h->pq_subspaces * h->pq_sub_dim;
+    uint32_t j, s;
+    int c, k = (n_train < PQ_CENTROIDS) ? (int)n_train : PQ_CENTROIDS, iteration;
+    float *codebook = (float*)calloc((size_t)h->pq_subspaces * h->pq_centroids * h->pq_sub_dim, sizeof(float));
+    float *transposed = (float*)malloc((size_t)PQ_CENTROIDS * h->pq_sub_dim * sizeof(float));
+    float *sums = (float*)malloc((size_t)PQ_CENTROIDS * h->pq_sub_dim * sizeof(float));
+    float *distances = (float*)malloc(PQ_CENTROIDS * sizeof(float));
+    long long *counts = (long long*)malloc(PQ_CENTROIDS * sizeof(long long));
+    unsigned char *codes = (unsigned char*)malloc(h->rows * h->pq_subspaces + 1);
+    const float *x, *centroid;
+    float *centroids;
+    double diff;
+    int result = 0;
+
+    if (codebook == NULL || transposed == NULL || sums == NULL || distances == NULL || counts == NULL || codes == NULL) {
+        fprintf(stderr, "Error allocating memory for product quantization.\n");
+        result = 1;
+    }
+    for (j = 0; j < h->pq_subspaces && result == 0; j++) {
+        centroids = codebook + (size_t)j * h->pq_centroids * h->pq_sub_dim;
+        for (c = 0; c < k; c++) memcpy(centroids + c * h->pq_sub_dim, writer->pq_rows + (uint64_t)c * n_train / k * h->rows / n_train * stride + j * h->pq_sub_dim, h->pq_sub_dim * sizeof(float));
+        for (iteration = 0; iteration <= PQ_ITERATIONS; iteration++) {
+            for (c = 0; c < k; c++) for (s = 0; s < h->pq_sub_dim; s++) transposed[s * k + c] = centroids[c * h->pq_sub_dim + s];
+            if (iteration == PQ_ITERATIONS) break;
+            memset(sums, 0, (size_t)k * h->pq_sub_dim * sizeof(float));
+            memset(counts, 0, k * sizeof(long long));
+            for (t = 0; t < n_train; t++) {
+                x = writer->pq_rows + t * h->rows / n_train * stride + j * h->pq_sub_dim;
+                c = nearest_centroid(transposed, k, h->pq_sub_dim, x, distances);
+                counts[c]++;
+                for (s = 0; s < h->pq_sub_dim; s++) sums[c * h->pq_sub_dim + s] += x[s];
+            }
+            for (c = 0; c < k; c++) { // Centroids of empty clusters stay where they are
+                if (counts[c] > 0) for (s = 0; s < h->pq_sub_dim; s++) centroids[c * h->pq_sub_dim + s] = sums[c * h->pq_sub_dim + s] / counts[c];
+            }
+        }
+        for (a = 0; a < h->rows; a++) {
+            x = writer->pq_rows + a * stride + j * h->pq_sub_dim;
+            c = nearest_centroid(transposed, k, h->pq_sub_dim, x, distances);
+            codes[a * h->pq_subspaces + j] = (unsigned char)c;
+            centroid = centroids + c * h->pq_sub_dim;
+            for (s = 0; s < h->pq_sub_dim && j * h->pq_sub_dim + s < h->dim; s++) { // Skip the zero padding
+                diff = x[s] - centroid[s];
+                writer->error_sum += diff * diff;
+                writer->norm_sum += (double)x[s] * x[s];
+            }
+        }
+    }
+    if (result == 0) {
+        fwrite(codes, 1, h->rows * h->pq_subspaces, writer->fout);
+        fwrite(zeros, 1, h->codebook_offset - (h->data_offset + h->rows * h->row_bytes), writer->fout);
+        fwrite(codebook, sizeof(float), (size_t)h->pq_subspaces * h->pq_centroids * h->pq_sub_dim, writer->fout);
+    }
+    free(codebook);
+    free(transposed);
+    free(sums);
+    free(distances);
+    free(counts);
+    free(codes);
+    return result;
+}
+
+int gloveModelWriterClose(GloveModelWriter* writer) {
+    int result = 0;
+    if (writer == NULL) return 1;
+    if (writer->rows_written != writer->header.rows) {
+        fprintf(stderr, "Model file closed after %llu of %llu rows.\n",
+                (unsigned long long)writer->rows_written, (unsigned long long)writer->header.rows);
+        result = 1;
+    }
+    else if (writer->header.dtype == GLOVE_DTYPE_PQ && write_pq(writer) != 0) result = 1;
+    else if (writer->header.dtype == GLOVE_DTYPE_INT8 || writer->header.dtype == GLOVE_DTYPE_PQ) {
+        writer->header.error = (writer->norm_sum > 0) ? sqrt(writer->error_sum / writer->norm_sum) : 0;
+        fprintf(stderr, "%s quantization: relative RMS reconstruction error %.4f\n",
+                (writer->header.dtype == GLOVE_DTYPE_PQ) ? "PQ" : "int8", writer->header.error);
+        fseek(writer->fout, 0, SEEK_SET); // The header was written before the error was known
+        fwrite(&writer->header, sizeof(writer->header), 1, writer->fout);
+    }
+    if (fclose(writer->fout) != 0) result = 1;
+    free(writer->row);
+    free(writer->values);
+    free(writer->pq_rows);
+    free(writer);
+    return result;
+}
+
+static void unmap_model(GloveModelFile* model, uint64_t length) {
+#if defined(_WIN32)
+    UnmapViewOfFile(model->base);
+    CloseHandle(model->mapping);
+    CloseHandle(model->file);
+#else
+    munmap((void*)model->base, length);
+#endif
+}
+
+/* Whether a header describes a file of a supported version whose sections lie in order within its length bytes. rows
+ * and the section offsets are bounded by length before they are multiplied, so a corrupt header cannot overflow the
+ * checks */
+static int valid_header(const MODEL_FILE_HEADER *h, uint64_t length) {
+    uint64_t header_size = (h->version >= 2) ? sizeof(MODEL_FILE_HEADER) : MODEL_FILE_HEADER_V1_SIZE;
+    if (memcmp(h->magic, MODEL_FILE_MAGIC, sizeof(h->magic)) != 0 || h->version < 1 || h->version > MODEL_FILE_VERSION
+        || h->byte_order != BYTE_ORDER_MARK || h->dtype > (uint32_t)((h->version == 1) ? GLOVE_DTYPE_FLOAT64 : GLOVE_DTYPE_PQ)
+        || h->file_size != length || h->dim == 0) return 0;
+    if (h->dtype == GLOVE_DTYPE_PQ && (h->pq_subspaces == 0 || h->pq_sub_dim == 0 || h->pq_centroids != PQ_CENTROIDS
+                                       || (uint64_t)h->pq_subspaces * h->pq_sub_dim < h->dim)) return 0; // Every code byte names a centroid
+    if (h->row_bytes == 0 || h->row_bytes < row_data_bytes(h)) return 0;
+    if (h->offsets_offset < header_size || h->offsets_offset > length || h->offsets_offset % sizeof(uint64_t) != 0
+        || h->rows >= (length - h->offsets_offset) / sizeof(uint64_t)) return 0; // The rows + 1 offsets fit
+    if (h->strings_offset != h->offsets_offset + (h->rows + 1) * sizeof(uint64_t)) return 0;
+    if (h->data_offset < h->strings_offset || h->data_offset > length || h->data_offset % MODEL_FILE_ALIGNMENT != 0
+        || h->rows > (length - h->data_offset) / h->row_bytes) return 0; // The rows fit
+    if (h->dtype != GLOVE_DTYPE_PQ) return h->data_offset + h->rows * h->row_bytes == length;
+    return h->codebook_offset >= h->data_offset + h->rows * h->row_bytes && h->codebook_offset <= length
+           && h->codebook_offset % MODEL_FILE_ALIGNMENT == 0
+           && (length - h->codebook_offset) % (h->pq_sub_dim * sizeof(float)) == 0
+           && (length - h->codebook_offset) / (h->pq_sub_dim * sizeof(float)) == (uint64_t)h->pq_subspaces * h->pq_centroids;
+}
+
+/* Whether the word offsets rise through the string table and each word ends with a NUL within it */
+static int valid_words(const GloveModelFile *m) {
+    const MODEL_FILE_HEADER *h = &m->header;
+    uint64_t a;
+    if (m->offsets[0] != 0 || m->offsets[h->rows] > h->data_offset - h->strings_offset) return 0;
+    for (a = 0; a < h->rows; a++) {
+        if (m->offsets[a + 1] <= m->offsets[a] || m->offsets[a + 1] > m->offsets[h->rows]) return 0;
+        if (m->strings[m->offsets[a + 1] - 1] != '\0') return 0;
+    }
+    return 1;
+}
+
+int gloveModelFileOpen(const char* fileName, GloveModelFile** model) {
+    uint64_t length;
+    const MODEL_FILE_HEADER *h;
+    GloveModelFile *m = (GloveModelFile*)calloc(1, sizeof(GloveModelFile));
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+#else
+    struct stat st;
+    int fd;
+#endif
+    *model = NULL;
+
+#if defined(_WIN32)
+    m->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) {fprintf(stderr, "Unable to open file %s.\n", fileName); free(m); return 1;}
+    GetFileSizeEx(m->file, &size);
+    length = size.QuadPart;
+    m->mapping = (length < sizeof(MODEL_FILE_HEADER)) ? NULL : CreateFileMappingA(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    m->base = (m->mapping == NULL) ? NULL : (const char*)MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m->base == NULL) {
+        fprintf(stderr, "Unable to map file %s.\n", fileName);
+        if (m->mapping != NULL) CloseHandle(m->mapping);
+        CloseHandle(m->file);
+        free(m);
+        return 1;
+    }
+#else
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {fprintf(stderr, "Unable to open file %s.\n", fileName); free(m); return 1;}
+    if (fstat(fd, &st) != 0 || (length = st.st_size) < sizeof(MODEL_FILE_HEADER)
+        || (m->base = (const char*)mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Unable to map file %s.\n", fileName);
+        close(fd);
+        free(m);
+        return 1;
+    }
+    close(fd); // The mapping keeps the file alive
+#endif
+
+    h = &m->header;
+    memcpy(&m->header, m->base, MODEL_FILE_HEADER_V1_SIZE);
+    if (h->version >= 2 && length >= sizeof(MODEL_FILE_HEADER)) memcpy(&m->header, m->base, sizeof(MODEL_FILE_HEADER));
+    if (valid_header(h, length)) {
+        m->offsets = (const uint64_t*)(m->base + h->offsets_offset);
+        m->strings = m->base + h->strings_offset;
+    }
+    if (m->offsets == NULL || !valid_words(m)) {
+        fprintf(stderr, "%s is not a GloVe model file of a supported version, or it is damaged.\n", fileName);
+        unmap_model(m, length);
+        free(m);
+        return 1;
+    }
+    if (h->dtype == GLOVE_DTYPE_PQ) m->codebook = (const float*)(m->base + h->codebook_offset);
+    *model = m;
+    return 0;
+}
+
+void gloveModelFileClose(GloveModelFile* model) {
+    if (model == NULL) return;
+    unmap_model(model, model->header.file_size);
+    free(model);
+}
+
+void gloveModelFileInfo(const GloveModelFile* model, GloveModelInfo* info) {
+    info->rows = (long long)model->header.rows;
+    info->dim = (int)model->header.dim;
+    info->vectorSize = (int)model->header.vector_size;
+    info->model = (int)model->header.model;
+    info->dtype = (int)model->header.dtype;
+    info->rowBytes = (long long)model->header.row_bytes;
+    info->subspaces = (int)model->header.pq_subspaces;
+    info->error = model->header.error;
+}
+
+const char* gloveModelFileWord(const GloveModelFile* model, long long row) {
+    if (row < 0 || (uint64_t)row >= model->header.rows) return NULL;
+    return model->strings + model->offsets[row];
+}
+
+const void* gloveModelFileRow(const GloveModelFile* model, long long row) {
+    if (row < 0 || (uint64_t)row >= model->header.rows) return NULL;
+    return model->base + model->header.data_offset + row * model->header.row_bytes;
+}
+
+int gloveModelFileDecode(const GloveModelFile* model, long long row, float* values) {
+    const MODEL_FILE_HEADER *h = &model->header;
+    const char *data = (const char*)gloveModelFileRow(model, row);
+    const unsigned char *codes;
+    uint32_t b;
+    float scale;
+    if (data == NULL) return 1;
+    if (h->dtype == GLOVE_DTYPE_FLOAT32) memcpy(values, data, h->dim * sizeof(float));
+    else if (h->dtype == GLOVE_DTYPE_FLOAT64) for (b = 0; b < h->dim; b++) values[b] = (float)((const double*)data)[b];
+    else if (h->dtype == GLOVE_DTYPE_INT8) {
+        scale = *(const float*)data;
+        for (b = 0; b < h->dim; b++) values[b] = scale * ((const signed char*)(data + sizeof(float)))[b];
+    }
+    else {
+        codes = (const unsigned char*)data;
+        for (b = 0; b < h->dim; b++)
+            values[b] = model->codebook[((size_t)(b / h->pq_sub_dim) * h->pq_centroids + codes[b / h->pq_sub_dim]) * h->pq_sub_dim + b % h->pq_sub_dim];
+    }
+    return 0;
+}
+
+double gloveModelFileDot(const GloveModelFile* model, long long row, const float* query) {
+    float score;
+    if (gloveModelFileScore(model, query, row, 1, &score) != 0) return 0;
+    return score;
+}
+
+int gloveModelFileScore(const GloveModelFile* model, const float* query, long long firstRow, long long count, float* scores) {
+    const MODEL_FILE_HEADER *h = &model->header;
+    const char *data;
+    const signed char *codes8;
+    const unsigned char *codes;
+    const float *centroid;
+    float *table;
+    long long a;
+    uint32_t b, j, s;
+    double dot;
+
+    if (firstRow < 0 || count < 0 || (uint64_t)(firstRow + count) > h->rows) return 1;
+    data = model->base + h->data_offset + firstRow * h->row_bytes;
+    if (h->dtype == GLOVE_DTYPE_PQ) {
+        /* Asymmetric distance computation: the dot products of the query with every centroid are computed once, after
+         * which each row costs one table lookup per subspace */
+        table = (float*)malloc((size_t)h->pq_subspaces * h->pq_centroids * sizeof(float));
+        if (table == NULL) return 1;
+        for (j = 0; j < h->pq_subspaces; j++) {
+            for (b = 0; b < h->pq_centroids; b++) {
+                centroid = model->codebook + ((size_t)j * h->pq_centroids + b) * h->pq_sub_dim;
+                for (dot = 0, s = 0; s < h->pq_sub_dim && j * h->pq_sub_dim + s < h->dim; s++) dot += centroid[s] * query[j * h->pq_sub_dim + s];
+                table[j * h->pq_centroids + b] = (float)dot;
+            }
+        }
+        for (a = 0; a < count; a++) {
+            codes = (const unsigned char*)(data + a * h->row_bytes);
+            for (dot = 0, j = 0; j < h->pq_subspaces; j++) dot += table[j * h->pq_centroids + codes[j]];
+            scores[a] = (float)dot;
+        }
+        free(table);
+        return 0;
+    }
+    for (a = 0; a < count; a++, data += h->row_bytes) {
+        dot = 0;
+        if (h->dtype == GLOVE_DTYPE_INT8) {
+            float sum = 0; // Single precision so the loop over the codes vectorizes
+            codes8 = (const signed char*)(data + sizeof(float));
+            for (b = 0; b < h->dim; b++) sum += codes8[b] * query[b];
+            dot = (double)*(const float*)data * sum;
+        }
+        else if (h->dtype == GLOVE_DTYPE_FLOAT32) for (b = 0; b < h->dim; b++) dot += ((const float*)data)[b] * query[b];
+        else for (b = 0; b < h->dim; b++) dot += ((const double*)data)[b] * query[b];
+        scores[a] = (float)dot;
+    }
+    return 0;
+}
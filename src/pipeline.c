@@ -0,0 +1,110 @@
+//  vocabCount, cooccur, shuffle and glove in one call, handing data from stage to stage in memory
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/glove.h"
+#include "pipeline.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_STRING_LENGTH 1000
+
+#if defined(_WIN32)
+static volatile LONG temp_calls;
+#else
+static volatile long temp_calls;
+#endif
+
+void glove_temp_name(char* out, size_t size, const char* head) {
+#if defined(_WIN32)
+    snprintf(out, size, "%s_%d_%ld", head, _getpid(), (long)InterlockedIncrement(&temp_calls));
+#else
+    snprintf(out, size, "%s_%ld_%ld", head, (long)getpid(), __sync_add_and_fetch(&temp_calls, 1));
+#endif
+}
+
+int glove_chunk_name(char* out, size_t size, const char* head, int chunk) {
+    int length = snprintf(out, size, "%s_%04d.bin", head, chunk);
+    if (length < 0 || (size_t)length >= size) {
+        fprintf(stderr, "Temporary file name %s_%04d.bin is too long.\n", head, chunk);
+        return 1;
+    }
+    return 0;
+}
+
+int createGlovePipelineArgs(GlovePipelineArgs* emptyArgs) {
+    createVocabCountArgs(&emptyArgs->vocab);
+    createCooccurArgs(&emptyArgs->cooccur);
+    createShuffleArgs(&emptyArgs->shuffle);
+    createGloveArgs(&emptyArgs->glove);
+    emptyArgs->profile = NULL;
+    emptyArgs->mode = 0;
+    return 0;
+}
+
+/* GLOVE_RECORD_SINK that adds the records of cooccur to the shuffler */
+static void shuffle_record(void *shuffler, int word1, int word2, double val) {
+    glove_shuffler_add((GLOVE_SHUFFLER*)shuffler, word1, word2, val);
+}
+
+int glovePipeline(const GlovePipelineArgs* args, const char* corpusIn, char* vocabOut, char* shufCooccurOut,
+                  char* gloveOut, char* gradsqOut, GloveModel** model) {
+    VocabCountArgs vocab_args = args->vocab;
+    CooccurArgs cooccur_args = args->cooccur;
+    ShuffleArgs shuffle_args = args->shuffle;
+    GloveArgs glove_args = args->glove;
+    GLOVE_VOCAB vocab;
+    GLOVE_SHUFFLER *shuffler;
+    char temp_file[MAX_STRING_LENGTH], *shuffled = shufCooccurOut;
+    int result;
+
+    if (model != NULL) *model = NULL;
+    if (args->glove.processes > 1) {
+        fprintf(stderr, "glovePipeline trains in one process; call glove for multi-process training.\n");
+        return 1;
+    }
+    if (args->profile != NULL)
+        vocab_args.profile = cooccur_args.profile = shuffle_args.profile = glove_args.profile = args->profile;
+    if (shuffled == NULL) {
+        glove_temp_name(temp_file, MAX_STRING_LENGTH - 4, args->shuffle.tempFile);
+        strcat(temp_file, ".bin");
+        shuffled = temp_file;
+    }
+
+    if (glove_count_vocab(&vocab_args, corpusIn, vocabOut, &vocab) != 0) return 1;
+    /* The shuffler takes the merged records as cooccur produces them, and its writer thread shuffles and writes each
+     * full chunk while the merge goes on */
+    shuffler = glove_shuffler_open(&shuffle_args, shuffled);
+    if (shuffler == NULL) {
+        free(vocab.words);
+        free(vocab.offsets);
+        return 1;
+    }
+    result = glove_count_cooccurrences(&cooccur_args, corpusIn, &vocab, shuffle_record, shuffler);
+    if (glove_shuffler_close(shuffler) != 0) result = 1;
+    if (result == 0) result = glove_train_vocab(&glove_args, shuffled, &vocab, gloveOut, gradsqOut, model);
+    free(vocab.words); // Still here if training did not start
+    free(vocab.offsets);
+    if (shufCooccurOut == NULL) remove(shuffled);
+    return result;
+}
@@ -0,0 +1,63 @@
+//  Entry points through which glovePipeline hands data from one stage to the next in memory, and helpers the stages
+//  share; not part of the public API
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#ifndef GLOVE_PIPELINE_H
+#define GLOVE_PIPELINE_H
+
+#include <stddef.h>
+#include "../include/glove.h"
+
+/* Vocabulary in frequency rank order: word a is NUL terminated and starts at words + offsets[a], and offsets[size] is
+ * the end of the last word, the layout glove reads vocabulary files into */
+typedef struct glove_vocab {
+    long long size;
+    char *words;
+    long long *offsets;
+} GLOVE_VOCAB;
+
+/* Receives the cooccurrence records of cooccur in place of its output file, in the order they would be written */
+typedef void (*GLOVE_RECORD_SINK)(void *data, int word1, int word2, double val);
+
+typedef struct shuffle_context GLOVE_SHUFFLER;
+
+/* vocabCount, also leaving the vocabulary in *vocab; vocabOut may be NULL */
+int glove_count_vocab(const VocabCountArgs* args, const char* corpusIn, char* vocabOut, GLOVE_VOCAB* vocab);
+
+/* cooccur with the vocabulary in memory, sending the merged records to sink */
+int glove_count_cooccurrences(const CooccurArgs* args, const char* corpusIn, const GLOVE_VOCAB* vocab,
+                              GLOVE_RECORD_SINK sink, void* sinkData);
+
+/* shuffle fed one record at a time, through two half-size chunk buffers and a writer thread; glove_shuffler_close
+ * finishes the shuffle into shufCooccurOut and frees the shuffler. Its output differs from that of shuffle() with the
+ * same input, which it does not replace */
+GLOVE_SHUFFLER *glove_shuffler_open(const ShuffleArgs* args, const char* shufCooccurOut);
+void glove_shuffler_add(GLOVE_SHUFFLER* shuffler, int word1, int word2, double val);
+int glove_shuffler_close(GLOVE_SHUFFLER* shuffler);
+
+/* gloveTrain with the vocabulary in memory, which it takes over and frees; model may be NULL */
+int glove_train_vocab(const GloveArgs* args, const char* shufCooccurIn, GLOVE_VOCAB* vocab, char* gloveOut,
+                      char* gradsqOut, GloveModel** model);
+
+/* Write to out (of size bytes) the temporary file prefix of one call: head, the process id and a number no other call
+ * in this process has used, so concurrent calls given the same tempFile do not write over each other's files */
+void glove_temp_name(char* out, size_t size, const char* head);
+
+/* Write to out (of size bytes) the name of temporary chunk file number chunk under the prefix head, <head>_<chunk>.bin
+ * with at least four digits; 1, after reporting it, if the name does not fit */
+int glove_chunk_name(char* out, size_t size, const char* head, int chunk);
+
+#endif //GLOVE_PIPELINE_H
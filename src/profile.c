@@ -0,0 +1,301 @@
+//  Resource profiles of the pipeline stages
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  A span samples the process's clocks and counters when it begins and again when it ends, and keeps the differences.
+//  The stages call these functions with the profile of their args, and every call returns at once for a NULL profile,
+//  so an unprofiled run pays a pointer test per phase and nothing per record.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/glove.h"
+
+#if defined(_WIN32)
+#define PSAPI_VERSION 2 // GetProcessMemoryInfo from kernel32, without linking psapi.lib
+#include <windows.h>
+#include <psapi.h>
+#define LOCK(lock) AcquireSRWLockExclusive(lock)
+#define UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+typedef SRWLOCK LOCK_T;
+#else
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#define LOCK(lock) pthread_mutex_lock(lock)
+#define UNLOCK(lock) pthread_mutex_unlock(lock)
+typedef pthread_mutex_t LOCK_T;
+#endif
+
+#define INITIAL_SPANS 64
+
+/* Process clocks and counters at one moment */
+typedef struct sample {
+    double wall, cpu;
+    long long bytes_read, bytes_written, peak_rss;
+} SAMPLE;
+
+typedef struct span {
+    GloveProfileSpan s;
+    SAMPLE begin;
+    int open;
+} SPAN;
+
+struct _GloveProfile {
+    SPAN *spans;
+    int count, capacity;
+    double origin; // Wall clock when the profile was created, which span starts are relative to
+    LOCK_T lock; // Stages running on different threads may share a profile
+};
+
+#if defined(_WIN32)
+static double filetime_seconds(const FILETIME *t) {
+    return (((unsigned long long)t->dwHighDateTime << 32) | t->dwLowDateTime) * 1e-7;
+}
+#endif
+
+static void take_sample(SAMPLE *s) {
+#if defined(_WIN32)
+    LARGE_INTEGER count, frequency;
+    FILETIME creation, exit_time, kernel, user;
+    IO_COUNTERS io;
+    PROCESS_MEMORY_COUNTERS memory;
+    HANDLE process = GetCurrentProcess();
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    s->wall = (double)count.QuadPart / frequency.QuadPart;
+    s->cpu = GetProcessTimes(process, &creation, &exit_time, &kernel, &user) ? filetime_seconds(&kernel) + filetime_seconds(&user) : 0;
+    s->bytes_read = s->bytes_written = 0;
+    if (GetProcessIoCounters(process, &io)) {
+        s->bytes_read = (long long)io.ReadTransferCount;
+        s->bytes_written = (long long)io.WriteTransferCount;
+    }
+    s->peak_rss = GetProcessMemoryInfo(process, &memory, sizeof(memory)) ? (long long)memory.PeakWorkingSetSize : 0;
+#else
+    struct timespec t;
+    struct rusage usage;
+    char key[32];
+    long long value;
+    FILE *fin;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    s->wall = t.tv_sec + t.tv_nsec * 1e-9;
+    getrusage(RUSAGE_SELF, &usage);
+    s->cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+#if defined(__APPLE__)
+    s->peak_rss = usage.ru_maxrss; // Bytes on macOS
+#else
+    s->peak_rss = (long long)usage.ru_maxrss * 1024; // Kilobytes on Linux and the BSDs
+#endif
+    s->bytes_read = s->bytes_written = 0;
+    fin = fopen("/proc/self/io", "r"); // Linux only; elsewhere the byte counts stay 0
+    if (fin != NULL) {
+        while (fscanf(fin, "%31s %lld", key, &value) == 2) {
+            if (strcmp(key, "rchar:") == 0) s->bytes_read = value;
+            else if (strcmp(key, "wchar:") == 0) s->bytes_written = value;
+        }
+        fclose(fin);
+    }
+#endif
+}
+
+int gloveProfileCreate(GloveProfile** profile) {
+    SAMPLE now;
+    GloveProfile *p = (GloveProfile*)calloc(1, sizeof(GloveProfile));
+    *profile = NULL;
+    if (p == NULL) {fprintf(stderr, "Out of memory for a profile.\n"); return 1;}
+    p->spans = (SPAN*)malloc(INITIAL_SPANS * sizeof(SPAN));
+    if (p->spans == NULL) {fprintf(stderr, "Out of memory for a profile.\n"); free(p); return 1;}
+    p->capacity = INITIAL_SPANS;
+    take_sample(&now);
+    p->origin = now.wall;
+#if defined(_WIN32)
+    InitializeSRWLock(&p->lock);
+#else
+    pthread_mutex_init(&p->lock, NULL);
+#endif
+    *profile = p;
+    return 0;
+}
+
+int gloveProfileBegin(GloveProfile* profile, int parent, const char* name) {
+    SPAN *span, *grown;
+    char *copy;
+    int index;
+
+    if (profile == NULL) return -1;
+    copy = (char*)malloc(strlen(name) + 1); // Span names stay put when the span array grows
+    if (copy == NULL) return -1;
+    strcpy(copy, name);
+    LOCK(&profile->lock);
+    if (profile->count == profile->capacity) {
+        grown = (SPAN*)realloc(profile->spans, 2 * profile->capacity * sizeof(SPAN));
+        if (grown == NULL) {UNLOCK(&profile->lock); free(copy); return -1;}
+        profile->spans = grown;
+        profile->capacity *= 2;
+    }
+    index = profile->count++;
+    span = &profile->spans[index];
+    memset(span, 0, sizeof(SPAN));
+    span->s.name = copy;
+    span->s.parent = (parent >= 0 && parent < index) ? parent : -1;
+    span->s.depth = (span->s.parent >= 0) ? profile->spans[span->s.parent].s.depth + 1 : 0;
+    span->open = 1;
+    take_sample(&span->begin);
+    span->s.start = span->begin.wall - profile->origin;
+    UNLOCK(&profile->lock);
+    return index;
+}
+
+/* Whether span a is span b or lies within it */
+static int within(const GloveProfile *profile, int a, int b) {
+    for (; a > b; a = profile->spans[a].s.parent);
+    return a == b;
+}
+
+void gloveProfileEnd(GloveProfile* profile, int span) {
+    SAMPLE now;
+    SPAN *s;
+    int a;
+
+    if (profile == NULL || span < 0) return;
+    take_sample(&now);
+    LOCK(&profile->lock);
+    for (a = span; a < profile->count; a++) { // Spans are numbered after their parents, so the ones inside follow it
+        s = &profile->spans[a];
+        if (!s->open || !within(profile, a, span)) continue;
+        s->open = 0;
+        s->s.wallSeconds = now.wall - s->begin.wall;
+        s->s.cpuSeconds = now.cpu - s->begin.cpu;
+        s->s.bytesRead = now.bytes_read - s->begin.bytes_read;
+        s->s.bytesWritten = now.bytes_written - s->begin.bytes_written;
+        s->s.peakRss = now.peak_rss;
+    }
+    UNLOCK(&profile->lock);
+}
+
+void gloveProfileAddRecords(GloveProfile* profile, int span, long long records) {
+    if (profile == NULL || span < 0) return;
+    LOCK(&profile->lock);
+    profile->spans[span].s.records += records;
+    UNLOCK(&profile->lock);
+}
+
+void gloveProfileAddTempFile(GloveProfile* profile, int span, const char* fileName) {
+    long long size = 0;
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+#else
+    struct stat st;
+#endif
+
+    if (profile == NULL || span < 0) return;
+#if defined(_WIN32)
+    if (GetFileAttributesExA(fileName, GetFileExInfoStandard, &attributes))
+        size = ((long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+#else
+    if (stat(fileName, &st) == 0) size = st.st_size;
+#endif
+    LOCK(&profile->lock);
+    for (; span >= 0; span = profile->spans[span].s.parent) {
+        profile->spans[span].s.tempFiles++;
+        profile->spans[span].s.tempBytes += size;
+    }
+    UNLOCK(&profile->lock);
+}
+
+int gloveProfileCount(const GloveProfile* profile) {
+    return (profile == NULL) ? 0 : profile->count;
+}
+
+int gloveProfileGet(const GloveProfile* profile, int span, GloveProfileSpan* result) {
+    GloveProfile *p = (GloveProfile*)profile;
+    if (profile == NULL || span < 0 || span >= profile->count) return 1;
+    LOCK(&p->lock);
+    *result = profile->spans[span].s;
+    UNLOCK(&p->lock);
+    return 0;
+}
+
+/* Write s as a JSON string */
+static void write_string(FILE *fout, const char *s) {
+    fputc('"', fout);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') fprintf(fout, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(fout, "\\u%04x", (unsigned char)*s);
+        else fputc(*s, fout);
+    }
+    fputc('"', fout);
+}
+
+/* Write the measurements of a span as JSON members */
+static void write_measurements(FILE *fout, const GloveProfileSpan *s) {
+    fprintf(fout, "\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"bytes_read\": %lld, \"bytes_written\": %lld, "
+            "\"peak_rss\": %lld, \"temp_files\": %lld, \"temp_bytes\": %lld, \"records\": %lld",
+            s->wallSeconds, s->cpuSeconds, s->bytesRead, s->bytesWritten, s->peakRss, s->tempFiles, s->tempBytes, s->records);
+}
+
+int gloveProfileWrite(const GloveProfile* profile, const char* fileName, int format) {
+    GloveProfile *p = (GloveProfile*)profile;
+    const GloveProfileSpan *s;
+    FILE *fout;
+    int a, root;
+
+    if (profile == NULL) return 1;
+    fout = fopen(fileName, "w");
+    if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n", fileName); return 1;}
+    LOCK(&p->lock);
+    fprintf(fout, (format == GLOVE_PROFILE_CHROME_TRACE) ? "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" : "{\"spans\": [");
+    for (a = 0; a < profile->count; a++) {
+        s = &profile->spans[a].s;
+        fprintf(fout, (a > 0) ? ",\n  {" : "\n  {");
+        if (format == GLOVE_PROFILE_CHROME_TRACE) {
+            /* One complete event per span; each top-level span gets its own track, so stages that overlap in time
+             * still nest properly */
+            for (root = a; profile->spans[root].s.parent >= 0; root = profile->spans[root].s.parent);
+            fprintf(fout, "\"name\": ");
+            write_string(fout, s->name);
+            fprintf(fout, ", \"cat\": \"glove\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+                    root, s->start * 1e6, s->wallSeconds * 1e6);
+            write_measurements(fout, s);
+            fprintf(fout, "}}");
+        }
+        else {
+            fprintf(fout, "\"name\": ");
+            write_string(fout, s->name);
+            fprintf(fout, ", \"parent\": %d, \"depth\": %d, \"start\": %.6f, ", s->parent, s->depth, s->start);
+            write_measurements(fout, s);
+            fprintf(fout, "}");
+        }
+    }
+    fprintf(fout, "\n]}\n");
+    UNLOCK(&p->lock);
+    if (fclose(fout) != 0) {fprintf(stderr, "Unable to write file %s.\n", fileName); return 1;}
+    return 0;
+}
+
+void gloveProfileFree(GloveProfile* profile) {
+    int a;
+    if (profile == NULL) return;
+    for (a = 0; a < profile->count; a++) free((char*)profile->spans[a].s.name);
+    free(profile->spans);
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&profile->lock);
+#endif
+    free(profile);
+}
@@ -27,6 +27,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include "../include/glove.h"
+#include "pipeline.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
 
 #define MAX_STRING_LENGTH 1000
 
@@ -39,17 +47,29 @@ typedef struct cooccur_rec {
     real val;
 } CREC;
 
-static int verbose; // 0, 1, or 2
-static long long array_size; // size of chunks to shuffle individually
-static char *file_head; // temporary file string
-static real memory_limit; // soft limit, in gigabytes
-static FILE *in, *out;
-
-/* Efficient string comparison */
-static int scmp( char *s1, char *s2 ) {
-    while (*s1 != '\0' && *s1 == *s2) {s1++; s2++;}
-    return(*s1 - *s2);
-}
+/* State of one shuffle() call or shuffler, so concurrent calls do not share anything but rand(). shuffle() reads its
+ * input array_size records at a time, shuffling each chunk into a temporary file. The shuffler that glovePipeline feeds
+ * takes records one at a time into the first of two buffers of half that size; each full chunk is shuffled and written
+ * by a writer thread while the other buffer fills. Both merge the temporary files with shuffle_merge at the end. */
+typedef struct shuffle_context {
+    int verbose; // 0, 1, or 2
+    long long array_size; // size of chunks to shuffle individually, and of the merge buffer
+    long long chunk_length; // Records in each of the shuffler's two chunk buffers
+    char file_head[MAX_STRING_LENGTH]; // temporary file string
+    real memory_limit; // soft limit, in gigabytes
+    FILE *in, *out;
+    CREC *array, *spare; // Shuffler chunk being filled, and the previous one while the writer thread has it
+    long long fill, spare_fill, lines; // Records in array and in spare, and records added in all
+    int chunks; // Temporary files written or being written
+    int writing, failed; // Whether the writer thread runs, and whether a temporary file could not be written
+#if defined(_WIN32)
+    HANDLE writer;
+#else
+    pthread_t writer;
+#endif
+    GloveProfile *profile;
+    int profile_span, chunk_span; // Spans of this call and of its chunk phase, -1 when not profiling
+} SHUFFLE_CONTEXT;
 
 /* Generate uniformly distributed random long ints */
 static long rand_long(long n) {
@@ -81,31 +101,31 @@ static void fvShuffle(CREC *array, long n) {
 }
 
 /* Merge shuffled temporary files; doesn't necessarily produce a perfect shuffle, but good enough */
-static int shuffle_merge(int num) {
+static int shuffle_merge(SHUFFLE_CONTEXT *ctx, int num) {
     long i, j, k, l = 0;
-    int fidcounter = 0;
+    int fidcounter = 0, span = gloveProfileBegin(ctx->profile, ctx->profile_span, "merge");
     CREC *array;
-    char filename[MAX_STRING_LENGTH];
-    FILE **fid, *fout = out;
+    char filename[MAX_STRING_LENGTH + 32];
+    FILE **fid, *fout = ctx->out;
     
-    array = malloc(sizeof(CREC) * array_size);
+    array = malloc(sizeof(CREC) * ctx->array_size);
     fid = malloc(sizeof(FILE) * num);
     for (fidcounter = 0; fidcounter < num; fidcounter++) { //num = number of temporary files to merge
-        sprintf(filename,"%s_%04d.bin",file_head, fidcounter);
+        if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, fidcounter) != 0) return 1;
         fid[fidcounter] = fopen(filename, "rb");
         if (fid[fidcounter] == NULL) {
             fprintf(stderr, "Unable to open file %s.\n",filename);
             return 1;
         }
     }
-    if (verbose > 0) fprintf(stderr, "Merging temp files: processed %ld lines.", l);
+    if (ctx->verbose > 0) fprintf(stderr, "Merging temp files: processed %ld lines.", l);
     
     while (1) { //Loop until EOF in all files
         i = 0;
         //Read at most array_size values into array, roughly array_size/num from each temp file
         for (j = 0; j < num; j++) {
             if (feof(fid[j])) continue;
-            for (k = 0; k < array_size / num; k++){
+            for (k = 0; k < ctx->array_size / num; k++){
                 fread(&array[i], sizeof(CREC), 1, fid[j]);
                 if (feof(fid[j])) break;
                 i++;
@@ -115,47 +135,50 @@ static int shuffle_merge(int num) {
         l += i;
       fvShuffle(array, i - 1); // Shuffles lines between temp files
         write_chunk(array,i,fout);
-        if (verbose > 0) fprintf(stderr, "\033[31G%ld lines.", l);
+        if (ctx->verbose > 0) fprintf(stderr, "\033[31G%ld lines.", l);
     }
+    fflush(fout);
     fprintf(stderr, "\033[0GMerging temp files: processed %ld lines.", l);
     for (fidcounter = 0; fidcounter < num; fidcounter++) {
         fclose(fid[fidcounter]);
-        sprintf(filename,"%s_%04d.bin",file_head, fidcounter);
-        remove(filename);
+        if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, fidcounter) == 0) remove(filename);
     }
+    gloveProfileAddRecords(ctx->profile, span, l);
+    gloveProfileEnd(ctx->profile, span);
     fprintf(stderr, "\n\n");
     free(array);
     return 0;
 }
 
 /* Shuffle large input stream by splitting into chunks */
-static int shuffle_by_chunks() {
+static int shuffle_by_chunks(SHUFFLE_CONTEXT *ctx) {
     long i = 0, l = 0;
-    int fidcounter = 0;
-    char filename[MAX_STRING_LENGTH];
+    int fidcounter = 0, span = gloveProfileBegin(ctx->profile, ctx->profile_span, "chunks");
+    char filename[MAX_STRING_LENGTH + 32];
     CREC *array;
-    FILE *fin = in, *fid;
-    array = malloc(sizeof(CREC) * array_size);
+    FILE *fin = ctx->in, *fid;
+    array = malloc(sizeof(CREC) * ctx->array_size);
     
     fprintf(stderr,"SHUFFLING COOCCURRENCES\n");
-    if (verbose > 0) fprintf(stderr,"array size: %lld\n", array_size);
-    sprintf(filename,"%s_%04d.bin",file_head, fidcounter);
+    if (ctx->verbose > 0) fprintf(stderr,"array size: %lld\n", ctx->array_size);
+    if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, fidcounter) != 0) return 1;
     fid = fopen(filename,"wb");
     if (fid == NULL) {
         fprintf(stderr, "Unable to open file %s.\n",filename);
         return 1;
     }
-    if (verbose > 1) fprintf(stderr, "Shuffling by chunks: processed 0 lines.");
+    if (ctx->verbose > 1) fprintf(stderr, "Shuffling by chunks: processed 0 lines.");
     
     while (1) { //Continue until EOF
-        if (i >= array_size) {// If array is full, shuffle it and save to temporary file
+        if (i >= ctx->array_size) {// If array is full, shuffle it and save to temporary file
           fvShuffle(array, i - 2);
             l += i;
-            if (verbose > 1) fprintf(stderr, "\033[22Gprocessed %ld lines.", l);
+            if (ctx->verbose > 1) fprintf(stderr, "\033[22Gprocessed %ld lines.", l);
             write_chunk(array,i,fid);
             fclose(fid);
+            gloveProfileAddTempFile(ctx->profile, span, filename);
             fidcounter++;
-            sprintf(filename,"%s_%04d.bin",file_head, fidcounter);
+            if (glove_chunk_name(filename, sizeof(filename), ctx->file_head, fidcounter) != 0) return 1;
             fid = fopen(filename,"wb");
             if (fid == NULL) {
                 fprintf(stderr, "Unable to open file %s.\n",filename);
@@ -170,15 +193,76 @@ static int shuffle_by_chunks() {
   fvShuffle(array, i - 2); //Last chunk may be smaller than array_size
     write_chunk(array,i,fid);
     l += i;
-    if (verbose > 1) fprintf(stderr, "\033[22Gprocessed %ld lines.\n", l);
-    if (verbose > 1) fprintf(stderr, "Wrote %d temporary file(s).\n", fidcounter + 1);
+    if (ctx->verbose > 1) fprintf(stderr, "\033[22Gprocessed %ld lines.\n", l);
+    if (ctx->verbose > 1) fprintf(stderr, "Wrote %d temporary file(s).\n", fidcounter + 1);
     fclose(fid);
+    gloveProfileAddTempFile(ctx->profile, span, filename);
+    gloveProfileAddRecords(ctx->profile, span, l);
+    gloveProfileAddRecords(ctx->profile, ctx->profile_span, l);
+    gloveProfileEnd(ctx->profile, span);
     free(array);
-    return shuffle_merge(fidcounter + 1); // Merge and shuffle together temporary files
+    return shuffle_merge(ctx, fidcounter + 1); // Merge and shuffle together temporary files
+}
+
+/* Shuffle the chunk in spare and write it to the next temporary file; runs on the writer thread */
+static void *
+#if defined(_WIN32)
+__stdcall
+#endif
+chunk_writer(void *vctx) {
+    SHUFFLE_CONTEXT *ctx = (SHUFFLE_CONTEXT*)vctx;
+    char filename[MAX_STRING_LENGTH + 32];
+    FILE *fid;
+
+    fvShuffle(ctx->spare, ctx->spare_fill);
+    fid = (glove_chunk_name(filename, sizeof(filename), ctx->file_head, ctx->chunks - 1) == 0) ? fopen(filename,"wb") : NULL;
+    if (fid == NULL) {
+        fprintf(stderr, "Unable to open file %s.\n",filename);
+        ctx->failed = 1;
+        return NULL;
+    }
+    write_chunk(ctx->spare, ctx->spare_fill, fid);
+    if (fclose(fid) != 0) {fprintf(stderr, "Unable to write file %s.\n",filename); ctx->failed = 1;}
+    gloveProfileAddTempFile(ctx->profile, ctx->chunk_span, filename);
+    return NULL;
+}
+
+static void wait_writer(SHUFFLE_CONTEXT *ctx) {
+    if (!ctx->writing) return;
+#if defined(_WIN32)
+    WaitForSingleObject(ctx->writer, INFINITE);
+    CloseHandle(ctx->writer);
+#else
+    pthread_join(ctx->writer, NULL);
+#endif
+    ctx->writing = 0;
+}
+
+/* Give the full chunk to the writer thread, once it is done with the previous one, and start filling the other buffer */
+static void hand_off(SHUFFLE_CONTEXT *ctx, int background) {
+    CREC *full = ctx->array;
+    wait_writer(ctx);
+    ctx->array = ctx->spare;
+    ctx->spare = full;
+    ctx->spare_fill = ctx->fill;
+    ctx->lines += ctx->fill;
+    ctx->fill = 0;
+    ctx->chunks++;
+    if (ctx->verbose > 1) fprintf(stderr, "\033[22Gprocessed %lld lines.", ctx->lines);
+    if (!background) {
+        chunk_writer(ctx);
+        return;
+    }
+    ctx->writing = 1;
+#if defined(_WIN32)
+    ctx->writer = (HANDLE)_beginthreadex(NULL, 0, (unsigned (__stdcall *)(void *))chunk_writer, ctx, 0, NULL);
+#else
+    pthread_create(&ctx->writer, NULL, chunk_writer, ctx);
+#endif
 }
 
 static const ShuffleArgs DEFAULT_SHUFFLE_ARGS = {
-        .verbose = 0, .memory = 4.f, .arraySize = -1, .tempFile = "temp_shuffle", .mode = 0
+        .verbose = 0, .memory = 4.f, .arraySize = -1, .tempFile = "temp_shuffle", .mode = 0, .profile = NULL
 };
 
 int createShuffleArgs(ShuffleArgs* emptyArgs) {
@@ -187,23 +271,102 @@ int createShuffleArgs(ShuffleArgs* emptyArgs) {
 }
 
 int shuffle(const ShuffleArgs* args, const char* cooccurIn, char* shufCooccurOut) {
-    file_head = malloc(sizeof(char) * MAX_STRING_LENGTH);
+    SHUFFLE_CONTEXT ctx;
+    int result;
 
-    verbose = args->verbose;
-    strcpy(file_head, args->tempFile);
-    memory_limit = args->memory;
+    ctx.verbose = args->verbose;
+    glove_temp_name(ctx.file_head, MAX_STRING_LENGTH - 16, args->tempFile); // Room for the _0000.bin suffixes
+    ctx.memory_limit = args->memory;
+    ctx.profile = args->profile;
 
-    in = fopen(cooccurIn, "rb");
-    if (in == NULL) { fprintf(stderr,"Unable to open file %s.\n", cooccurIn); return 1; }
-    out = fopen(shufCooccurOut, "wb");
-    if (out == NULL) { fprintf(stderr,"Unable to open file %s.\n", shufCooccurOut); return 1; }
+    ctx.in = fopen(cooccurIn, "rb");
+    if (ctx.in == NULL) { fprintf(stderr,"Unable to open file %s.\n", cooccurIn); return 1; }
+    ctx.out = fopen(shufCooccurOut, "wb");
+    if (ctx.out == NULL) { fprintf(stderr,"Unable to open file %s.\n", shufCooccurOut); fclose(ctx.in); return 1; }
 
-    if (args->arraySize > 0) { array_size = args->arraySize; }
-    else { array_size = (long long) (0.95 * (real) memory_limit * 1073741824 / (sizeof(CREC))); }
+    if (args->arraySize > 0) { ctx.array_size = args->arraySize; }
+    else { ctx.array_size = (long long) (0.95 * (real) ctx.memory_limit * 1073741824 / (sizeof(CREC))); }
 
-    int result = shuffle_by_chunks();
-    fclose(in);
-    fclose(out);
+    ctx.profile_span = gloveProfileBegin(ctx.profile, -1, "shuffle");
+    result = shuffle_by_chunks(&ctx);
+    fclose(ctx.in);
+    fclose(ctx.out);
+    gloveProfileEnd(ctx.profile, ctx.profile_span);
     return result;
 }
 
+GLOVE_SHUFFLER *glove_shuffler_open(const ShuffleArgs* args, const char* shufCooccurOut) {
+    SHUFFLE_CONTEXT *ctx = (SHUFFLE_CONTEXT*)calloc(1, sizeof(SHUFFLE_CONTEXT));
+
+    ctx->verbose = args->verbose;
+    glove_temp_name(ctx->file_head, MAX_STRING_LENGTH - 16, args->tempFile); // Room for the _0000.bin suffixes
+    ctx->memory_limit = args->memory;
+    ctx->profile = args->profile;
+
+    if (args->arraySize > 0) { ctx->array_size = args->arraySize; }
+    else { ctx->array_size = (long long) (0.95 * (real) ctx->memory_limit * 1073741824 / (sizeof(CREC))); }
+    ctx->chunk_length = (ctx->array_size > 1) ? ctx->array_size / 2 : 1;
+
+    ctx->out = fopen(shufCooccurOut, "wb");
+    if (ctx->out == NULL) { fprintf(stderr,"Unable to open file %s.\n", shufCooccurOut); free(ctx); return NULL; }
+    ctx->array = (CREC*)malloc(sizeof(CREC) * ctx->chunk_length);
+    ctx->spare = (CREC*)malloc(sizeof(CREC) * ctx->chunk_length);
+    if (ctx->array == NULL || ctx->spare == NULL) {
+        fprintf(stderr, "Unable to allocate two chunks of %lld records.\n", ctx->chunk_length);
+        free(ctx->array);
+        free(ctx->spare);
+        fclose(ctx->out);
+        free(ctx);
+        return NULL;
+    }
+
+    ctx->profile_span = gloveProfileBegin(ctx->profile, -1, "shuffle");
+    ctx->chunk_span = gloveProfileBegin(ctx->profile, ctx->profile_span, "chunks");
+    fprintf(stderr,"SHUFFLING COOCCURRENCES\n");
+    if (ctx->verbose > 0) fprintf(stderr,"array size: %lld\n", ctx->array_size);
+    if (ctx->verbose > 1) fprintf(stderr, "Shuffling by chunks: processed 0 lines.");
+    return ctx;
+}
+
+void glove_shuffler_add(GLOVE_SHUFFLER* ctx, int word1, int word2, double val) {
+    CREC *cr = &ctx->array[ctx->fill++];
+    cr->word1 = word1;
+    cr->word2 = word2;
+    cr->val = val;
+    if (ctx->fill == ctx->chunk_length) hand_off(ctx, 1);
+}
+
+int glove_shuffler_close(GLOVE_SHUFFLER* ctx) {
+    int result = 0;
+
+    wait_writer(ctx);
+    if (ctx->chunks == 0) {
+        /* Everything fit in one chunk: shuffle it in memory and write it out, without temporary files */
+        ctx->lines = ctx->fill;
+        fvShuffle(ctx->array, ctx->fill);
+        write_chunk(ctx->array, ctx->fill, ctx->out);
+        fflush(ctx->out);
+        if (ctx->verbose > 1) fprintf(stderr, "\033[22Gprocessed %lld lines.\n", ctx->lines);
+        fprintf(stderr, "Shuffled %lld lines in memory.\n\n", ctx->lines);
+        gloveProfileAddRecords(ctx->profile, ctx->chunk_span, ctx->lines);
+        gloveProfileEnd(ctx->profile, ctx->chunk_span);
+    }
+    else {
+        if (ctx->fill > 0) hand_off(ctx, 0); // Last chunk may be smaller than chunk_length
+        if (ctx->verbose > 1) fprintf(stderr, "\n");
+        if (ctx->verbose > 1) fprintf(stderr, "Wrote %d temporary file(s).\n", ctx->chunks);
+        gloveProfileAddRecords(ctx->profile, ctx->chunk_span, ctx->lines);
+        gloveProfileEnd(ctx->profile, ctx->chunk_span);
+        free(ctx->array);
+        free(ctx->spare);
+        ctx->array = ctx->spare = NULL;
+        result = ctx->failed ? 1 : shuffle_merge(ctx, ctx->chunks); // Merge and shuffle together temporary files
+    }
+    gloveProfileAddRecords(ctx->profile, ctx->profile_span, ctx->lines);
+    if (fclose(ctx->out) != 0) {fprintf(stderr, "Unable to write the shuffled cooccurrences.\n"); result = 1;}
+    gloveProfileEnd(ctx->profile, ctx->profile_span);
+    free(ctx->array);
+    free(ctx->spare);
+    free(ctx);
+    return result;
+}
@@ -0,0 +1,763 @@
+//  Word vectors loaded for queries, and nearest neighbor search over them
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  Rows are kept as floats, normalized to unit length and padded to a multiple of 64 bytes, so cosine similarity is a
+//  plain dot product. A batch of queries is scored by splitting the rows between threads; each thread walks its rows
+//  in blocks that fit in the L2 cache and multiplies every block with QUERY_BLOCK queries at a time, feeding the scores
+//  into one bounded min-heap per query. The heaps of all threads are merged at the end.
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/glove.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#include <malloc.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define VECTOR_ALIGNMENT 64
+#define ROW_BLOCK_BYTES (256 * 1024) // Rows scored against every query before moving on, sized to stay in the L2 cache
+#define QUERY_BLOCK 4 // Queries multiplied with each row at once
+#define HASH_SEED 1159241
+#define EMPTY_SCORE (-FLT_MAX) // Score of unfilled heap entries, below any cosine
+#define MIN_CHUNK_BYTES (1 << 20) // Smallest share of a text file worth a thread of its own
+#define MAX_MANTISSA 100000000000000000ULL // Digits of a number beyond 18 significant ones are dropped
+#define MAX_EXACT_POWER 22 // Largest power of ten that is exact in double precision
+
+static const double POWERS_OF_TEN[MAX_EXACT_POWER + 1] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+struct _GloveVectors {
+    long long count, stride; // Rows, and floats per row including the padding
+    int size;
+    float *rows; // count rows of stride floats, unit length unless all zero
+    char *words; // Words, each NUL terminated, starting at word_offsets
+    long long *word_offsets;
+    long long *table, table_size; // Open addressing hash of words to rows, -1 for empty slots
+};
+
+typedef struct neighbor {
+    float score;
+    long long row;
+} NEIGHBOR;
+
+/* State of one gloveVectorsNearest call */
+typedef struct nearest_context {
+    const GloveVectors *vectors;
+    const float *queries; // Normalized and padded, count rounded up to a multiple of QUERY_BLOCK (extra ones zero)
+    int count, k, threads;
+    NEIGHBOR *heaps; // k entries for each thread and query, heaps[(thread * count + query) * k], min-heaps on score
+} NEAREST_CONTEXT;
+
+/* State of one parallel parse of a text file */
+typedef struct text_context {
+    char *text;
+    long long *chunks; // Chunk t of whole lines is text[chunks[t] .. chunks[t + 1])
+    long long *rows; // Chunk t holds rows rows[t] .. rows[t + 1] - 1
+    long long *bad_rows; // First row of each chunk that does not parse, or -1
+    char **words; // Words of each chunk, with offsets into them in v->word_offsets until they are joined
+    long long *words_used;
+    GloveVectors *v;
+} TEXT_CONTEXT;
+
+typedef struct thread_arg {
+    void *ctx;
+    long long id;
+} THREAD_ARG;
+
+#if defined(_WIN32)
+typedef void *(__stdcall *thread_fn)(void *);
+#else
+typedef void *(*thread_fn)(void *);
+#endif
+
+/* Run fn on count threads, passing each a THREAD_ARG with ctx and its id (0 .. count - 1), and wait for all of them */
+static void run_threads(void *ctx, thread_fn fn, int count) {
+    long long a;
+    THREAD_ARG *thread_ids = (THREAD_ARG*)malloc(sizeof(THREAD_ARG) * count);
+    for (a = 0; a < count; a++) {
+        thread_ids[a].ctx = ctx;
+        thread_ids[a].id = a;
+    }
+#if defined (_WIN32)
+    HANDLE *wt = (HANDLE*)malloc(count * sizeof(HANDLE));
+    for (a = 0; a < count; a++) wt[a] = (HANDLE)_beginthreadex(NULL, 0, (unsigned (__stdcall *)(void *))fn, (void*)&thread_ids[a], 0, NULL);
+    for (a = 0; a < count; a++) WaitForSingleObject(wt[a], INFINITE);
+    free(wt);
+#else
+    pthread_t *pt = (pthread_t *)malloc(count * sizeof(pthread_t));
+    for (a = 0; a < count; a++) pthread_create(&pt[a], NULL, fn, (void *)&thread_ids[a]);
+    for (a = 0; a < count; a++) pthread_join(pt[a], NULL);
+    free(pt);
+#endif
+    free(thread_ids);
+}
+
+/* Processors available to this process */
+static int processor_count() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+#endif
+}
+
+/* Zeroed memory aligned to VECTOR_ALIGNMENT, released with free_aligned; NULL if out of memory */
+static float *alloc_aligned(long long count) {
+    void *p;
+#if defined(_WIN32)
+    p = _aligned_malloc(count * sizeof(float), VECTOR_ALIGNMENT);
+#else
+    if (posix_memalign(&p, VECTOR_ALIGNMENT, count * sizeof(float)) != 0) p = NULL;
+#endif
+    if (p != NULL) memset(p, 0, count * sizeof(float));
+    return (float*)p;
+}
+
+static void free_aligned(float *p) {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+/* Simple bitwise hash function */
+static unsigned int bitwisehash(const char *word, long long tsize, unsigned int seed) {
+    char c;
+    unsigned int h;
+    h = seed;
+    for (; (c =* word) != '\0'; word++) h ^= ((h << 5) + c + (h >> 2));
+    return(((h&0x7fffffff) % tsize));
+}
+
+/* A handle for count rows of size values, with zeroed rows and room for words_bytes bytes of words; NULL if out of
+ * memory */
+static GloveVectors *new_vectors(long long count, int size, long long words_bytes) {
+    GloveVectors *v = (GloveVectors*)calloc(1, sizeof(GloveVectors));
+    v->count = count;
+    v->size = size;
+    v->stride = (size + VECTOR_ALIGNMENT / sizeof(float) - 1) / (VECTOR_ALIGNMENT / sizeof(float)) * (VECTOR_ALIGNMENT / sizeof(float));
+    v->rows = alloc_aligned(count * v->stride);
+    v->words = (char*)malloc(words_bytes);
+    v->word_offsets = (long long*)malloc((count + 1) * sizeof(long long));
+    if (v->rows == NULL || v->words == NULL || v->word_offsets == NULL) {
+        gloveVectorsFree(v);
+        return NULL;
+    }
+    return v;
+}
+
+/* Scale a vector of n floats to unit length; all zero vectors are left as they are */
+static void normalize(float *x, long long n) {
+    long long a;
+    double norm = 0;
+    for (a = 0; a < n; a++) norm += (double)x[a] * x[a];
+    if (norm > 0) for (a = 0, norm = 1 / sqrt(norm); a < n; a++) x[a] = (float)(x[a] * norm);
+}
+
+/* Normalize the rows and hash the words of a filled in handle */
+static void finish_vectors(GloveVectors *v) {
+    long long a, slot;
+    for (a = 0; a < v->count; a++) normalize(v->rows + a * v->stride, v->size);
+    v->table_size = 2 * v->count + 1;
+    v->table = (long long*)malloc(v->table_size * sizeof(long long));
+    for (a = 0; a < v->table_size; a++) v->table[a] = -1;
+    for (a = 0; a < v->count; a++) {
+        slot = bitwisehash(v->words + v->word_offsets[a], v->table_size, HASH_SEED);
+        while (v->table[slot] >= 0) slot = (slot + 1) % v->table_size;
+        v->table[slot] = a;
+    }
+}
+
+/* Read a whole file into a NUL terminated buffer; prints an error and returns NULL on failure */
+static char *read_file(const char *file_name, long long *length) {
+    char *text;
+    FILE *fin = fopen(file_name, "rb");
+    if (fin == NULL) {fprintf(stderr, "Unable to open file %s.\n", file_name); return NULL;}
+    fseek(fin, 0, SEEK_END);
+    *length = ftell(fin);
+    rewind(fin);
+    text = (char*)malloc(*length + 1);
+    if (text == NULL || (long long)fread(text, 1, *length, fin) != *length) {
+        fprintf(stderr, "Unable to read file %s.\n", file_name);
+        free(text);
+        fclose(fin);
+        return NULL;
+    }
+    text[*length] = '\0';
+    fclose(fin);
+    return text;
+}
+
+/* Number of non-empty lines of text */
+static long long count_lines(const char *text, long long length) {
+    long long a, lines = 0;
+    for (a = 0; a < length; a++) if (text[a] != '\n' && (a + 1 == length || text[a + 1] == '\n')) lines++;
+    return lines;
+}
+
+/* Skip spaces, tabs and carriage returns, but not the end of the line */
+static char *skip_blanks(char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+/* Skip to the first blank or the end of the line */
+static char *skip_field(char *p) {
+    while (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '\0') p++;
+    return p;
+}
+
+/* Number of blank separated fields of the line at p */
+static int count_fields(char *p) {
+    int fields = 0;
+    for (p = skip_blanks(p); *p != '\n' && *p != '\0'; p = skip_blanks(skip_field(p))) fields++;
+    return fields;
+}
+
+/* Size given by a word2vec style "<rows> <size>" first line, or 0 if the line at p is not one */
+static int header_size(char *p) {
+    long long fields[2] = {0, 0};
+    int n;
+    for (n = 0; n < 2; n++) {
+        p = skip_blanks(p);
+        if (*p < '0' || *p > '9') return 0;
+        for (; *p >= '0' && *p <= '9'; p++) if (fields[n] < INT_MAX) fields[n] = 10 * fields[n] + (*p - '0');
+    }
+    p = skip_blanks(p);
+    return ((*p == '\n' || *p == '\0') && fields[1] < INT_MAX) ? (int)fields[1] : 0;
+}
+
+/* Parse the decimal number at p into a float, setting *end past it, or to p if there is none. Numbers of up to 18
+ * significant digits and exponents within 22, which covers what glove and the published vector files write, are a
+ * product or quotient of two exactly represented doubles, rounded once more to float; this can differ from strtof
+ * only when the value lies within about 1e-16 of halfway between two floats. Everything else (inf, nan, hex floats,
+ * extreme exponents) is left to strtof */
+static float parse_float(char *p, char **end) {
+    char *start = p;
+    unsigned long long mantissa = 0;
+    int negative = 0, exponent = 0, digits = 0, e = 0, e_negative = 0;
+    double x;
+
+    if (*p == '-') {negative = 1; p++;}
+    else if (*p == '+') p++;
+    for (; *p >= '0' && *p <= '9'; p++, digits++) {
+        if (mantissa < MAX_MANTISSA) mantissa = 10 * mantissa + (*p - '0');
+        else exponent++;
+    }
+    if (*p == '.') {
+        for (p++; *p >= '0' && *p <= '9'; p++, digits++)
+            if (mantissa < MAX_MANTISSA) {
+                mantissa = 10 * mantissa + (*p - '0');
+                exponent--;
+            }
+    }
+    if (digits == 0) return strtof(start, end);
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '-') {e_negative = 1; p++;}
+        else if (*p == '+') p++;
+        if (*p < '0' || *p > '9') return strtof(start, end);
+        for (; *p >= '0' && *p <= '9'; p++) if (e < 10000) e = 10 * e + (*p - '0');
+        exponent += e_negative ? -e : e;
+    }
+    if (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '\0') {*end = start; return 0;} // e.g. "1st"
+    if (exponent < -MAX_EXACT_POWER || exponent > MAX_EXACT_POWER) return strtof(start, end);
+    x = (exponent < 0) ? (double)mantissa / POWERS_OF_TEN[-exponent] : (double)mantissa * POWERS_OF_TEN[exponent];
+    *end = p;
+    return (float)(negative ? -x : x);
+}
+
+/* Parse the "word value value ..." line at *line into size floats at row, setting *word and *word_length to the word
+ * in place and *line to the end of the line; returns 1 if it does not hold a word and size values */
+static int parse_line(char **line, int size, float *row, char **word, long long *word_length) {
+    char *p, *end;
+    int n, fields;
+
+    *word = *line;
+    p = skip_field(*line);
+    *word_length = p - *word;
+    for (n = 0; ; n++) {
+        p = skip_blanks(p);
+        if (*p == '\n' || *p == '\0' || n == size) break;
+        row[n] = parse_float(p, &end);
+        if (end == p) break;
+        p = end;
+    }
+    if (n == size && (*p == '\n' || *p == '\0')) {*line = p; return 0;}
+
+    /* Some published files have words holding spaces, like ". . ." in the Common Crawl vectors: the values are then
+     * the last size fields, and the word is everything before them */
+    if ((fields = count_fields(*line)) <= size) return 1;
+    for (p = *line, n = 1; n < fields - size; n++) p = skip_blanks(skip_field(p));
+    p = skip_field(p);
+    *word_length = p - *word;
+    for (n = 0; n < size; n++) {
+        p = skip_blanks(p);
+        row[n] = parse_float(p, &end);
+        if (end == p) return 1;
+        p = end;
+    }
+    p = skip_blanks(p);
+    if (*p != '\n' && *p != '\0') return 1;
+    *line = p;
+    return 0;
+}
+
+/* Count the rows of this thread's chunk */
+static void *count_rows_thread(void *arg) {
+    TEXT_CONTEXT *ctx = (TEXT_CONTEXT*)((THREAD_ARG*)arg)->ctx;
+    long long id = ((THREAD_ARG*)arg)->id;
+    ctx->rows[id + 1] = count_lines(ctx->text + ctx->chunks[id], ctx->chunks[id + 1] - ctx->chunks[id]);
+    return NULL;
+}
+
+/* Parse the rows of this thread's chunk, copying their words to a buffer of the chunk */
+static void *parse_rows_thread(void *arg) {
+    TEXT_CONTEXT *ctx = (TEXT_CONTEXT*)((THREAD_ARG*)arg)->ctx;
+    long long id = ((THREAD_ARG*)arg)->id;
+    GloveVectors *v = ctx->v;
+    long long row, length, used = 0, capacity = 16 * (ctx->rows[id + 1] - ctx->rows[id]) + 64;
+    char *p = ctx->text + ctx->chunks[id], *word, *words = (char*)malloc(capacity);
+
+    for (row = ctx->rows[id]; row < ctx->rows[id + 1]; row++) {
+        while (*p == '\n') p++;
+        if (parse_line(&p, v->size, v->rows + row * v->stride, &word, &length) != 0) {ctx->bad_rows[id] = row; break;}
+        if (used + length + 1 > capacity) {
+            capacity = 2 * capacity + length + 1;
+            words = (char*)realloc(words, capacity);
+        }
+        v->word_offsets[row] = used;
+        memcpy(words + used, word, length);
+        used += length;
+        words[used++] = '\0';
+    }
+    ctx->words[id] = words;
+    ctx->words_used[id] = used;
+    return NULL;
+}
+
+/* Words and vectors, not yet normalized, of a text file with one "word value value ..." line per row, as written by
+ * glove; a word2vec style "<rows> <size>" first line is skipped. The file is split between threads at line
+ * boundaries: each counts the rows of its chunk, and then, knowing its first row, parses them in place */
+static int parse_text(const char *file_name, int threads, GloveVectors **vectors) {
+    TEXT_CONTEXT ctx;
+    long long length, start, lines, used = 0, a, t, header = 0, bad = -1;
+    int size;
+    char *text = read_file(file_name, &length), *p;
+    GloveVectors *v;
+
+    *vectors = NULL;
+    if (text == NULL) return 1;
+    for (p = text; *p == '\n'; p++);
+    if ((size = header_size(p)) > 0) {
+        header = 1;
+        while (*p != '\n' && *p != '\0') p++;
+        while (*p == '\n') p++;
+    }
+    else size = count_fields(p) - 1;
+    start = p - text;
+    if (threads > (length - start) / MIN_CHUNK_BYTES + 1) threads = (int)((length - start) / MIN_CHUNK_BYTES + 1);
+    if (threads < 1) threads = 1;
+
+    ctx.text = text;
+    ctx.chunks = (long long*)malloc((threads + 1) * sizeof(long long));
+    ctx.rows = (long long*)calloc(threads + 1, sizeof(long long));
+    ctx.bad_rows = (long long*)malloc(threads * sizeof(long long));
+    ctx.words = (char**)calloc(threads, sizeof(char*));
+    ctx.words_used = (long long*)calloc(threads, sizeof(long long));
+    for (t = 0; t <= threads; t++) {
+        a = (t == threads) ? length : start + (length - start) * t / threads;
+        if (t > 0) while (a < length && text[a - 1] != '\n') a++;
+        ctx.chunks[t] = a;
+    }
+    run_threads(&ctx, count_rows_thread, threads);
+    for (t = 0; t < threads; t++) {
+        ctx.rows[t + 1] += ctx.rows[t];
+        ctx.bad_rows[t] = -1;
+    }
+    lines = ctx.rows[threads];
+    if (lines == 0 || size < 1) {
+        fprintf(stderr, "%s holds no word vectors.\n", file_name);
+        v = NULL;
+        goto cleanup;
+    }
+    if ((ctx.v = v = new_vectors(lines, size, 1)) == NULL) {
+        fprintf(stderr, "Out of memory loading %s.\n", file_name);
+        goto cleanup;
+    }
+    run_threads(&ctx, parse_rows_thread, threads);
+
+    for (t = 0; t < threads && bad < 0; t++) bad = ctx.bad_rows[t];
+    for (t = 0; t < threads; t++) used += ctx.words_used[t];
+    free(v->words);
+    if (bad >= 0 || (v->words = (char*)malloc(used)) == NULL) {
+        if (bad >= 0) fprintf(stderr, "Line %lld of %s does not hold a word and %d values.\n", bad + header + 1, file_name, size);
+        else fprintf(stderr, "Out of memory loading %s.\n", file_name);
+        v->words = NULL;
+        gloveVectorsFree(v);
+        v = NULL;
+        goto cleanup;
+    }
+    for (t = 0, used = 0; t < threads; t++) { // Join the words of the chunks
+        memcpy(v->words + used, ctx.words[t], ctx.words_used[t]);
+        for (a = ctx.rows[t]; a < ctx.rows[t + 1]; a++) v->word_offsets[a] += used;
+        used += ctx.words_used[t];
+    }
+    v->word_offsets[lines] = used;
+
+cleanup:
+    for (t = 0; t < threads; t++) free(ctx.words[t]);
+    free(ctx.words);
+    free(ctx.words_used);
+    free(ctx.bad_rows);
+    free(ctx.rows);
+    free(ctx.chunks);
+    free(text);
+    *vectors = v;
+    return (v == NULL) ? 1 : 0;
+}
+
+/* Words and normalized vectors of a text file, parsed on one thread per processor */
+static int load_text(const char *file_name, GloveVectors **vectors) {
+    if (parse_text(file_name, processor_count(), vectors) != 0) return 1;
+    finish_vectors(*vectors);
+    return 0;
+}
+
+/* Word + context vectors of the headerless binary parameter file written by glove (binary 1 or 2), whose words are
+ * those of the vocabulary file */
+static int load_binary(const char *file_name, const char *vocab_file, GloveVectors **vectors) {
+    long long vocab_length, lines, row, used = 0, a, bytes;
+    int size;
+    char *vocab = read_file(vocab_file, &vocab_length), *p, *word;
+    double *values;
+    GloveVectors *v;
+    FILE *fin;
+
+    if (vocab == NULL) return 1;
+    lines = count_lines(vocab, vocab_length);
+    fin = fopen(file_name, "rb");
+    if (fin == NULL) {fprintf(stderr, "Unable to open file %s.\n", file_name); free(vocab); return 1;}
+    fseek(fin, 0, SEEK_END);
+    bytes = ftell(fin);
+    rewind(fin);
+    if (lines == 0 || bytes % (2 * lines * sizeof(double)) != 0 || (size = (int)(bytes / (2 * lines * sizeof(double))) - 1) < 1) {
+        fprintf(stderr, "The size of %s does not match the %lld words of %s.\n", file_name, lines, vocab_file);
+        fclose(fin);
+        free(vocab);
+        return 1;
+    }
+    if ((v = new_vectors(lines, size, vocab_length + 1)) == NULL) {
+        fprintf(stderr, "Out of memory loading %s.\n", file_name);
+        fclose(fin);
+        free(vocab);
+        return 1;
+    }
+    for (p = vocab, row = 0; row < lines; row++) {
+        while (*p == '\n') p++;
+        for (word = p; *p != ' ' && *p != '\n' && *p != '\0'; p++);
+        v->word_offsets[row] = used;
+        memcpy(v->words + used, word, p - word);
+        used += p - word;
+        v->words[used++] = '\0';
+        while (*p != '\n' && *p != '\0') p++;
+    }
+    v->word_offsets[lines] = used;
+    free(vocab);
+
+    values = (double*)malloc((size + 1) * sizeof(double));
+    for (row = 0; row < 2 * lines; row++) { // Word rows, then context rows, each followed by its bias
+        if (fread(values, sizeof(double), size + 1, fin) != (size_t)(size + 1)) {
+            fprintf(stderr, "Unable to read file %s.\n", file_name);
+            free(values);
+            fclose(fin);
+            gloveVectorsFree(v);
+            return 1;
+        }
+        for (a = 0; a < size; a++) v->rows[(row % lines) * v->stride + a] += (float)values[a];
+    }
+    free(values);
+    fclose(fin);
+    finish_vectors(v);
+    *vectors = v;
+    return 0;
+}
+
+/* Rows of a binary model file, dequantized; word + context vectors for files of model 0 */
+static int load_model_file(const char *file_name, GloveVectors **vectors) {
+    GloveModelFile *model;
+    GloveModelInfo info;
+    GloveVectors *v;
+    long long row, used = 0, bytes = 0, a;
+    int size;
+    float *values;
+
+    if (gloveModelFileOpen(file_name, &model) != 0) return 1;
+    gloveModelFileInfo(model, &info);
+    size = (info.model == 0) ? info.vectorSize : info.dim;
+    for (row = 0; row < info.rows; row++) bytes += strlen(gloveModelFileWord(model, row)) + 1;
+    if (info.rows == 0 || (v = new_vectors(info.rows, size, bytes)) == NULL) {
+        fprintf(stderr, (info.rows == 0) ? "%s holds no word vectors.\n" : "Out of memory loading %s.\n", file_name);
+        gloveModelFileClose(model);
+        return 1;
+    }
+    values = (float*)malloc(info.dim * sizeof(float));
+    for (row = 0; row < info.rows; row++) {
+        v->word_offsets[row] = used;
+        strcpy(v->words + used, gloveModelFileWord(model, row));
+        used += strlen(v->words + used) + 1;
+        gloveModelFileDecode(model, row, values);
+        for (a = 0; a < size; a++)
+            v->rows[row * v->stride + a] = (info.model == 0) ? values[a] + values[info.vectorSize + 1 + a] : values[a];
+    }
+    v->word_offsets[info.rows] = used;
+    free(values);
+    gloveModelFileClose(model);
+    finish_vectors(v);
+    *vectors = v;
+    return 0;
+}
+
+int gloveVectorsLoad(const char* vectorsFile, const char* vocabFile, GloveVectors** vectors) {
+    char magic[8];
+    int is_model_file;
+    FILE *fin = fopen(vectorsFile, "rb");
+    *vectors = NULL;
+    if (fin == NULL) {fprintf(stderr, "Unable to open file %s.\n", vectorsFile); return 1;}
+    is_model_file = fread(magic, 1, sizeof(magic), fin) == sizeof(magic) && memcmp(magic, "GLOVEMDL", sizeof(magic)) == 0;
+    fclose(fin);
+    if (is_model_file) return load_model_file(vectorsFile, vectors);
+    if (vocabFile != NULL) return load_binary(vectorsFile, vocabFile, vectors);
+    return load_text(vectorsFile, vectors);
+}
+
+int gloveVectorsFromModel(GloveModel* model, GloveVectors** vectors) {
+    long long count = gloveModelVocabSize(model), row, used = 0, bytes = 0, a;
+    int size = gloveModelVectorSize(model);
+    const double *combined = gloveModelCombined(model);
+    GloveVectors *v;
+
+    *vectors = NULL;
+    for (row = 0; row < count; row++) bytes += strlen(gloveModelWord(model, row)) + 1;
+    if (combined == NULL || count == 0 || (v = new_vectors(count, size, bytes)) == NULL) {
+        fprintf(stderr, "Out of memory copying the model's vectors.\n");
+        return 1;
+    }
+    for (row = 0; row < count; row++) {
+        v->word_offsets[row] = used;
+        strcpy(v->words + used, gloveModelWord(model, row));
+        used += strlen(v->words + used) + 1;
+        for (a = 0; a < size; a++) v->rows[row * v->stride + a] = (float)combined[row * size + a];
+    }
+    v->word_offsets[count] = used;
+    finish_vectors(v);
+    *vectors = v;
+    return 0;
+}
+
+int gloveVectorsConvert(const char* textFile, const char* modelOut, int dtype, int threads) {
+    GloveVectors *v;
+    GloveModelWriter *writer;
+    const char **words;
+    long long row;
+    int result;
+
+    if (parse_text(textFile, (threads > 0) ? threads : processor_count(), &v) != 0) return 1;
+    words = (const char**)malloc(v->count * sizeof(char*));
+    for (row = 0; row < v->count; row++) words[row] = v->words + v->word_offsets[row];
+    result = gloveModelWriterOpen(modelOut, v->count, v->size, 1, dtype, words, &writer);
+    if (result == 0) {
+        for (row = 0; row < v->count; row++) gloveModelWriterAddRowF(writer, v->rows + row * v->stride);
+        result = gloveModelWriterClose(writer);
+    }
+    free(words);
+    gloveVectorsFree(v);
+    return result;
+}
+
+long long gloveVectorsCount(const GloveVectors* vectors) {
+    return vectors->count;
+}
+
+int gloveVectorsSize(const GloveVectors* vectors) {
+    return vectors->size;
+}
+
+const char* gloveVectorsWord(const GloveVectors* vectors, long long row) {
+    if (row < 0 || row >= vectors->count) return NULL;
+    return vectors->words + vectors->word_offsets[row];
+}
+
+long long gloveVectorsFind(const GloveVectors* vectors, const char* word) {
+    long long slot = bitwisehash(word, vectors->table_size, HASH_SEED), index;
+    while ((index = vectors->table[slot]) >= 0) {
+        if (strcmp(vectors->words + vectors->word_offsets[index], word) == 0) return index;
+        slot = (slot + 1) % vectors->table_size;
+    }
+    return -1;
+}
+
+const float* gloveVectorsRow(const GloveVectors* vectors, long long row) {
+    if (row < 0 || row >= vectors->count) return NULL;
+    return vectors->rows + row * vectors->stride;
+}
+
+void gloveVectorsFree(GloveVectors* vectors) {
+    if (vectors == NULL) return;
+    if (vectors->rows != NULL) free_aligned(vectors->rows);
+    free(vectors->words);
+    free(vectors->word_offsets);
+    free(vectors->table);
+    free(vectors);
+}
+
+/* Dot products of n rows with the QUERY_BLOCK queries starting at q, into scores[query * score_stride + row]. The
+ * inner loop runs over whole padded rows, so it vectorizes without a remainder */
+static void score_rows(const float *rows, long long n, long long stride, const float *q, float *scores,
+                       long long score_stride) {
+    long long i, j;
+    const float *q0 = q, *q1 = q + stride, *q2 = q + 2 * stride, *q3 = q + 3 * stride, *r;
+    float s0, s1, s2, s3;
+    for (i = 0; i < n; i++) {
+        r = rows + i * stride;
+        s0 = s1 = s2 = s3 = 0;
+        for (j = 0; j < stride; j++) {
+            s0 += r[j] * q0[j];
+            s1 += r[j] * q1[j];
+            s2 += r[j] * q2[j];
+            s3 += r[j] * q3[j];
+        }
+        scores[i] = s0;
+        scores[score_stride + i] = s1;
+        scores[2 * score_stride + i] = s2;
+        scores[3 * score_stride + i] = s3;
+    }
+}
+
+/* Replace the smallest entry of a full min-heap of k neighbors and restore the heap */
+static void heap_replace(NEIGHBOR *heap, int k, float score, long long row) {
+    int a = 0, child;
+    while ((child = 2 * a + 1) < k) {
+        if (child + 1 < k && heap[child + 1].score < heap[child].score) child++;
+        if (heap[child].score >= score) break;
+        heap[a] = heap[child];
+        a = child;
+    }
+    heap[a].score = score;
+    heap[a].row = row;
+}
+
+/* Score this thread's share of the rows against every query */
+static void *nearest_thread(void *arg) {
+    NEAREST_CONTEXT *ctx = (NEAREST_CONTEXT*)((THREAD_ARG*)arg)->ctx;
+    long long id = ((THREAD_ARG*)arg)->id;
+    const GloveVectors *v = ctx->vectors;
+    long long first = v->count * id / ctx->threads, last = v->count * (id + 1) / ctx->threads, start, n, i;
+    long long block_rows = ROW_BLOCK_BYTES / (v->stride * sizeof(float));
+    int q, b;
+    float *scores, *s;
+    NEIGHBOR *heap;
+
+    if (block_rows < 1) block_rows = 1;
+    scores = (float*)malloc(QUERY_BLOCK * block_rows * sizeof(float));
+    for (start = first; start < last; start += block_rows) {
+        n = (last - start < block_rows) ? last - start : block_rows;
+        for (q = 0; q < ctx->count; q += QUERY_BLOCK) {
+            score_rows(v->rows + start * v->stride, n, v->stride, ctx->queries + q * v->stride, scores, block_rows);
+            for (b = 0; b < QUERY_BLOCK && q + b < ctx->count; b++) {
+                heap = ctx->heaps + (id * ctx->count + q + b) * ctx->k;
+                for (i = 0, s = scores + b * block_rows; i < n; i++)
+                    if (s[i] > heap[0].score) heap_replace(heap, ctx->k, s[i], start + i);
+            }
+        }
+    }
+    free(scores);
+    return NULL;
+}
+
+/* Best neighbors first; equal scores in row order */
+static int compare_neighbors(const void *a, const void *b) {
+    const NEIGHBOR *x = (const NEIGHBOR*)a, *y = (const NEIGHBOR*)b;
+    if (x->score != y->score) return (x->score < y->score) ? 1 : -1;
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+int gloveVectorsNearest(const GloveVectors* vectors, const float* queries, int count, int k, int threads,
+                        long long* rows, float* scores) {
+    NEAREST_CONTEXT ctx;
+    long long a, padded = (count + QUERY_BLOCK - 1) / QUERY_BLOCK * QUERY_BLOCK;
+    int q, t, b;
+    float *normalized;
+    NEIGHBOR *merged;
+
+    if (k < 1 || count < 0) {fprintf(stderr, "gloveVectorsNearest needs k >= 1.\n"); return 1;}
+    if (count == 0) return 0;
+    ctx.vectors = vectors;
+    ctx.count = count;
+    ctx.k = k;
+    ctx.threads = (threads < 1) ? 1 : (threads > vectors->count) ? (int)vectors->count : threads;
+    normalized = alloc_aligned(padded * vectors->stride);
+    ctx.heaps = (NEIGHBOR*)malloc((long long)ctx.threads * count * k * sizeof(NEIGHBOR));
+    if (normalized == NULL || ctx.heaps == NULL) {
+        fprintf(stderr, "Out of memory for %d queries of %d neighbors.\n", count, k);
+        if (normalized != NULL) free_aligned(normalized);
+        free(ctx.heaps);
+        return 1;
+    }
+    for (q = 0; q < count; q++) {
+        memcpy(normalized + q * vectors->stride, queries + (long long)q * vectors->size, vectors->size * sizeof(float));
+        normalize(normalized + q * vectors->stride, vectors->size);
+    }
+    ctx.queries = normalized;
+    for (a = 0; a < (long long)ctx.threads * count * k; a++) {
+        ctx.heaps[a].score = EMPTY_SCORE;
+        ctx.heaps[a].row = -1;
+    }
+    run_threads(&ctx, nearest_thread, ctx.threads);
+
+    for (q = 0; q < count; q++) { // Fold the other threads' heaps into thread 0's, then sort it
+        merged = ctx.heaps + (long long)q * k;
+        for (t = 1; t < ctx.threads; t++)
+            for (b = 0; b < k; b++) {
+                NEIGHBOR *n = ctx.heaps + ((long long)t * count + q) * k + b;
+                if (n->score > merged[0].score) heap_replace(merged, k, n->score, n->row);
+            }
+        qsort(merged, k, sizeof(NEIGHBOR), compare_neighbors);
+        for (b = 0; b < k; b++) {
+            rows[(long long)q * k + b] = merged[b].row;
+            scores[(long long)q * k + b] = (merged[b].row < 0) ? 0 : merged[b].score;
+        }
+    }
+    free_aligned(normalized);
+    free(ctx.heaps);
+    return 0;
+}
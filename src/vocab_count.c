@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../include/glove.h"
+#include "pipeline.h"
 
 #define MAX_STRING_LENGTH 1000
 #define TSIZE	1048576
@@ -45,10 +46,16 @@ typedef struct hashrec {
     struct hashrec *next;
 } HASHREC;
 
-static int verbose; // 0, 1, or 2
-static long long min_count; // min occurrences for inclusion in vocab min_count < 1 defaults to min_count = 1
-static long long max_vocab; // max_vocab <= 0 for no limit
-static FILE *in, *out;
+/* State of one vocabCount() call */
+typedef struct vocab_count_context {
+    int verbose; // 0, 1, or 2
+    long long min_count; // min occurrences for inclusion in vocab min_count < 1 defaults to min_count = 1
+    long long max_vocab; // max_vocab <= 0 for no limit
+    FILE *in, *out; // out is NULL when the vocabulary is only kept in memory
+    GLOVE_VOCAB *kept; // Receives the vocabulary for glovePipeline; NULL for none
+    GloveProfile *profile;
+    int profile_span; // Span of this call, -1 when not profiling
+} VOCAB_COUNT_CONTEXT;
 
 /* Efficient string comparison */
 static int scmp( char *s1, char *s2 ) {
@@ -121,27 +128,72 @@ static void hashinsert(HASHREC **ht, char *w) {
     return;
 }
 
-static int get_counts() {
+/* Free the hash table and its records */
+static void free_hashtable(HASHREC **ht) {
+    int i;
+    HASHREC *htmp, *next;
+    for (i = 0; i < TSIZE; i++) {
+        for (htmp = ht[i]; htmp != NULL; htmp = next) {
+            next = htmp->next;
+            free(htmp->word);
+            free(htmp);
+        }
+    }
+    free(ht);
+}
+
+/* Pack the first count words of vocab into kept */
+static int keep_words(GLOVE_VOCAB *kept, VOCAB *vocab, long long count) {
+    long long a, used = 0;
+    for (a = 0; a < count; a++) used += strlen(vocab[a].word) + 1;
+    kept->size = count;
+    kept->words = (char*)malloc(used + 1);
+    kept->offsets = (long long*)malloc((count + 1) * sizeof(long long));
+    if (kept->words == NULL || kept->offsets == NULL) {
+        fprintf(stderr, "Out of memory for a vocabulary of %lld words.\n", count);
+        free(kept->words);
+        free(kept->offsets);
+        kept->words = NULL;
+        kept->offsets = NULL;
+        return 1;
+    }
+    for (a = 0, used = 0; a < count; a++) {
+        kept->offsets[a] = used;
+        strcpy(kept->words + used, vocab[a].word);
+        used += strlen(vocab[a].word) + 1;
+    }
+    kept->offsets[count] = used;
+    return 0;
+}
+
+static int get_counts(VOCAB_COUNT_CONTEXT *ctx) {
     long long i = 0, j = 0, vocab_size = 12500;
+    int span, result;
     char format[20];
     char str[MAX_STRING_LENGTH + 1];
     HASHREC **vocab_hash = inithashtable();
     HASHREC *htmp;
     VOCAB *vocab;
-    FILE *fid = in;
+    FILE *fid = ctx->in;
     
     fprintf(stderr, "BUILDING VOCABULARY\n");
-    if (verbose > 1) fprintf(stderr, "Processed %lld tokens.", i);
+    if (ctx->verbose > 1) fprintf(stderr, "Processed %lld tokens.", i);
     sprintf(format,"%%%ds",MAX_STRING_LENGTH);
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "count");
     while (fscanf(fid, format, str) != EOF) { // Insert all tokens into hashtable
         if (strcmp(str, "<unk>") == 0) {
             fprintf(stderr, "\nError, <unk> vector found in corpus.\nPlease remove <unk>s from your corpus (e.g. cat text8 | sed -e 's/<unk>/<raw_unk>/g' > text8.new)");
+            free_hashtable(vocab_hash);
             return 1;
         }
         hashinsert(vocab_hash, str);
-        if (((++i)%100000) == 0) if (verbose > 1) fprintf(stderr,"\033[11G%lld tokens.", i);
+        if (((++i)%100000) == 0) if (ctx->verbose > 1) fprintf(stderr,"\033[11G%lld tokens.", i);
     }
-    if (verbose > 1) fprintf(stderr, "\033[0GProcessed %lld tokens.\n", i);
+    if (ctx->verbose > 1) fprintf(stderr, "\033[0GProcessed %lld tokens.\n", i);
+    gloveProfileAddRecords(ctx->profile, span, i);
+    gloveProfileAddRecords(ctx->profile, ctx->profile_span, i);
+    gloveProfileEnd(ctx->profile, span);
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "sort");
     vocab = malloc(sizeof(VOCAB) * vocab_size);
     for (i = 0; i < TSIZE; i++) { // Migrate vocab to array
         htmp = vocab_hash[i];
@@ -156,29 +208,38 @@ static int get_counts() {
             htmp = htmp->next;
         }
     }
-    if (verbose > 1) fprintf(stderr, "Counted %lld unique words.\n", j);
-    if (max_vocab > 0 && max_vocab < j)
+    if (ctx->verbose > 1) fprintf(stderr, "Counted %lld unique words.\n", j);
+    if (ctx->max_vocab > 0 && ctx->max_vocab < j)
         // If the vocabulary exceeds limit, first sort full vocab by frequency without alphabetical tie-breaks.
         // This results in pseudo-random ordering for words with same frequency, so that when truncated, the words span whole alphabet
         qsort(vocab, j, sizeof(VOCAB), CompareVocab);
-    else max_vocab = j;
-    qsort(vocab, max_vocab, sizeof(VOCAB), CompareVocabTie); //After (possibly) truncating, sort (possibly again), breaking ties alphabetically
+    else ctx->max_vocab = j;
+    qsort(vocab, ctx->max_vocab, sizeof(VOCAB), CompareVocabTie); //After (possibly) truncating, sort (possibly again), breaking ties alphabetically
+    gloveProfileAddRecords(ctx->profile, span, j);
+    gloveProfileEnd(ctx->profile, span);
     
-    for (i = 0; i < max_vocab; i++) {
-        if (vocab[i].count < min_count) { // If a minimum frequency cutoff exists, truncate vocabulary
-            if (verbose > 0) fprintf(stderr, "Truncating vocabulary at min count %lld.\n",min_count);
+    span = gloveProfileBegin(ctx->profile, ctx->profile_span, "write");
+    for (i = 0; i < ctx->max_vocab; i++) {
+        if (vocab[i].count < ctx->min_count) { // If a minimum frequency cutoff exists, truncate vocabulary
+            if (ctx->verbose > 0) fprintf(stderr, "Truncating vocabulary at min count %lld.\n",ctx->min_count);
             break;
         }
-        fprintf(out, "%s %lld\n",vocab[i].word,vocab[i].count);
+        if (ctx->out != NULL) fprintf(ctx->out, "%s %lld\n",vocab[i].word,vocab[i].count);
     }
+    if (ctx->out != NULL) fflush(ctx->out);
+    gloveProfileAddRecords(ctx->profile, span, i);
+    gloveProfileEnd(ctx->profile, span);
     
-    if (i == max_vocab && max_vocab < j) if (verbose > 0) fprintf(stderr, "Truncating vocabulary at size %lld.\n", max_vocab);
+    if (i == ctx->max_vocab && ctx->max_vocab < j) if (ctx->verbose > 0) fprintf(stderr, "Truncating vocabulary at size %lld.\n", ctx->max_vocab);
     fprintf(stderr, "Using vocabulary of size %lld.\n\n", i);
-    return 0;
+    result = (ctx->kept != NULL) ? keep_words(ctx->kept, vocab, i) : 0;
+    free(vocab);
+    free_hashtable(vocab_hash);
+    return result;
 }
 
 static const VocabCountArgs DEFAULT_VOCABCOUNT_ARGS = {
-        .verbose = 0, .maxVocab = -1, .minCount = 1, .mode = 0
+        .verbose = 0, .maxVocab = -1, .minCount = 1, .mode = 0, .profile = NULL
 };
 
 int createVocabCountArgs(VocabCountArgs* emptyArgs) {
@@ -186,20 +247,35 @@ int createVocabCountArgs(VocabCountArgs* emptyArgs) {
     return 0;
 }
 
-int vocabCount(const VocabCountArgs* args, const char* corpusIn, char* vocabOut) {
-    verbose = args->verbose;
-    max_vocab = args->maxVocab;
-    min_count = args->minCount;
+int glove_count_vocab(const VocabCountArgs* args, const char* corpusIn, char* vocabOut, GLOVE_VOCAB* vocab) {
+    VOCAB_COUNT_CONTEXT ctx;
+    int result;
+
+    ctx.verbose = args->verbose;
+    ctx.max_vocab = args->maxVocab;
+    ctx.min_count = args->minCount;
+    ctx.profile = args->profile;
+    ctx.kept = vocab;
+    if (vocab != NULL) memset(vocab, 0, sizeof(GLOVE_VOCAB));
 
-    in = fopen(corpusIn, "r");
-    if (in == NULL) { fprintf(stderr,"Unable to open file %s.\n", corpusIn); return 1; }
-    out = fopen(vocabOut, "w");
-    if (out == NULL) { fprintf(stderr,"Unable to open file %s.\n", vocabOut); return 1; }
+    ctx.in = fopen(corpusIn, "r");
+    if (ctx.in == NULL) { fprintf(stderr,"Unable to open file %s.\n", corpusIn); return 1; }
+    ctx.out = NULL;
+    if (vocabOut != NULL || vocab == NULL) {
+        ctx.out = fopen(vocabOut, "w");
+        if (ctx.out == NULL) { fprintf(stderr,"Unable to open file %s.\n", vocabOut); fclose(ctx.in); return 1; }
+    }
 
-    if (min_count < 1) { min_count = 1; }
+    if (ctx.min_count < 1) { ctx.min_count = 1; }
 
-    int result = get_counts();
-    fclose(in);
-    fclose(out);
+    ctx.profile_span = gloveProfileBegin(ctx.profile, -1, "vocab_count");
+    result = get_counts(&ctx);
+    fclose(ctx.in);
+    if (ctx.out != NULL) fclose(ctx.out);
+    gloveProfileEnd(ctx.profile, ctx.profile_span);
     return result;
 }
+
+int vocabCount(const VocabCountArgs* args, const char* corpusIn, char* vocabOut) {
+    return glove_count_vocab(args, corpusIn, vocabOut, NULL);
+}
@@ -0,0 +1,391 @@
+//  Minimal perfect hash of a vocabulary, for word to row lookups straight from a mapped file
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  Hash and displace (Belazzougui et al., CHD, with the per-bucket seeds of PTHash): every word is hashed once to 64
+//  bits, which pick its bucket, and each bucket stores the seed that sends its words to free slots. Buckets are placed
+//  largest first into slots / HASH_LOAD slots, which leaves a few free slots for the last, single word buckets to land
+//  in quickly; the words that land at or past count are then moved to the free slots below it through a small remap
+//  table, so the entries array is exactly count long. A lookup reads the bucket's seed and then one entry, which holds
+//  the word's full hash to reject unknown words (wrongly accepting one has probability about 2^-64) and its row.
+//
+//  File layout (native byte order, recorded in the header):
+//    header                   WORD_HASH_HEADER
+//    seeds                    buckets uint32
+//    remap                    slots - count uint32, the entry of each slot at or past count
+//    entries                  count WORD_HASH_ENTRY
+//  Each section starts 64-byte aligned.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/glove.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define WORD_HASH_VERSION 1
+#define WORD_HASH_ALIGNMENT 64
+#define BYTE_ORDER_MARK 0x01020304u
+#define MAX_STRING_LENGTH 1000
+#define BUCKET_SIZE 4 // Average words per bucket; larger buckets make a smaller seeds array and a slower build
+#define HASH_LOAD 0.99 // Words per slot while placing buckets
+#define MAX_SEED_TRIES (1u << 24) // A bucket that fails this many seeds holds words with equal hashes
+#define EMPTY_REMAP UINT32_MAX
+
+static const char WORD_HASH_MAGIC[8] = "GLOVEMPH";
+
+typedef struct word_hash_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t count, buckets, slots;
+    uint64_t hash_seed;
+    uint64_t seeds_offset, remap_offset, entries_offset;
+    uint64_t file_size;
+} WORD_HASH_HEADER;
+
+typedef struct word_hash_entry {
+    uint64_t hash;
+    uint64_t row;
+} WORD_HASH_ENTRY;
+
+struct _GloveWordHash {
+    WORD_HASH_HEADER h;
+    const uint32_t *seeds, *remap;
+    const WORD_HASH_ENTRY *entries;
+    const char *base;
+    uint64_t length;
+#if defined(_WIN32)
+    HANDLE file, mapping;
+#endif
+};
+
+static uint64_t align_up(uint64_t n) {
+    return (n + WORD_HASH_ALIGNMENT - 1) / WORD_HASH_ALIGNMENT * WORD_HASH_ALIGNMENT;
+}
+
+/* splitmix64 finalizer, a well mixed function of x */
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* 64-bit hash of a word, eight bytes at a time */
+static uint64_t hash_word(const char *word, uint64_t seed) {
+    uint64_t h = seed, chunk;
+    size_t length = strlen(word), a;
+    for (a = 0; a + 8 <= length; a += 8) {
+        memcpy(&chunk, word + a, 8);
+        h = mix(h ^ chunk);
+    }
+    chunk = 0;
+    memcpy(&chunk, word + a, length - a);
+    return mix(h ^ chunk ^ ((uint64_t)length << 56));
+}
+
+/* Map a 64-bit hash onto 0 .. n - 1 for n < 2^32 */
+static uint64_t reduce(uint64_t x, uint64_t n) {
+    return ((x >> 32) * n) >> 32;
+}
+
+static uint64_t bucket_of(const WORD_HASH_HEADER *h, uint64_t hash) {
+    return reduce(hash, h->buckets);
+}
+
+static uint64_t slot_of(const WORD_HASH_HEADER *h, uint64_t hash, uint32_t seed) {
+    return reduce(mix(hash ^ mix(seed)), h->slots);
+}
+
+/* Buckets largest first, which are the hardest to place */
+static int compare_bucket_sizes(const void *a, const void *b) {
+    const uint64_t *x = (const uint64_t*)a, *y = (const uint64_t*)b;
+    return (x[1] < y[1]) - (x[1] > y[1]);
+}
+
+/* Write the sections of a built hash to file_name */
+static int write_word_hash(const WORD_HASH_HEADER *h, const uint32_t *seeds, const uint32_t *remap,
+                           const WORD_HASH_ENTRY *entries, const char *file_name) {
+    static const char zeros[WORD_HASH_ALIGNMENT] = {0};
+    FILE *fout = fopen(file_name, "wb");
+    int ok;
+    if (fout == NULL) {fprintf(stderr, "Unable to open file %s.\n", file_name); return 1;}
+    ok = fwrite(h, sizeof(WORD_HASH_HEADER), 1, fout) == 1
+        && fwrite(zeros, 1, h->seeds_offset - sizeof(WORD_HASH_HEADER), fout) == h->seeds_offset - sizeof(WORD_HASH_HEADER)
+        && fwrite(seeds, sizeof(uint32_t), h->buckets, fout) == h->buckets
+        && fwrite(zeros, 1, h->remap_offset - h->seeds_offset - h->buckets * sizeof(uint32_t), fout) == h->remap_offset - h->seeds_offset - h->buckets * sizeof(uint32_t)
+        && fwrite(remap, sizeof(uint32_t), h->slots - h->count, fout) == h->slots - h->count
+        && fwrite(zeros, 1, h->entries_offset - h->remap_offset - (h->slots - h->count) * sizeof(uint32_t), fout) == h->entries_offset - h->remap_offset - (h->slots - h->count) * sizeof(uint32_t)
+        && fwrite(entries, sizeof(WORD_HASH_ENTRY), h->count, fout) == h->count;
+    if (fclose(fout) != 0) ok = 0;
+    if (!ok) {fprintf(stderr, "Unable to write file %s.\n", file_name); return 1;}
+    return 0;
+}
+
+int gloveWordHashWrite(const char* const* words, long long count, const char* hashOut) {
+    WORD_HASH_HEADER h;
+    uint64_t *hashes = NULL, *sizes = NULL, *starts = NULL, *order = NULL, *slots = NULL, a, b, c, slot, next_free;
+    uint32_t *seeds = NULL, *remap = NULL, seed;
+    unsigned char *taken = NULL;
+    WORD_HASH_ENTRY *entries = NULL;
+    int result = 1;
+
+    if (count < 1 || count >= UINT32_MAX / 2) {fprintf(stderr, "Cannot hash a vocabulary of %lld words.\n", count); return 1;}
+    memset(&h, 0, sizeof(WORD_HASH_HEADER));
+    memcpy(h.magic, WORD_HASH_MAGIC, sizeof(h.magic));
+    h.version = WORD_HASH_VERSION;
+    h.byte_order = BYTE_ORDER_MARK;
+    h.count = count;
+    h.buckets = (count + BUCKET_SIZE - 1) / BUCKET_SIZE;
+    h.slots = (uint64_t)(count / HASH_LOAD) + 1;
+    h.hash_seed = 0x5eed0f9104eULL;
+    h.seeds_offset = align_up(sizeof(WORD_HASH_HEADER));
+    h.remap_offset = align_up(h.seeds_offset + h.buckets * sizeof(uint32_t));
+    h.entries_offset = align_up(h.remap_offset + (h.slots - h.count) * sizeof(uint32_t));
+    h.file_size = h.entries_offset + h.count * sizeof(WORD_HASH_ENTRY);
+
+    hashes = (uint64_t*)malloc(count * sizeof(uint64_t));
+    sizes = (uint64_t*)calloc(2 * h.buckets, sizeof(uint64_t)); // (bucket, size) pairs, sorted by size
+    starts = (uint64_t*)calloc(h.buckets + 1, sizeof(uint64_t));
+    order = (uint64_t*)malloc(count * sizeof(uint64_t)); // Words grouped by bucket
+    slots = (uint64_t*)malloc(count * sizeof(uint64_t)); // Slot of each word once placed
+    seeds = (uint32_t*)calloc(h.buckets, sizeof(uint32_t));
+    remap = (uint32_t*)malloc((h.slots - h.count + 1) * sizeof(uint32_t));
+    taken = (unsigned char*)calloc(h.slots, 1);
+    entries = (WORD_HASH_ENTRY*)calloc(h.count, sizeof(WORD_HASH_ENTRY));
+    if (hashes == NULL || sizes == NULL || starts == NULL || order == NULL || slots == NULL || seeds == NULL
+        || remap == NULL || taken == NULL || entries == NULL) {
+        fprintf(stderr, "Out of memory hashing %lld words.\n", count);
+        goto cleanup;
+    }
+
+    for (a = 0; a < h.count; a++) { // Group the words by bucket with a counting sort
+        hashes[a] = hash_word(words[a], h.hash_seed);
+        starts[bucket_of(&h, hashes[a]) + 1]++;
+    }
+    for (b = 0; b < h.buckets; b++) {
+        sizes[2 * b] = b;
+        sizes[2 * b + 1] = starts[b + 1];
+        starts[b + 1] += starts[b];
+    }
+    for (a = 0; a < h.count; a++) order[starts[bucket_of(&h, hashes[a])] + --sizes[2 * bucket_of(&h, hashes[a]) + 1]] = a;
+    for (b = 0; b < h.buckets; b++) sizes[2 * b + 1] = starts[b + 1] - starts[b];
+    qsort(sizes, h.buckets, 2 * sizeof(uint64_t), compare_bucket_sizes);
+
+    for (b = 0; b < h.buckets && sizes[2 * b + 1] > 0; b++) {
+        uint64_t bucket = sizes[2 * b], first = starts[bucket], last = starts[bucket + 1];
+        for (seed = 0; seed < MAX_SEED_TRIES; seed++) {
+            for (a = first; a < last; a++) {
+                slot = slot_of(&h, hashes[order[a]], seed);
+                if (taken[slot]) break;
+                taken[slot] = 1;
+                slots[order[a]] = slot;
+            }
+            if (a == last) break;
+            for (c = first; c < a; c++) taken[slots[order[c]]] = 0; // Collision: free this seed's slots, try the next
+        }
+        if (seed == MAX_SEED_TRIES) {
+            for (a = first, c = last; a + 1 < last; a++) { // c is left at last when no two words hash alike
+                for (c = a + 1; c < last && hashes[order[a]] != hashes[order[c]]; c++);
+                if (c < last) break;
+            }
+            if (c >= last) {a = first; c = (last - first > 1) ? first + 1 : first;}
+            fprintf(stderr, "Words \"%s\" and \"%s\" %s.\n", words[order[a]], words[order[c]],
+                    (strcmp(words[order[a]], words[order[c]]) == 0) ? "are the same word" : "hash alike");
+            goto cleanup;
+        }
+        seeds[bucket] = seed;
+    }
+
+    for (a = 0, next_free = 0; a < h.slots - h.count; a++) remap[a] = EMPTY_REMAP;
+    for (a = 0; a < h.count; a++) {
+        slot = slots[a];
+        if (slot >= h.count) { // Move to the next free slot below count
+            while (taken[next_free]) next_free++;
+            taken[next_free] = 1;
+            remap[slot - h.count] = (uint32_t)next_free;
+            slot = next_free;
+        }
+        entries[slot].hash = hashes[a];
+        entries[slot].row = a;
+    }
+    result = write_word_hash(&h, seeds, remap, entries, hashOut);
+
+cleanup:
+    free(hashes);
+    free(sizes);
+    free(starts);
+    free(order);
+    free(slots);
+    free(seeds);
+    free(remap);
+    free(taken);
+    free(entries);
+    return result;
+}
+
+int gloveWordHashBuild(const char* wordsFile, const char* hashOut) {
+    GloveModelFile *model;
+    GloveModelInfo info;
+    char magic[8], line[MAX_STRING_LENGTH + 2], *text = NULL;
+    const char **words = NULL;
+    long long count = 0, capacity = 0, used = 0, a, *offsets = NULL;
+    size_t length;
+    int result;
+    FILE *fin = fopen(wordsFile, "rb");
+
+    if (fin == NULL) {fprintf(stderr, "Unable to open file %s.\n", wordsFile); return 1;}
+    if (fread(magic, 1, sizeof(magic), fin) == sizeof(magic) && memcmp(magic, "GLOVEMDL", sizeof(magic)) == 0) {
+        fclose(fin);
+        if (gloveModelFileOpen(wordsFile, &model) != 0) return 1;
+        gloveModelFileInfo(model, &info);
+        words = (const char**)malloc(info.rows * sizeof(char*));
+        for (a = 0; a < info.rows; a++) words[a] = gloveModelFileWord(model, a);
+        result = gloveWordHashWrite(words, info.rows, hashOut);
+        free(words);
+        gloveModelFileClose(model);
+        return result;
+    }
+    rewind(fin);
+    while (fgets(line, sizeof(line), fin) != NULL) { // Vocabulary file: the word is the first field of each line
+        length = strcspn(line, " \t\r\n");
+        if (length == 0) continue;
+        if (count == capacity) {
+            capacity = 2 * capacity + 4096;
+            offsets = (long long*)realloc(offsets, capacity * sizeof(long long));
+        }
+        text = (char*)realloc(text, used + length + 1);
+        memcpy(text + used, line, length);
+        text[used + length] = '\0';
+        offsets[count++] = used;
+        used += length + 1;
+        if (strchr(line, '\n') == NULL) while ((a = fgetc(fin)) != EOF && a != '\n'); // Skip the rest of a long line
+    }
+    fclose(fin);
+    words = (const char**)malloc((count + 1) * sizeof(char*));
+    for (a = 0; a < count; a++) words[a] = text + offsets[a];
+    result = gloveWordHashWrite(words, count, hashOut);
+    free(words);
+    free(offsets);
+    free(text);
+    return result;
+}
+
+static void unmap_word_hash(GloveWordHash* hash) {
+#if defined(_WIN32)
+    UnmapViewOfFile(hash->base);
+    CloseHandle(hash->mapping);
+    CloseHandle(hash->file);
+#else
+    munmap((void*)hash->base, hash->length);
+#endif
+}
+
+int gloveWordHashOpen(const char* fileName, GloveWordHash** hash) {
+    GloveWordHash *x = (GloveWordHash*)calloc(1, sizeof(GloveWordHash));
+    WORD_HASH_HEADER *h = &x->h;
+    uint64_t a;
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+#else
+    struct stat st;
+    int fd;
+#endif
+    *hash = NULL;
+
+#if defined(_WIN32)
+    x->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (x->file == INVALID_HANDLE_VALUE) {fprintf(stderr, "Unable to open file %s.\n", fileName); free(x); return 1;}
+    GetFileSizeEx(x->file, &size);
+    x->length = size.QuadPart;
+    x->mapping = (x->length < sizeof(WORD_HASH_HEADER)) ? NULL : CreateFileMappingA(x->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    x->base = (x->mapping == NULL) ? NULL : (const char*)MapViewOfFile(x->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (x->base == NULL) {
+        fprintf(stderr, "Unable to map file %s.\n", fileName);
+        if (x->mapping != NULL) CloseHandle(x->mapping);
+        CloseHandle(x->file);
+        free(x);
+        return 1;
+    }
+#else
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0) {fprintf(stderr, "Unable to open file %s.\n", fileName); free(x); return 1;}
+    if (fstat(fd, &st) != 0 || (x->length = st.st_size) < sizeof(WORD_HASH_HEADER)
+        || (x->base = (const char*)mmap(NULL, x->length, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Unable to map file %s.\n", fileName);
+        close(fd);
+        free(x);
+        return 1;
+    }
+    close(fd); // The mapping keeps the file alive
+#endif
+
+    memcpy(h, x->base, sizeof(WORD_HASH_HEADER));
+    if (memcmp(h->magic, WORD_HASH_MAGIC, sizeof(h->magic)) != 0 || h->version != WORD_HASH_VERSION
+        || h->byte_order != BYTE_ORDER_MARK || h->file_size != x->length || h->count == 0 || h->slots < h->count
+        || h->slots >= UINT32_MAX || h->buckets == 0 || h->buckets >= UINT32_MAX
+        || h->seeds_offset != align_up(sizeof(WORD_HASH_HEADER))
+        || h->remap_offset != align_up(h->seeds_offset + h->buckets * sizeof(uint32_t))
+        || h->entries_offset != align_up(h->remap_offset + (h->slots - h->count) * sizeof(uint32_t))
+        || h->file_size != h->entries_offset + h->count * sizeof(WORD_HASH_ENTRY)) {
+        fprintf(stderr, "%s is not a GloVe word hash file of a supported version.\n", fileName);
+        unmap_word_hash(x);
+        free(x);
+        return 1;
+    }
+    x->seeds = (const uint32_t*)(x->base + h->seeds_offset);
+    x->remap = (const uint32_t*)(x->base + h->remap_offset);
+    x->entries = (const WORD_HASH_ENTRY*)(x->base + h->entries_offset);
+    for (a = 0; a < h->slots - h->count; a++) // Lookups must stay inside the file whatever it holds
+        if (x->remap[a] != EMPTY_REMAP && x->remap[a] >= h->count) break;
+    if (a < h->slots - h->count) {
+        fprintf(stderr, "%s is corrupt.\n", fileName);
+        unmap_word_hash(x);
+        free(x);
+        return 1;
+    }
+    *hash = x;
+    return 0;
+}
+
+void gloveWordHashClose(GloveWordHash* hash) {
+    if (hash == NULL) return;
+    unmap_word_hash(hash);
+    free(hash);
+}
+
+long long gloveWordHashFind(const GloveWordHash* hash, const char* word) {
+    uint64_t x = hash_word(word, hash->h.hash_seed), slot = slot_of(&hash->h, x, hash->seeds[bucket_of(&hash->h, x)]);
+    if (slot >= hash->h.count) {
+        slot = hash->remap[slot - hash->h.count];
+        if (slot == EMPTY_REMAP) return -1;
+    }
+    return (hash->entries[slot].hash == x) ? (long long)hash->entries[slot].row : -1;
+}
+
+const void* gloveWordHashRow(const GloveWordHash* hash, const GloveModelFile* model, const char* word) {
+    long long row = gloveWordHashFind(hash, word);
+    return (row < 0) ? NULL : gloveModelFileRow(model, row);
+}
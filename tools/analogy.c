@@ -0,0 +1,79 @@
+//  Word analogy evaluation of trained word vectors, with the output of eval/python/evaluate.py
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "glove.h"
+
+static int find_arg(char *str, int argc, char **argv) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(str, argv[i])) {
+            if (i == argc - 1) {
+                printf("No argument given for %s\n", str);
+                exit(1);
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+static double percent(long long part, long long whole) {
+    return (whole > 0) ? 100.0 * part / whole : 0;
+}
+
+int main(int argc, char **argv) {
+    int i, threads = 8, file;
+    char *vectors_file = NULL, *vocab_file = NULL, *question_dir = "./eval/question-data";
+    GloveVectors *vectors;
+    GloveAnalogyResult r;
+
+    if (argc == 1) {
+        printf("Word analogy accuracy of word vectors\n\n");
+        printf("Usage options:\n");
+        printf("\t-vectors-file <file>\n");
+        printf("\t\tText vectors, binary model file (.glvm) or binary parameters (.bin, with -vocab-file)\n");
+        printf("\t-vocab-file <file>\n");
+        printf("\t\tVocabulary of a .bin parameter file\n");
+        printf("\t-question-dir <dir>\n");
+        printf("\t\tDirectory of the analogy question files; default ./eval/question-data\n");
+        printf("\t-threads <int>\n");
+        printf("\t\tNumber of threads; default 8\n");
+        printf("\nExample usage:\n");
+        printf("./glove_analogy -vectors-file vectors.txt\n");
+        return 0;
+    }
+    if ((i = find_arg((char *)"-vectors-file", argc, argv)) > 0) vectors_file = argv[i + 1];
+    if ((i = find_arg((char *)"-vocab-file", argc, argv)) > 0) vocab_file = argv[i + 1];
+    if ((i = find_arg((char *)"-question-dir", argc, argv)) > 0) question_dir = argv[i + 1];
+    if ((i = find_arg((char *)"-threads", argc, argv)) > 0) threads = atoi(argv[i + 1]);
+    if (vectors_file == NULL) {fprintf(stderr, "No -vectors-file given.\n"); return 1;}
+
+    if (gloveVectorsLoad(vectors_file, vocab_file, &vectors) != 0) return 1;
+    if (gloveAnalogyEvaluate(vectors, question_dir, threads, &r) != 0) {gloveVectorsFree(vectors); return 1;}
+    for (file = 0; file < GLOVE_ANALOGY_FILES; file++) {
+        printf("%s:\n", gloveAnalogyFile(file));
+        printf("ACCURACY TOP1: %.2f%% (%lld/%lld)\n", percent(r.correct[file], r.count[file]), r.correct[file], r.count[file]);
+    }
+    printf("Questions seen/total: %.2f%% (%lld/%lld)\n", percent(r.totalCount, r.fullCount), r.totalCount, r.fullCount);
+    printf("Semantic accuracy: %.2f%%  (%lld/%lld)\n", percent(r.semanticCorrect, r.semanticCount), r.semanticCorrect, r.semanticCount);
+    printf("Syntactic accuracy: %.2f%%  (%lld/%lld)\n", percent(r.syntacticCorrect, r.syntacticCount), r.syntacticCorrect, r.syntacticCount);
+    printf("Total accuracy: %.2f%%  (%lld/%lld)\n", percent(r.totalCorrect, r.totalCount), r.totalCorrect, r.totalCount);
+    gloveVectorsFree(vectors);
+    return 0;
+}
@@ -0,0 +1,432 @@
+//  Benchmark of the GloVe pipeline on a synthetic corpus, with microbenchmarks of the training update, reported as JSON
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+//
+//  The corpus is generated from a seed, so runs with the same options train on the same data and their numbers can
+//  be compared across commits and machines without any download. Word frequencies follow Zipf's law, and a fraction
+//  of tokens follow their predecessor as in a first order Markov chain, picked among a few successors fixed per word,
+//  which gives the cooccurrence matrix the repeated pairs of real text instead of uniformly spread ones.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "glove.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#define MAX_STRING_LENGTH 1000
+#define MAX_STAGES 7
+#define SUCCESSORS 8 // Words that can follow each word in a Markov step
+#define CREC_BYTES 16 // Bytes of a cooccurrence record: two ints and a double
+#define CACHE_BYTES (256 * 1024) // W and gradsq of the cache resident kernel runs
+#define MEMORY_BYTES (256LL * 1024 * 1024) // W and gradsq of the memory bound kernel runs
+#define KERNEL_SIZES 4
+#define OUTPUT_BUFFER_SIZE 65536
+
+static const int KERNEL_VECTOR_SIZES[KERNEL_SIZES] = {50, 100, 200, 300};
+
+typedef struct stage {
+    const char *name;
+    double seconds;
+    long long tokens, records, bytes; // Corpus tokens, records produced or consumed, and bytes read (written by generate)
+} STAGE;
+
+typedef struct kernel_run {
+    int vector_size, interleave;
+    const char *rows; // "cache" or "memory"
+    long long vocab_size, updates;
+    double seconds;
+} KERNEL_RUN;
+
+static int find_arg(char *str, int argc, char **argv) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(str, argv[i])) {
+            if (i == argc - 1) {
+                printf("No argument given for %s\n", str);
+                exit(1);
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Seconds on a monotonic clock, for measuring intervals */
+static double now_seconds() {
+#if defined(_WIN32)
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+/* SplitMix64, a well mixed function of x */
+static unsigned long long mix(unsigned long long x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* Uniform number in [0, 1) from the top 53 bits of x */
+static double to_uniform(unsigned long long x) {
+    return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Next uniform number in [0, 1) from a xorshift64* generator */
+static double next_uniform(unsigned long long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return to_uniform(*state * 2685821657736338717ULL);
+}
+
+/* Word of frequency rank r (from 0): "a" .. "z", "aa" .. "zz", "aaa" ..., so frequent words are short as in text */
+static int rank_word(long long r, char *word) {
+    char reversed[16];
+    int length = 0, a;
+    for (r++; r > 0; r = (r - 1) / 26) reversed[length++] = (char)('a' + (r - 1) % 26);
+    for (a = 0; a < length; a++) word[a] = reversed[length - 1 - a];
+    word[length] = '\0';
+    return length;
+}
+
+/* Rank drawn from the cumulative Zipf distribution cdf of vocab words, for u uniform in [0, 1) */
+static long long zipf_rank(const double *cdf, long long vocab, double u) {
+    long long low = 0, high = vocab - 1, mid;
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (cdf[mid] > u) high = mid;
+        else low = mid + 1;
+    }
+    return low;
+}
+
+/* Write a corpus of <tokens> words from a vocabulary of <vocab>, <line_length> to a line, whose frequencies follow
+ * Zipf's law with exponent <zipf>; each token is, with probability <markov>, one of the SUCCESSORS words that can follow
+ * the previous one, themselves Zipf draws fixed by the seed. Sets *bytes and *lines to the size of the file */
+static int generate_corpus(const char *file_name, long long tokens, long long vocab, int line_length, double zipf,
+                           double markov, unsigned long long seed, long long *bytes, long long *lines) {
+    double *cdf = (double*)malloc(vocab * sizeof(double)), sum = 0;
+    char *words = (char*)malloc(vocab * 16), *out = (char*)malloc(OUTPUT_BUFFER_SIZE + 64);
+    int *lengths = (int*)malloc(vocab * sizeof(int)), column = 0;
+    long long a, rank = 0, used = 0;
+    unsigned long long state = mix(seed) | 1;
+    FILE *fout = fopen(file_name, "wb");
+
+    if (fout == NULL) {
+        fprintf(stderr, "Unable to open file %s.\n", file_name);
+        free(cdf);
+        free(words);
+        free(out);
+        free(lengths);
+        return 1;
+    }
+    for (a = 0; a < vocab; a++) {
+        cdf[a] = sum += pow((double)(a + 1), -zipf);
+        lengths[a] = rank_word(a, words + a * 16);
+    }
+    for (a = 0; a < vocab; a++) cdf[a] /= sum;
+    *bytes = *lines = 0;
+    for (a = 0; a < tokens; a++) {
+        if (a > 0 && next_uniform(&state) < markov)
+            rank = zipf_rank(cdf, vocab, to_uniform(mix(seed ^ (rank * SUCCESSORS + (long long)(next_uniform(&state) * SUCCESSORS)))));
+        else rank = zipf_rank(cdf, vocab, next_uniform(&state));
+        memcpy(out + used, words + rank * 16, lengths[rank]);
+        used += lengths[rank];
+        out[used++] = (++column == line_length || a == tokens - 1) ? '\n' : ' ';
+        if (out[used - 1] == '\n') {
+            column = 0;
+            (*lines)++;
+        }
+        if (used >= OUTPUT_BUFFER_SIZE) {
+            fwrite(out, 1, used, fout);
+            *bytes += used;
+            used = 0;
+        }
+    }
+    fwrite(out, 1, used, fout);
+    *bytes += used;
+    free(cdf);
+    free(words);
+    free(out);
+    free(lengths);
+    if (fclose(fout) != 0) {fprintf(stderr, "Unable to write file %s.\n", file_name); return 1;}
+    return 0;
+}
+
+static long long file_size(const char *file_name) {
+    long long size;
+    FILE *fin = fopen(file_name, "rb");
+    if (fin == NULL) return 0;
+    fseek(fin, 0, SEEK_END);
+    size = ftell(fin);
+    fclose(fin);
+    return size;
+}
+
+static long long count_lines(const char *file_name) {
+    long long lines = 0;
+    int c;
+    FILE *fin = fopen(file_name, "rb");
+    if (fin == NULL) return 0;
+    while ((c = getc(fin)) != EOF) if (c == '\n') lines++;
+    fclose(fin);
+    return lines;
+}
+
+static double per_second(double count, double seconds) {
+    return (seconds > 0) ? count / seconds : 0;
+}
+
+int main(int argc, char **argv) {
+    int i, k, line_length = 1000, iter = 3, vector_size = 50, window_size = 15, threads, pipeline = 1, kernels = 1;
+    int keep = 0, fused = 0, stages = 0, runs = 0, layout, resident;
+    long long tokens = 10000000, vocab = 100000, kernel_updates = 2000000, bytes, lines;
+    unsigned long long seed = 1;
+    double zipf = 1.0, markov = 0.3, start;
+    float memory = 1.0;
+    char *dir = ".", *json_file = NULL, *profile_file = NULL, *trace_file = NULL;
+    char corpus_file[MAX_STRING_LENGTH], vocab_file[MAX_STRING_LENGTH], cooccur_file[MAX_STRING_LENGTH];
+    char shuffle_file[MAX_STRING_LENGTH], overflow_file[MAX_STRING_LENGTH], shuffle_temp[MAX_STRING_LENGTH];
+    char glove_temp[MAX_STRING_LENGTH];
+    STAGE stage[MAX_STAGES];
+    KERNEL_RUN run[2 * 2 * KERNEL_SIZES];
+    VocabCountArgs vocab_args;
+    CooccurArgs cooccur_args;
+    ShuffleArgs shuffle_args;
+    GloveArgs glove_args;
+    GlovePipelineArgs pipeline_args;
+    GloveModel *model;
+    GloveProfile *profile = NULL;
+    FILE *fout = stdout;
+
+    createGloveArgs(&glove_args);
+    threads = glove_args.threads;
+    if (argc == 1) {
+        printf("Benchmark the GloVe pipeline on a synthetic corpus and the training update on its own\n\n");
+        printf("Usage options:\n");
+        printf("\t-tokens <int>\n");
+        printf("\t\tTokens of the generated corpus; default 10000000\n");
+        printf("\t-vocab <int>\n");
+        printf("\t\tDistinct words the corpus is drawn from; default 100000\n");
+        printf("\t-line-length <int>\n");
+        printf("\t\tTokens per line; default 1000\n");
+        printf("\t-zipf <float>\n");
+        printf("\t\tExponent of the Zipf distribution of word frequencies; default 1.0\n");
+        printf("\t-markov <float>\n");
+        printf("\t\tFraction of tokens drawn among the few fixed successors of the previous token; default 0.3\n");
+        printf("\t-seed <int>\n");
+        printf("\t\tSeed of the corpus; default 1\n");
+        printf("\t-window-size <int>\n");
+        printf("\t\tContext window of cooccur; default 15\n");
+        printf("\t-memory <float>\n");
+        printf("\t\tMemory of cooccur and shuffle, in GB; default 1.0\n");
+        printf("\t-vector-size <int>\n");
+        printf("\t\tVector size of glove; default 50\n");
+        printf("\t-iter <int>\n");
+        printf("\t\tIterations of glove; default 3\n");
+        printf("\t-threads <int>\n");
+        printf("\t\tThreads of glove; default %d\n", threads);
+        printf("\t-kernel-updates <int>\n");
+        printf("\t\tUpdates timed by each kernel microbenchmark; default 2000000\n");
+        printf("\t-pipeline <int>, -kernels <int>\n");
+        printf("\t\tRun the pipeline stages, and the kernel microbenchmarks: 0 or 1 (default)\n");
+        printf("\t-fused <int>\n");
+        printf("\t\tAlso time glovePipeline, which runs the stages in one call: 0 (default) or 1. It is timed once without\n");
+        printf("\t\ttraining (pipeline_prep, to set against vocab_count + cooccur + shuffle) and once in full (pipeline)\n");
+        printf("\t-dir <dir>\n");
+        printf("\t\tDirectory for the corpus and intermediate files; default .\n");
+        printf("\t-keep <int>\n");
+        printf("\t\tKeep the generated files: 0 (default) or 1\n");
+        printf("\t-json <file>\n");
+        printf("\t\tWrite the results to <file> instead of stdout\n");
+        printf("\t-profile <file>, -trace <file>\n");
+        printf("\t\tWrite the resource profile of the pipeline stages as JSON, and as a Chrome trace\n");
+        printf("\nExample usage:\n");
+        printf("./glove_bench -tokens 50000000 -threads 8 -json bench.json\n");
+        return 0;
+    }
+    if ((i = find_arg((char *)"-tokens", argc, argv)) > 0) tokens = atoll(argv[i + 1]);
+    if ((i = find_arg((char *)"-vocab", argc, argv)) > 0) vocab = atoll(argv[i + 1]);
+    if ((i = find_arg((char *)"-line-length", argc, argv)) > 0) line_length = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-zipf", argc, argv)) > 0) zipf = atof(argv[i + 1]);
+    if ((i = find_arg((char *)"-markov", argc, argv)) > 0) markov = atof(argv[i + 1]);
+    if ((i = find_arg((char *)"-seed", argc, argv)) > 0) seed = strtoull(argv[i + 1], NULL, 10);
+    if ((i = find_arg((char *)"-window-size", argc, argv)) > 0) window_size = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-memory", argc, argv)) > 0) memory = (float)atof(argv[i + 1]);
+    if ((i = find_arg((char *)"-vector-size", argc, argv)) > 0) vector_size = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-iter", argc, argv)) > 0) iter = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-threads", argc, argv)) > 0) threads = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-kernel-updates", argc, argv)) > 0) kernel_updates = atoll(argv[i + 1]);
+    if ((i = find_arg((char *)"-pipeline", argc, argv)) > 0) pipeline = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-kernels", argc, argv)) > 0) kernels = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-fused", argc, argv)) > 0) fused = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-dir", argc, argv)) > 0) dir = argv[i + 1];
+    if ((i = find_arg((char *)"-keep", argc, argv)) > 0) keep = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-json", argc, argv)) > 0) json_file = argv[i + 1];
+    if ((i = find_arg((char *)"-profile", argc, argv)) > 0) profile_file = argv[i + 1];
+    if ((i = find_arg((char *)"-trace", argc, argv)) > 0) trace_file = argv[i + 1];
+    if (tokens < 1 || vocab < 1 || line_length < 1 || iter < 1 || vector_size < 1 || kernel_updates < 1) {
+        fprintf(stderr, "-tokens, -vocab, -line-length, -iter, -vector-size and -kernel-updates must be positive.\n");
+        return 1;
+    }
+
+    if (pipeline) {
+        if ((profile_file != NULL || trace_file != NULL) && gloveProfileCreate(&profile) != 0) return 1;
+        snprintf(corpus_file, MAX_STRING_LENGTH, "%s/bench_corpus.txt", dir);
+        snprintf(vocab_file, MAX_STRING_LENGTH, "%s/bench_vocab.txt", dir);
+        snprintf(cooccur_file, MAX_STRING_LENGTH, "%s/bench_cooccurrence.bin", dir);
+        snprintf(shuffle_file, MAX_STRING_LENGTH, "%s/bench_cooccurrence.shuf.bin", dir);
+        snprintf(overflow_file, MAX_STRING_LENGTH, "%s/bench_overflow", dir);
+        snprintf(shuffle_temp, MAX_STRING_LENGTH, "%s/bench_temp_shuffle", dir);
+        snprintf(glove_temp, MAX_STRING_LENGTH, "%s/bench_temp_glove", dir);
+
+        fprintf(stderr, "Generating %lld tokens...\n", tokens);
+        start = now_seconds();
+        if (generate_corpus(corpus_file, tokens, vocab, line_length, zipf, markov, seed, &bytes, &lines) != 0) return 1;
+        stage[stages++] = (STAGE){"generate", now_seconds() - start, tokens, lines, bytes};
+
+        fprintf(stderr, "vocab_count...\n");
+        createVocabCountArgs(&vocab_args);
+        vocab_args.profile = profile;
+        start = now_seconds();
+        if (vocabCount(&vocab_args, corpus_file, vocab_file) != 0) return 1;
+        stage[stages++] = (STAGE){"vocab_count", now_seconds() - start, tokens, count_lines(vocab_file), bytes};
+
+        fprintf(stderr, "cooccur...\n");
+        createCooccurArgs(&cooccur_args);
+        cooccur_args.windowSize = window_size;
+        cooccur_args.memory = memory;
+        cooccur_args.overflowFile = overflow_file;
+        cooccur_args.profile = profile;
+        start = now_seconds();
+        if (cooccur(&cooccur_args, corpus_file, vocab_file, cooccur_file) != 0) return 1;
+        stage[stages++] = (STAGE){"cooccur", now_seconds() - start, tokens, file_size(cooccur_file) / CREC_BYTES, bytes};
+
+        fprintf(stderr, "shuffle...\n");
+        createShuffleArgs(&shuffle_args);
+        shuffle_args.memory = memory;
+        shuffle_args.tempFile = shuffle_temp;
+        shuffle_args.profile = profile;
+        start = now_seconds();
+        if (shuffle(&shuffle_args, cooccur_file, shuffle_file) != 0) return 1;
+        bytes = file_size(shuffle_file);
+        stage[stages++] = (STAGE){"shuffle", now_seconds() - start, tokens, bytes / CREC_BYTES, bytes};
+
+        fprintf(stderr, "glove...\n");
+        glove_args.vectorSize = vector_size;
+        glove_args.iter = iter;
+        glove_args.threads = threads;
+        glove_args.tempFile = glove_temp;
+        glove_args.profile = profile;
+        start = now_seconds();
+        if (gloveTrain(&glove_args, shuffle_file, vocab_file, NULL, NULL, &model) != 0) return 1;
+        stage[stages++] = (STAGE){"glove", now_seconds() - start, tokens, iter * (bytes / CREC_BYTES), iter * bytes};
+        gloveModelFree(model);
+        if (profile_file != NULL && gloveProfileWrite(profile, profile_file, GLOVE_PROFILE_JSON) != 0) return 1;
+        if (trace_file != NULL && gloveProfileWrite(profile, trace_file, GLOVE_PROFILE_CHROME_TRACE) != 0) return 1;
+        gloveProfileFree(profile);
+
+        if (fused) {
+            fprintf(stderr, "glovePipeline...\n");
+            createGlovePipelineArgs(&pipeline_args);
+            pipeline_args.vocab = vocab_args;
+            pipeline_args.cooccur = cooccur_args;
+            pipeline_args.shuffle = shuffle_args;
+            pipeline_args.glove = glove_args;
+            pipeline_args.vocab.profile = pipeline_args.cooccur.profile = NULL;
+            pipeline_args.shuffle.profile = pipeline_args.glove.profile = NULL;
+            pipeline_args.glove.iter = 0; // What the pipeline changes; training itself is the same as in the glove stage
+            start = now_seconds();
+            if (glovePipeline(&pipeline_args, corpus_file, NULL, shuffle_file, NULL, NULL, &model) != 0) return 1;
+            stage[stages++] = (STAGE){"pipeline_prep", now_seconds() - start, tokens, bytes / CREC_BYTES, bytes};
+            gloveModelFree(model);
+            pipeline_args.glove.iter = iter;
+            start = now_seconds();
+            if (glovePipeline(&pipeline_args, corpus_file, NULL, shuffle_file, NULL, NULL, &model) != 0) return 1;
+            stage[stages++] = (STAGE){"pipeline", now_seconds() - start, tokens, iter * (bytes / CREC_BYTES), iter * bytes};
+            gloveModelFree(model);
+        }
+
+        if (!keep) {
+            remove(corpus_file);
+            remove(vocab_file);
+            remove(cooccur_file);
+            remove(shuffle_file);
+        }
+    }
+
+    if (kernels) {
+        createGloveArgs(&glove_args);
+        for (k = 0; k < KERNEL_SIZES; k++)
+            for (resident = 0; resident < 2; resident++)
+                for (layout = 0; layout < 2; layout++) {
+                    run[runs].vector_size = glove_args.vectorSize = KERNEL_VECTOR_SIZES[k];
+                    run[runs].interleave = glove_args.interleave = layout;
+                    run[runs].rows = resident ? "memory" : "cache";
+                    run[runs].vocab_size = (resident ? MEMORY_BYTES : CACHE_BYTES) / (4 * (KERNEL_VECTOR_SIZES[k] + 1) * (long long)sizeof(double));
+                    if (run[runs].vocab_size < 1) run[runs].vocab_size = 1;
+                    run[runs].updates = kernel_updates;
+                    fprintf(stderr, "Update kernel, vector size %d, rows in %s, %s layout...\n", run[runs].vector_size,
+                            run[runs].rows, layout ? "interleaved" : "separate");
+                    if (gloveBenchmarkUpdates(&glove_args, run[runs].vocab_size, kernel_updates, &run[runs].seconds) != 0) return 1;
+                    runs++;
+                }
+    }
+
+    if (json_file != NULL && (fout = fopen(json_file, "w")) == NULL) {fprintf(stderr, "Unable to open file %s.\n", json_file); return 1;}
+    fprintf(fout, "{\n  \"benchmark\": \"glove_bench\",\n  \"version\": 1,\n");
+    fprintf(fout, "  \"config\": {\"tokens\": %lld, \"vocab\": %lld, \"line_length\": %d, \"zipf\": %g, \"markov\": %g, "
+            "\"seed\": %llu, \"window_size\": %d, \"memory\": %g, \"vector_size\": %d, \"iter\": %d, \"threads\": %d, "
+            "\"kernel_updates\": %lld},\n", tokens, vocab, line_length, zipf, markov, seed, window_size, memory,
+            vector_size, iter, threads, kernel_updates);
+    fprintf(fout, "  \"stages\": [");
+    for (i = 0; i < stages; i++)
+        fprintf(fout, "%s\n    {\"name\": \"%s\", \"seconds\": %.6f, \"tokens\": %lld, \"records\": %lld, \"bytes\": %lld, "
+                "\"tokens_per_sec\": %.6g, \"records_per_sec\": %.6g, \"bytes_per_sec\": %.6g}", (i > 0) ? "," : "",
+                stage[i].name, stage[i].seconds, stage[i].tokens, stage[i].records, stage[i].bytes,
+                per_second(stage[i].tokens, stage[i].seconds), per_second(stage[i].records, stage[i].seconds),
+                per_second(stage[i].bytes, stage[i].seconds));
+    fprintf(fout, "%s],\n  \"kernels\": [", (stages > 0) ? "\n  " : "");
+    for (i = 0; i < runs; i++)
+        fprintf(fout, "%s\n    {\"name\": \"update\", \"vector_size\": %d, \"rows\": \"%s\", \"layout\": \"%s\", "
+                "\"vocab_size\": %lld, \"updates\": %lld, \"seconds\": %.6f, \"updates_per_sec\": %.6g, \"ns_per_update\": %.4f}",
+                (i > 0) ? "," : "", run[i].vector_size, run[i].rows, run[i].interleave ? "interleaved" : "separate",
+                run[i].vocab_size, run[i].updates, run[i].seconds, per_second(run[i].updates, run[i].seconds),
+                1e9 * run[i].seconds / run[i].updates);
+    fprintf(fout, "%s]\n}\n", (runs > 0) ? "\n  " : "");
+    if (fout != stdout) fclose(fout);
+
+    for (i = 0; i < stages; i++)
+        fprintf(stderr, "%-13s %9.3f s %12.4g tokens/s %12.4g records/s %10.4g MB/s\n", stage[i].name, stage[i].seconds,
+                per_second(stage[i].tokens, stage[i].seconds), per_second(stage[i].records, stage[i].seconds),
+                per_second(stage[i].bytes, stage[i].seconds) / 1e6);
+    for (i = 0; i < runs; i++)
+        fprintf(stderr, "update %4d %-6s %-11s %9.1f ns/update\n", run[i].vector_size, run[i].rows,
+                run[i].interleave ? "interleaved" : "separate", 1e9 * run[i].seconds / run[i].updates);
+    return 0;
+}
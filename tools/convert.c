@@ -0,0 +1,98 @@
+//  Convert a text vectors file, such as the pretrained GloVe downloads, to a binary model file
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "glove.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+static const int DTYPES[5] = {-1, GLOVE_DTYPE_FLOAT32, GLOVE_DTYPE_FLOAT64, GLOVE_DTYPE_INT8, GLOVE_DTYPE_PQ};
+
+static int find_arg(char *str, int argc, char **argv) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(str, argv[i])) {
+            if (i == argc - 1) {
+                printf("No argument given for %s\n", str);
+                exit(1);
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Seconds on a monotonic clock, for measuring intervals */
+static double now_seconds() {
+#if defined(_WIN32)
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+int main(int argc, char **argv) {
+    int i, verbose = 1, type = 1, threads = 0;
+    char *vectors_file = NULL, *output_file = NULL;
+    GloveModelFile *model;
+    GloveModelInfo info;
+    double seconds;
+
+    if (argc == 1) {
+        printf("Convert text word vectors to a binary model file\n\n");
+        printf("Usage options:\n");
+        printf("\t-verbose <int>\n");
+        printf("\t\tSet verbosity: 0 or 1 (default)\n");
+        printf("\t-vectors-file <file>\n");
+        printf("\t\tText vectors, one \"word value value ...\" line per word\n");
+        printf("\t-output-file <file>\n");
+        printf("\t\tModel file to write\n");
+        printf("\t-type <int>\n");
+        printf("\t\tStored values: 1: 32-bit floats (default), 2: 64-bit doubles, 3: per-row scaled int8,\n");
+        printf("\t\t4: product quantization\n");
+        printf("\t-threads <int>\n");
+        printf("\t\tNumber of threads parsing the text; default one per processor\n");
+        printf("\nExample usage:\n");
+        printf("./glove_convert -vectors-file glove.840B.300d.txt -output-file glove.840B.300d.glvm\n");
+        return 0;
+    }
+    if ((i = find_arg((char *)"-verbose", argc, argv)) > 0) verbose = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-vectors-file", argc, argv)) > 0) vectors_file = argv[i + 1];
+    if ((i = find_arg((char *)"-output-file", argc, argv)) > 0) output_file = argv[i + 1];
+    if ((i = find_arg((char *)"-type", argc, argv)) > 0) type = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-threads", argc, argv)) > 0) threads = atoi(argv[i + 1]);
+    if (vectors_file == NULL || output_file == NULL) {fprintf(stderr, "Both -vectors-file and -output-file are needed.\n"); return 1;}
+    if (type < 1 || type > 4) {fprintf(stderr, "-type must be 1, 2, 3 or 4.\n"); return 1;}
+
+    seconds = now_seconds();
+    if (gloveVectorsConvert(vectors_file, output_file, DTYPES[type], threads) != 0) return 1;
+    if (verbose > 0 && gloveModelFileOpen(output_file, &model) == 0) {
+        gloveModelFileInfo(model, &info);
+        fprintf(stderr, "Converted %lld words of %d values in %.1f s.\n", info.rows, info.dim, now_seconds() - seconds);
+        gloveModelFileClose(model);
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+//  Build an approximate nearest neighbor index of trained word vectors and report its recall against exact search
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "glove.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+static int find_arg(char *str, int argc, char **argv) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(str, argv[i])) {
+            if (i == argc - 1) {
+                printf("No argument given for %s\n", str);
+                exit(1);
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Seconds on a monotonic clock, for measuring intervals */
+static double now_seconds() {
+#if defined(_WIN32)
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+/* Recall at k and latency of the index for ef = k, 2k, 4k, ... up to max_ef, against exact neighbors of count rows
+ * spread evenly through the vectors, queried with their own vectors */
+static int report_recall(const GloveVectors *vectors, const GloveIndex *index, int count, int k, int max_ef) {
+    long long rows_count = gloveVectorsCount(vectors), *exact, *found, hits;
+    int size = gloveVectorsSize(vectors), q, a, b, ef;
+    float *queries, *scores;
+    double seconds;
+
+    if (count > rows_count) count = (int)rows_count;
+    queries = (float*)malloc((long long)count * size * sizeof(float));
+    exact = (long long*)malloc((long long)count * k * sizeof(long long));
+    found = (long long*)malloc((long long)count * k * sizeof(long long));
+    scores = (float*)malloc((long long)count * k * sizeof(float));
+    for (q = 0; q < count; q++) memcpy(queries + (long long)q * size, gloveVectorsRow(vectors, rows_count * q / count), size * sizeof(float));
+    seconds = now_seconds();
+    if (gloveVectorsNearest(vectors, queries, count, k, 1, exact, scores) != 0) return 1;
+    seconds = now_seconds() - seconds;
+    printf("%d queries, recall at %d against exact search (%.3f ms per query on one thread)\n\n", count, k, 1e3 * seconds / count);
+    printf("      ef      recall    ms/query\n");
+    for (ef = k; ef <= max_ef; ef *= 2) {
+        seconds = now_seconds();
+        if (gloveIndexSearch(index, queries, count, k, ef, 1, found, scores) != 0) return 1;
+        seconds = now_seconds() - seconds;
+        for (q = 0, hits = 0; q < count; q++)
+            for (a = 0; a < k; a++)
+                for (b = 0; b < k; b++) if (found[(long long)q * k + a] == exact[(long long)q * k + b]) {hits++; break;}
+        printf("%8d    %8.4f    %8.4f\n", ef, (double)hits / ((double)count * k), 1e3 * seconds / count);
+    }
+    free(queries);
+    free(exact);
+    free(found);
+    free(scores);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int i, queries = 1000, k = 10, max_ef = 640;
+    char *vectors_file = NULL, *vocab_file = NULL, *index_file = NULL;
+    GloveIndexArgs args;
+    GloveVectors *vectors;
+    GloveIndex *index;
+    double seconds;
+
+    createGloveIndexArgs(&args);
+    if (argc == 1) {
+        printf("Build an approximate nearest neighbor index of word vectors\n\n");
+        printf("Usage options:\n");
+        printf("\t-verbose <int>\n");
+        printf("\t\tSet verbosity: 0, 1 (default), or 2\n");
+        printf("\t-vectors-file <file>\n");
+        printf("\t\tText vectors, binary model file (.glvm) or binary parameters (.bin, with -vocab-file)\n");
+        printf("\t-vocab-file <file>\n");
+        printf("\t\tVocabulary of a .bin parameter file\n");
+        printf("\t-index-file <file>\n");
+        printf("\t\tIndex to write\n");
+        printf("\t-m <int>\n");
+        printf("\t\tLinks per node; default %d\n", args.m);
+        printf("\t-ef-construction <int>\n");
+        printf("\t\tCandidates considered when linking a node; default %d\n", args.efConstruction);
+        printf("\t-threads <int>\n");
+        printf("\t\tNumber of threads; default one per processor\n");
+        printf("\t-queries <int>\n");
+        printf("\t\tRows queried to measure recall against exact search, 0 to skip; default 1000\n");
+        printf("\t-k <int>\n");
+        printf("\t\tNeighbors per query for the recall report; default 10\n");
+        printf("\t-max-ef <int>\n");
+        printf("\t\tLargest ef of the recall report, which doubles from k; default 640\n");
+        printf("\nExample usage:\n");
+        printf("./glove_index -vectors-file vectors.txt -index-file vectors.hnsw\n");
+        return 0;
+    }
+    args.verbose = 1;
+    if ((i = find_arg((char *)"-verbose", argc, argv)) > 0) args.verbose = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-vectors-file", argc, argv)) > 0) vectors_file = argv[i + 1];
+    if ((i = find_arg((char *)"-vocab-file", argc, argv)) > 0) vocab_file = argv[i + 1];
+    if ((i = find_arg((char *)"-index-file", argc, argv)) > 0) index_file = argv[i + 1];
+    if ((i = find_arg((char *)"-m", argc, argv)) > 0) args.m = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-ef-construction", argc, argv)) > 0) args.efConstruction = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-threads", argc, argv)) > 0) args.threads = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-queries", argc, argv)) > 0) queries = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-k", argc, argv)) > 0) k = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-max-ef", argc, argv)) > 0) max_ef = atoi(argv[i + 1]);
+    if (vectors_file == NULL || index_file == NULL) {fprintf(stderr, "Both -vectors-file and -index-file are needed.\n"); return 1;}
+    if (k < 1) k = 1;
+
+    if (gloveVectorsLoad(vectors_file, vocab_file, &vectors) != 0) return 1;
+    seconds = now_seconds();
+    if (gloveIndexBuild(&args, vectors, index_file) != 0) {gloveVectorsFree(vectors); return 1;}
+    if (args.verbose > 0) fprintf(stderr, "Built in %.1f s.\n", now_seconds() - seconds);
+    if (queries > 0) {
+        if (gloveIndexOpen(index_file, &index) != 0) {gloveVectorsFree(vectors); return 1;}
+        report_recall(vectors, index, queries, k, max_ef);
+        gloveIndexClose(index);
+    }
+    gloveVectorsFree(vectors);
+    return 0;
+}
@@ -0,0 +1,149 @@
+//  Interactive nearest neighbor lookup over trained word vectors, the native counterpart of eval/python/distance.py
+//
+//  Copyright (c) 2016 Galen Cochrane
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "glove.h"
+
+#define MAX_LINE_LENGTH 10000
+#define MAX_TERMS 64 // Words of one query line
+
+typedef struct query {
+    char line[MAX_LINE_LENGTH];
+    long long terms[MAX_TERMS]; // Rows of the query's words, excluded from its neighbors
+    int num_terms;
+} QUERY;
+
+static int find_arg(char *str, int argc, char **argv) {
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(str, argv[i])) {
+            if (i == argc - 1) {
+                printf("No argument given for %s\n", str);
+                exit(1);
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Sum the vectors of the words of q->line into query; returns 1, after saying which, if a word is unknown */
+static int parse_query(const GloveVectors *vectors, QUERY *q, float *query) {
+    char term[MAX_LINE_LENGTH], *p = q->line;
+    const float *row;
+    int a, size = gloveVectorsSize(vectors);
+
+    memset(query, 0, size * sizeof(float));
+    for (q->num_terms = 0; q->num_terms < MAX_TERMS; ) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        for (a = 0; *p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'; ) term[a++] = *p++;
+        if (a == 0) break;
+        term[a] = '\0';
+        q->terms[q->num_terms] = gloveVectorsFind(vectors, term);
+        if (q->terms[q->num_terms] < 0) {
+            printf("Word: %s  Out of dictionary!\n\n", term);
+            return 1;
+        }
+        printf("Word: %s  Position in vocabulary: %lld\n", term, q->terms[q->num_terms]);
+        row = gloveVectorsRow(vectors, q->terms[q->num_terms++]);
+        for (a = 0; a < size; a++) query[a] += row[a];
+    }
+    return q->num_terms == 0;
+}
+
+/* Print the first n neighbors of a query that are not among its words */
+static void print_neighbors(const GloveVectors *vectors, const QUERY *q, const long long *rows, const float *scores,
+                            int k, int n) {
+    int a, b, shown = 0;
+    printf("\n                               Word       Cosine distance\n");
+    printf("---------------------------------------------------------\n");
+    for (a = 0; a < k && shown < n && rows[a] >= 0; a++) {
+        for (b = 0; b < q->num_terms && q->terms[b] != rows[a]; b++);
+        if (b < q->num_terms) continue;
+        printf("%35s\t\t%f\n", gloveVectorsWord(vectors, rows[a]), scores[a]);
+        shown++;
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int i, n = 100, threads = 8, batch = 1, count, a, k;
+    char *vectors_file = NULL, *vocab_file = NULL;
+    GloveVectors *vectors;
+    QUERY *queries;
+    float *query_vectors, *scores;
+    long long *rows;
+    int eof = 0, size;
+
+    if (argc == 1) {
+        printf("Nearest neighbors of words and word sums by cosine similarity\n\n");
+        printf("Usage options:\n");
+        printf("\t-vectors-file <file>\n");
+        printf("\t\tText vectors, binary model file (.glvm) or binary parameters (.bin, with -vocab-file)\n");
+        printf("\t-vocab-file <file>\n");
+        printf("\t\tVocabulary of a .bin parameter file\n");
+        printf("\t-n <int>\n");
+        printf("\t\tNumber of neighbors to show; default 100\n");
+        printf("\t-threads <int>\n");
+        printf("\t\tNumber of threads; default 8\n");
+        printf("\t-batch <int>\n");
+        printf("\t\tQuery lines read from stdin before searching, for scripted use; default 1\n");
+        printf("\nExample usage:\n");
+        printf("echo 'king queen' | ./glove_neighbors -vectors-file vectors.txt -n 10\n");
+        return 0;
+    }
+    if ((i = find_arg((char *)"-vectors-file", argc, argv)) > 0) vectors_file = argv[i + 1];
+    if ((i = find_arg((char *)"-vocab-file", argc, argv)) > 0) vocab_file = argv[i + 1];
+    if ((i = find_arg((char *)"-n", argc, argv)) > 0) n = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-threads", argc, argv)) > 0) threads = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-batch", argc, argv)) > 0) batch = atoi(argv[i + 1]);
+    if (vectors_file == NULL) {fprintf(stderr, "No -vectors-file given.\n"); return 1;}
+    if (n < 1) n = 1;
+    if (batch < 1) batch = 1;
+
+    if (gloveVectorsLoad(vectors_file, vocab_file, &vectors) != 0) return 1;
+    size = gloveVectorsSize(vectors);
+    fprintf(stderr, "Loaded %lld vectors of size %d.\n", gloveVectorsCount(vectors), size);
+    queries = (QUERY*)malloc(batch * sizeof(QUERY));
+    query_vectors = (float*)malloc((long long)batch * size * sizeof(float));
+    rows = (long long*)malloc((long long)batch * (n + MAX_TERMS) * sizeof(long long));
+    scores = (float*)malloc((long long)batch * (n + MAX_TERMS) * sizeof(float));
+
+    while (!eof) {
+        for (count = 0; count < batch; ) {
+            if (batch == 1) {printf("\nEnter word or sentence (EXIT to break): "); fflush(stdout);}
+            if (fgets(queries[count].line, MAX_LINE_LENGTH, stdin) == NULL || strncmp(queries[count].line, "EXIT", 4) == 0) {
+                eof = 1;
+                break;
+            }
+            if (parse_query(vectors, &queries[count], query_vectors + (long long)count * size) == 0) count++;
+        }
+        for (a = 0, k = n; a < count; a++) if (n + queries[a].num_terms > k) k = n + queries[a].num_terms; // Room for the query words, which are dropped
+        if (gloveVectorsNearest(vectors, query_vectors, count, k, threads, rows, scores) != 0) break;
+        for (a = 0; a < count; a++) {
+            if (batch > 1) printf("\nQuery: %s", queries[a].line);
+            print_neighbors(vectors, &queries[a], rows + (long long)a * k, scores + (long long)a * k, k, n);
+        }
+    }
+    free(queries);
+    free(query_vectors);
+    free(rows);
+    free(scores);
+    gloveVectorsFree(vectors);
+    return 0;
+}